@@ -0,0 +1,475 @@
+/*
+ *  File: FLATQuery.cpp
+ *
+ *  Build a FLAT index over a binary data file and run range or kNN queries on it
+ *
+ *  - queries come from a query file (see SpatialQuery::ReadQueries) or are
+ *    random boxes of a given volume in the universe of the data
+ *  - with -k the queries are kNN queries around random points of the universe
+ *  - moving queries (from the query file or random ones with -m) are run a
+ *    step at a time, every step reusing what the last one crawled
+ *  - prints the FLAT statistics of every query and their sum
+ *  - payload pages go through a page cache of the given size
+ *  - optionally runs the queries as a batch, overlapping queries share their crawl
+ *  - optionally reads ahead of the crawl on prefetching threads
+ *  - optionally runs range and kNN queries on many query threads at once
+ *  - optionally checks every result count (every kNN distance) against a scan of the data file
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <pthread.h>
+
+#include "FLATIndex.hpp"
+#include "DataFileReader.hpp"
+#include "Timer.hpp"
+
+/*
+ * Input parameters
+ */
+std::string inputFile                   = "";               // data to index or to check against
+std::string indexStem                   = "";
+std::string queryFile                   = "";
+bool build                              = false;
+int objects                             = 0;                // objects to index, 0 for all
+int buildThreads                        = 1;                // threads inducing the links
+bool packPages                          = false;
+int randomQueries                       = 100;
+double queryVolume                      = 0.0001;           // fraction of the universe
+unsigned int kNearest                   = 0;                // neighbours of kNN queries, 0 for range queries
+int movingSteps                         = 0;                // steps of random moving queries, 0 for none
+double cacheMB                          = 0;                // payload page cache, 0 for none
+unsigned int cacheShards                = 16;
+unsigned int batchGroup                 = 0;                // queries sharing a crawl, 0 for no batch
+int prefetchThreads                     = 0;
+unsigned int maxInFlight                = 64;
+int queryThreads                        = 1;
+bool memoryResident                     = false;
+bool hugePages                          = false;
+bool check                              = false;
+bool perQuery                           = false;
+
+void usage(const char *program_name) {
+
+    printf("   Usage: %s -x <stem> [options]\n", program_name);
+    printf("   -h               Print this help menu.\n");
+    printf("   -x               <stem> index files\n");
+    printf("   -i               <path> binary data file (to build, check or place random queries)\n");
+    printf("   -b               build the index over the data file first\n");
+    printf("   -n               number of objects to index (0 for all)\n");
+    printf("   -t               threads inducing the links while building\n");
+    printf("   -z               pack the payload pages while building\n");
+    printf("   -q               <path> query file\n");
+    printf("   -r               number of random range queries (without a query file)\n");
+    printf("   -V               volume of the random queries, fraction of the universe\n");
+    printf("   -k               run kNN queries for this many neighbours around random points\n");
+    printf("   -m               run random moving queries of this many steps\n");
+    printf("   -C               payload page cache in MB (0 - no cache)\n");
+    printf("   -S               shards of the page cache\n");
+    printf("   -B               run as a batch, at most this many queries share a crawl (0 - no batch)\n");
+    printf("   -P               prefetching threads (0 - no prefetching)\n");
+    printf("   -I               maximum prefetch requests in flight\n");
+    printf("   -T               query threads for range and kNN queries\n");
+    printf("   -M               load the whole index into memory\n");
+    printf("   -H               use huge pages for the index in memory\n");
+    printf("   -c               check the results against a scan of the data file\n");
+    printf("   -p               print the statistics of every query\n");
+
+}
+
+//Parsing Arguments
+void parse_args(int argc, const char* argv[]) {
+
+    int x;
+    for ( x= 1; x < argc; ++x)
+    {
+        switch (argv[x][1])
+        {
+            case 'h':
+                usage(argv[0]);
+                exit(1);
+                break;
+		case 'x':
+			if (++x < argc) indexStem = argv[x];
+            break;
+		case 'i':
+			if (++x < argc) inputFile = argv[x];
+            break;
+		case 'b':
+			build = true;
+            break;
+		case 'n':
+			sscanf(argv[++x], "%d", &objects);
+            break;
+		case 't':
+			sscanf(argv[++x], "%d", &buildThreads);
+            break;
+		case 'z':
+			packPages = true;
+            break;
+		case 'q':
+			if (++x < argc) queryFile = argv[x];
+            break;
+		case 'r':
+			sscanf(argv[++x], "%d", &randomQueries);
+            break;
+		case 'V':
+			sscanf(argv[++x], "%lf", &queryVolume);
+            break;
+		case 'k':
+			sscanf(argv[++x], "%u", &kNearest);
+            break;
+		case 'm':
+			sscanf(argv[++x], "%d", &movingSteps);
+            break;
+		case 'C':
+			sscanf(argv[++x], "%lf", &cacheMB);
+            break;
+		case 'S':
+			sscanf(argv[++x], "%u", &cacheShards);
+            break;
+		case 'B':
+			sscanf(argv[++x], "%u", &batchGroup);
+            break;
+		case 'P':
+			sscanf(argv[++x], "%d", &prefetchThreads);
+            break;
+		case 'I':
+			sscanf(argv[++x], "%u", &maxInFlight);
+            break;
+		case 'T':
+			sscanf(argv[++x], "%d", &queryThreads);
+            break;
+		case 'M':
+			memoryResident = true;
+            break;
+		case 'H':
+			hugePages = true;
+            break;
+		case 'c':
+			check = true;
+            break;
+		case 'p':
+			perQuery = true;
+            break;
+        default:
+            fprintf(stderr, "Error: Invalid command line parameter, %c\n", argv[x][1]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+}
+
+// results of every query by a scan of the data file
+void scan(std::vector<FLAT::SpatialQuery>& queries, std::vector<FLAT::uint64>& results)
+{
+    results.assign(queries.size(),0);
+    FLAT::DataFileReader* input = new FLAT::DataFileReader(inputFile);
+    FLAT::uint64 scanned = 0;
+    while ((objects == 0 || scanned < (FLAT::uint64)objects) && input->hasNext())
+    {
+        FLAT::SpatialObject* sobj = input->getNext();
+        for (unsigned q = 0; q < queries.size(); q++)
+            if (FLAT::overlapsRegion(sobj,queries[q].Region)) results[q]++;
+        delete sobj;
+        scanned++;
+    }
+    delete input;
+}
+
+// distances of the k nearest objects of every query point by a scan of the data file, nearest first
+void scanNearest(std::vector<FLAT::SpatialQuery>& queries, std::vector< std::vector<FLAT::bigSpaceUnit> >& distances)
+{
+    std::vector< std::priority_queue<FLAT::bigSpaceUnit> > nearest(queries.size());
+    FLAT::DataFileReader* input = new FLAT::DataFileReader(inputFile);
+    FLAT::uint64 scanned = 0;
+    while ((objects == 0 || scanned < (FLAT::uint64)objects) && input->hasNext())
+    {
+        FLAT::SpatialObject* sobj = input->getNext();
+        for (unsigned q = 0; q < queries.size(); q++)
+        {
+            nearest[q].push(sobj->pointDistance(queries[q].Point));
+            if (nearest[q].size() > kNearest) nearest[q].pop();
+        }
+        delete sobj;
+        scanned++;
+    }
+    delete input;
+
+    distances.assign(queries.size(),std::vector<FLAT::bigSpaceUnit>());
+    for (unsigned q = 0; q < queries.size(); q++)
+    {
+        for (; !nearest[q].empty(); nearest[q].pop()) distances[q].push_back(nearest[q].top());
+        std::reverse(distances[q].begin(),distances[q].end());
+    }
+}
+
+// the queries handed out to the query threads one at a time
+struct QueryWork
+{
+    FLAT::FLATIndex* index;
+    std::vector<FLAT::SpatialQuery>* queries;
+    std::vector<FLAT::uint64>* found;
+    std::vector< std::vector<FLAT::bigSpaceUnit> >* distances;
+    unsigned next;
+};
+
+void* queryThread(void* arg)
+{
+    QueryWork* work = (QueryWork*)arg;
+    while (true)
+    {
+        unsigned q = __sync_fetch_and_add(&work->next,1);
+        if (q >= work->queries->size()) break;
+
+        FLAT::SpatialQuery& query = (*work->queries)[q];
+        std::vector<FLAT::SpatialObject*> results;
+        if (kNearest > 0)
+        {
+            FLAT::FLATIndex::kNearestNeighbour(work->index,query,results,kNearest);
+            for (unsigned r = 0; r < results.size(); r++)
+                (*work->distances)[q].push_back(results[r]->pointDistance(query.Point));
+        }
+        else
+            FLAT::FLATIndex::rangeQuery(work->index,query,results);
+        for (unsigned r = 0; r < results.size(); r++) delete results[r];
+        (*work->found)[q] = results.size();
+    }
+    return NULL;
+}
+
+int main(int argc, const char* argv[])
+{
+    parse_args(argc, argv);
+
+    if (indexStem.empty() || ((build || check || queryFile.empty()) && inputFile.empty()))
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    FLAT::Timer timer;
+    if (build)
+    {
+        timer.start();
+        FLAT::FLATIndex::buildIndexWithCount(inputFile,"binary",indexStem,objects,buildThreads,
+                packPages ? FLAT::PACKED_PAGES : FLAT::RAW_PAGES);
+        timer.stop();
+        std::cout << "Built " << indexStem << " in " << timer << " s" << std::endl;
+    }
+
+    FLAT::FLATIndex* index = memoryResident ? FLAT::FLATIndex::loadIndexMemory(indexStem,hugePages)
+                                            : FLAT::FLATIndex::loadIndex(indexStem);
+    FLAT::FLATIndex::setPageCache(index,(FLAT::uint64)(cacheMB*1024*1024),cacheShards);
+    FLAT::FLATIndex::setPrefetching(index,prefetchThreads,maxInFlight);
+    if (queryThreads > 1) FLAT::FLATIndex::setConcurrentReaders(index);
+
+    std::vector<FLAT::SpatialQuery> queries;
+    if (kNearest > 0)
+    {
+        // random points in the universe of the data file
+        FLAT::DataFileReader* input = new FLAT::DataFileReader(inputFile);
+        FLAT::Box universe = input->universe;
+        delete input;
+
+        for (int q = 0; q < randomQueries; q++)
+        {
+            FLAT::SpatialQuery query;
+            query.type = FLAT::KNN_QUERY;
+            FLAT::Vertex::randomPoint(universe,query.Point);
+            queries.push_back(query);
+        }
+    }
+    else if (movingSteps > 0)
+    {
+        // random boxes moving half their size per step, turning back at the border of the universe
+        FLAT::DataFileReader* input = new FLAT::DataFileReader(inputFile);
+        FLAT::Box universe = input->universe;
+        universe.isEmpty = false;
+        delete input;
+
+        for (int q = 0; q < randomQueries; q++)
+        {
+            FLAT::SpatialQuery query;
+            query.type = FLAT::MOVING_QUERY;
+            FLAT::Box box;
+            FLAT::Box::randomBox(universe,queryVolume,box);
+            box.isEmpty = false;
+            double direction[DIMENSION];
+            for (int d = 0; d < DIMENSION; d++) direction[d] = (double)rand()/RAND_MAX - 0.5;
+            for (int s = 0; s < movingSteps; s++)
+            {
+                query.Moving.push_back(box);
+                for (int d = 0; d < DIMENSION; d++)
+                {
+                    double shift = direction[d] * (box.high[d]-box.low[d]);
+                    if (box.low[d]+shift < universe.low[d] || box.high[d]+shift > universe.high[d])
+                    {
+                        direction[d] = -direction[d];
+                        shift = -shift;
+                    }
+                    box.low[d] += shift;
+                    box.high[d] += shift;
+                }
+            }
+            queries.push_back(query);
+        }
+    }
+    else if (!queryFile.empty())
+        FLAT::SpatialQuery::ReadQueries(queries,queryFile);
+    else
+    {
+        // random boxes in the universe of the data file
+        FLAT::DataFileReader* input = new FLAT::DataFileReader(inputFile);
+        FLAT::Box universe = input->universe;
+        universe.isEmpty = false;
+        delete input;
+
+        for (int q = 0; q < randomQueries; q++)
+        {
+            FLAT::SpatialQuery query;
+            query.type = FLAT::RANGE_QUERY;
+            FLAT::Box::randomBox(universe,queryVolume,query.Region);
+            query.Region.isEmpty = false;
+            queries.push_back(query);
+        }
+    }
+
+    FLAT::QueryStatistics total;
+    std::vector<FLAT::uint64> found;
+    std::vector< std::vector<FLAT::bigSpaceUnit> > foundDistances;
+    if (perQuery) { total.printFLATheader(); std::cout << std::endl; }
+    if (!queries.empty() && queries[0].type == FLAT::MOVING_QUERY)
+    {
+        // every step becomes a range query of its own for the statistics and the check
+        std::vector<FLAT::SpatialQuery> steps;
+        std::vector<FLAT::Millisecond> latency;
+        FLAT::uint64 pagesRead = 0, pagesReused = 0;
+        for (unsigned q = 0; q < queries.size(); q++)
+        {
+            FLAT::MovingCrawl crawl(index);
+            for (unsigned s = 0; s < queries[q].Moving.size(); s++)
+            {
+                FLAT::SpatialQuery step;
+                step.type = FLAT::RANGE_QUERY;
+                step.Region = queries[q].Moving[s];
+                std::vector<FLAT::SpatialObject*> results;
+                crawl.step(step.Region,results,step.stats);
+                found.push_back(results.size());
+                latency.push_back((FLAT::Millisecond)step.stats.executionTime._elapsed_milliseconds);
+
+                if (perQuery) step.stats.printFLATstats();
+                total.add(step.stats);
+                total.ObjectSize = step.stats.ObjectSize;
+                steps.push_back(step);
+            }
+            pagesRead += crawl.pagesRead;
+            pagesReused += crawl.pagesReused;
+        }
+        std::cout << queries.size() << " moving queries, " << steps.size() << " steps" << std::endl;
+        if (!latency.empty())
+        {
+            std::vector<FLAT::Millisecond> sorted(latency);
+            std::sort(sorted.begin(),sorted.end());
+            double sum = 0;
+            for (unsigned s = 0; s < sorted.size(); s++) sum += sorted[s];
+            std::cout << "Step latency (ms): mean " << sum/sorted.size() << ", median " << sorted[sorted.size()/2]
+                      << ", 99th " << sorted[sorted.size()*99/100] << ", max " << sorted.back() << std::endl;
+        }
+        std::cout << "Payload pages of the steps: " << pagesRead << " read, " << pagesReused << " kept from the step before" << std::endl;
+        queries.swap(steps);
+    }
+    else if (batchGroup > 0)
+    {
+        std::vector< std::vector<FLAT::SpatialObject*> > results;
+        FLAT::FLATIndex::batchRangeQuery(index,queries,results,total,batchGroup);
+        for (unsigned q = 0; q < queries.size(); q++)
+        {
+            for (unsigned r = 0; r < results[q].size(); r++) delete results[q][r];
+            found.push_back(results[q].size());
+            if (perQuery) queries[q].stats.printFLATstats();
+        }
+    }
+    else
+    {
+        found.assign(queries.size(),0);
+        foundDistances.assign(queries.size(),std::vector<FLAT::bigSpaceUnit>());
+        QueryWork work = { index, &queries, &found, &foundDistances, 0 };
+        FLAT::Timer wall;
+        wall.start();
+        if (queryThreads <= 1)
+            queryThread(&work);
+        else
+        {
+            std::vector<pthread_t> threads(queryThreads);
+            for (int t = 0; t < queryThreads; t++) pthread_create(&threads[t],NULL,queryThread,&work);
+            for (int t = 0; t < queryThreads; t++) pthread_join(threads[t],NULL);
+        }
+        wall.stop();
+
+        for (unsigned q = 0; q < queries.size(); q++)
+        {
+            if (perQuery) queries[q].stats.printFLATstats();
+            total.add(queries[q].stats);
+            total.ObjectSize = queries[q].stats.ObjectSize;
+        }
+        if (wall._elapsed_milliseconds > 0)
+            std::cout << queries.size() << " queries on " << queryThreads << " threads in " << wall << " s, "
+                      << queries.size()*1000.0/wall._elapsed_milliseconds << " queries/s" << std::endl;
+    }
+
+    std::cout << queries.size() << " queries" << std::endl;
+    total.printFLATheader(); std::cout << std::endl;
+    total.printFLATstats();
+    std::cout << "Payload pages: " << total.FLAT_payLoadCacheHits << " cache hits, "
+              << total.FLAT_payLoadCacheMisses << " misses" << std::endl;
+    if (index->prefetcher != NULL)
+        std::cout << "Prefetched: " << total.FLAT_prefetchMetaHits << " metadata and "
+                  << total.FLAT_prefetchPayLoadHit << " payload pages used, "
+                  << index->prefetcher->issued << " requests, " << index->prefetcher->dropped << " dropped" << std::endl;
+
+    if (check && kNearest > 0)
+    {
+        // the neighbours may differ on ties, their distances may not
+        std::vector< std::vector<FLAT::bigSpaceUnit> > expected;
+        scanNearest(queries,expected);
+        unsigned wrong = 0;
+        for (unsigned q = 0; q < queries.size(); q++)
+        {
+            bool agree = foundDistances[q].size() == expected[q].size();
+            for (unsigned r = 0; agree && r < expected[q].size(); r++)
+                agree = fabs(foundDistances[q][r]-expected[q][r]) <= 1e-9*(1+fabs(expected[q][r]));
+            if (!agree)
+            {
+                std::cout << "Query " << q << " " << queries[q].Point << ": " << found[q]
+                          << " neighbours, the scan finds " << expected[q].size();
+                if (!foundDistances[q].empty() && !expected[q].empty())
+                    std::cout << ", farthest at " << foundDistances[q].back() << " and " << expected[q].back();
+                std::cout << std::endl;
+                wrong++;
+            }
+        }
+        std::cout << queries.size()-wrong << " of " << queries.size() << " queries agree with the scan" << std::endl;
+    }
+    else if (check)
+    {
+        std::vector<FLAT::uint64> expected;
+        scan(queries,expected);
+        unsigned wrong = 0;
+        for (unsigned q = 0; q < queries.size(); q++)
+            if (found[q] != expected[q])
+            {
+                std::cout << "Query " << q << " " << queries[q].Region << ": " << found[q]
+                          << " results, the scan finds " << expected[q] << std::endl;
+                wrong++;
+            }
+        std::cout << queries.size()-wrong << " of " << queries.size() << " queries agree with the scan" << std::endl;
+    }
+
+    FLAT::FLATIndex::unLoadIndex(index);
+    return 0;
+}
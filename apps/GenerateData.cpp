@@ -0,0 +1,200 @@
+/*
+ *  File: GenerateData.cpp
+ *
+ *  Synthetic datasets in the binary input format of SpatialJoin
+ *
+ *  - uniform, normal, clustered (gaussian mixture) or skewed object centers
+ *  - vertices, boxes, segments or cones with a distribution of sizes
+ *  - generated and written in chunks by several threads (see FLAT::DataGenerator)
+ *
+ */
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+
+#include "DataGenerator.hpp"
+#include "Timer.hpp"
+
+/*
+ * Input parameters
+ */
+FLAT::uint64 objects                    = 1000000;          // objects to generate
+int distribution                        = FLAT::UNIFORM;
+int objectType                          = FLAT::BOX;
+int sizeDistribution                    = FLAT::SIZE_UNIFORM;
+double minSize                          = 1;
+double maxSize                          = 10;
+double minRadius                        = 0.1;
+double maxRadius                        = 1;
+double universeSize                     = 1000;             // the universe is [0,universeSize]^3
+unsigned int clusters                   = 10;
+double sigma                            = 0.02;             // of the clusters
+double normalSigma                      = 0.25;
+double skew                             = 4;
+unsigned int seed                       = 1;
+unsigned int clusterSeed                = 1;
+int threads                             = 1;
+FLAT::uint64 chunkSize                  = 65536;
+std::string outputFile                  = "";
+bool verbose                            = true;
+
+void usage(const char *program_name) {
+
+    printf("   Usage: %s -o <path> [options]\n", program_name);
+    printf("   -h               Print this help menu.\n");
+    printf("   -o               <path> output file\n");
+    printf("   -n               number of objects\n");
+    printf("   -D               distribution of the centers (0 - Uniform; 1 - Clustered; 2 - Skewed; 3 - Normal)\n");
+    printf("   -t               object type (0 - Vertex; 1 - Box; 2 - Cone; 5 - Segment)\n");
+    printf("   -S               size distribution (0 - Constant; 1 - Uniform; 2 - Normal; 3 - Exponential)\n");
+    printf("   -z               <min> <max> object size: box side, segment or cone length\n");
+    printf("   -r               <min> <max> radius of segments and cones\n");
+    printf("   -u               size of the universe per dimension\n");
+    printf("   -c               number of clusters\n");
+    printf("   -g               deviation of the clusters, fraction of the universe\n");
+    printf("   -G               deviation of the normal distribution, fraction of the universe\n");
+    printf("   -k               skew exponent\n");
+    printf("   -s               seed\n");
+    printf("   -C               seed of the cluster centers (same for datasets to be joined)\n");
+    printf("   -p               threads\n");
+    printf("   -b               objects per chunk\n");
+    printf("   -v               verbose\n");
+
+}
+
+//Parsing Arguments
+void parse_args(int argc, const char* argv[]) {
+
+    int x;
+    int t;
+    for ( x= 1; x < argc; ++x)
+    {
+        switch (argv[x][1])
+        {
+            case 'h':
+                usage(argv[0]);
+                exit(1);
+                break;
+		case 'o':
+			if (++x < argc) outputFile = argv[x];
+            break;
+		case 'n':
+			sscanf(argv[++x], "%lu", &objects);
+            break;
+		case 'D':
+			sscanf(argv[++x], "%d", &distribution);
+            break;
+		case 't':
+			sscanf(argv[++x], "%d", &objectType);
+            break;
+		case 'S':
+			sscanf(argv[++x], "%d", &sizeDistribution);
+            break;
+		case 'z':
+			sscanf(argv[++x], "%lf", &minSize);
+			sscanf(argv[++x], "%lf", &maxSize);
+            break;
+		case 'r':
+			sscanf(argv[++x], "%lf", &minRadius);
+			sscanf(argv[++x], "%lf", &maxRadius);
+            break;
+		case 'u':
+			sscanf(argv[++x], "%lf", &universeSize);
+            break;
+		case 'c':
+			sscanf(argv[++x], "%u", &clusters);
+            break;
+		case 'g':
+			sscanf(argv[++x], "%lf", &sigma);
+            break;
+		case 'G':
+			sscanf(argv[++x], "%lf", &normalSigma);
+            break;
+		case 'k':
+			sscanf(argv[++x], "%lf", &skew);
+            break;
+		case 's':
+			sscanf(argv[++x], "%u", &seed);
+            break;
+		case 'C':
+			sscanf(argv[++x], "%u", &clusterSeed);
+            break;
+		case 'p':
+			sscanf(argv[++x], "%d", &threads);
+            break;
+		case 'b':
+			sscanf(argv[++x], "%lu", &chunkSize);
+            break;
+		case 'v':       /* verbose */
+                        t = 1;
+			sscanf(argv[++x], "%u", &t);
+                        verbose = (t == 1) ? true : false;
+            break;
+        default:
+            fprintf(stderr, "Error: Invalid command line parameter, %c\n", argv[x][1]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    parse_args(argc, argv);
+
+    if (outputFile.empty())
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    if (distribution < 0 || distribution >= FLAT::DISTRIBUTIONS)
+    {
+        std::cout << "No such distribution!" << std::endl;
+        exit(0);
+    }
+    if (sizeDistribution < 0 || sizeDistribution >= FLAT::SIZE_DISTRIBUTIONS)
+    {
+        std::cout << "No such size distribution!" << std::endl;
+        exit(0);
+    }
+    if (objectType != FLAT::VERTEX && objectType != FLAT::BOX && objectType != FLAT::CONE && objectType != FLAT::SEGMENT)
+    {
+        std::cout << "Only vertices, boxes, cones and segments can be generated!" << std::endl;
+        exit(0);
+    }
+
+    FLAT::DataGenerator generator(seed);
+    generator.universe.low  = FLAT::Vertex(0,0,0);
+    generator.universe.high = FLAT::Vertex(universeSize,universeSize,universeSize);
+    generator.objectType        = (FLAT::SpatialObjectType)objectType;
+    generator.sizeDistribution  = (FLAT::SizeDistribution)sizeDistribution;
+    generator.minSize           = minSize;
+    generator.maxSize           = maxSize;
+    generator.minRadius         = minRadius;
+    generator.maxRadius         = maxRadius;
+    generator.clusters          = clusters;
+    generator.sigma             = sigma;
+    generator.normalSigma       = normalSigma;
+    generator.skew              = skew;
+    generator.clusterSeed       = clusterSeed;
+    generator.threads           = threads;
+    generator.chunkSize         = chunkSize;
+
+    if (verbose)
+        std::cout << "Generating " << objects << " objects, "
+                  << FLAT::DataGenerator::getTitle((FLAT::DataDistribution)distribution) << " centers, "
+                  << FLAT::DataGenerator::getTitle((FLAT::SizeDistribution)sizeDistribution) << " sizes, on "
+                  << threads << " threads" << std::endl;
+
+    FLAT::Timer timer;
+    timer.start();
+    if (!generator.generate((FLAT::DataDistribution)distribution,objects,outputFile))
+        exit(0);
+    timer.stop();
+
+    if (verbose)
+        std::cout << "Written " << outputFile << " in " << timer << " s" << std::endl;
+
+    return 0;
+}
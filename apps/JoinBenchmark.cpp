@@ -0,0 +1,439 @@
+/*
+ *  File: JoinBenchmark.cpp
+ *
+ *  Reproducible benchmark of the spatial join algorithms
+ *
+ *  - generates uniform, gaussian and skewed datasets with a fixed seed
+ *    (cached in the data directory, see FLAT::DataGenerator)
+ *  - reads every dataset pair once and runs every selected algorithm on it,
+ *    first the warmup runs and then the measured repetitions
+ *  - writes latency, throughput and memory of every configuration as JSON
+ *    or CSV
+ *
+ */
+
+#include <unistd.h>
+#include <ios>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+
+#include "algoPS.h"
+#include "algoNL.h"
+#include "S3Hash.h"
+#include "PBSMHash.h"
+#include "TOUCH.h"
+#include "DataGenerator.hpp"
+
+#define bench_NL                        0
+#define bench_PS                        1
+#define bench_SGrid                     2
+#define bench_S3                        3
+#define bench_PBSM                      4
+#define bench_TOUCH_TD                  5
+#define bench_TOUCH_BU                  6
+#define bench_TOUCH_TDD                 7
+#define bench_TOUCH_TDF                 8
+#define bench_Configurations            9
+
+/*
+ * Input parameters
+ */
+FLAT::uint64 sizeA                      = 10000;            // objects in A
+FLAT::uint64 sizeB                      = 10000;            // objects in B
+double epsilon                          = 5;                // the epsilon of the similarity join
+unsigned int seed                       = 42;               // seed of the generated datasets
+int warmup                              = 1;                // runs before measuring
+int repetitions                         = 3;                // measured runs
+int leafsize                            = 100;              // TOUCH leaf size
+int nodesize                            = 2;                // TOUCH fanout
+int localPartitions                     = 100;              // SGrid resolution
+std::string distributions               = "012";            // datasets to generate
+std::string configurations              = "012345678";      // algorithms to run
+std::string dataDir                     = ".";              // where the datasets are kept
+std::string outputFile                  = "benchmark.json";
+bool csv                                = false;            // output format
+bool verbose                            = false;
+
+void usage(const char *program_name) {
+
+    printf("   Usage: %s\n", program_name);
+    printf("   -h               Print this help menu.\n");
+    printf("   -n               #A #B  number of objects to generate\n");
+    printf("   -e               Epsilon of the similarity join\n");
+    printf("   -D               distributions, e.g. 012 (0 - Uniform; 1 - Clustered; 2 - Skewed; 3 - Normal)\n");
+    printf("   -a               algorithms, e.g. 012345678\n");
+    printf("      0:NL 1:PS 2:SGrid 3:S3 4:PBSM 5:TOUCH TD 6:TOUCH BU 7:TOUCH TDD 8:TOUCH TDF\n");
+    printf("   -w               warmup runs\n");
+    printf("   -r               measured repetitions\n");
+    printf("   -s               seed of the datasets\n");
+    printf("   -l               TOUCH leaf size\n");
+    printf("   -b               TOUCH fanout\n");
+    printf("   -g               number of SGH cells per dimension\n");
+    printf("   -d               <path> directory of the generated datasets\n");
+    printf("   -o               <path> output file\n");
+    printf("   -f               output format (0 - JSON; 1 - CSV)\n");
+    printf("   -v               verbose\n");
+
+}
+
+//Parsing Arguments
+void parse_args(int argc, const char* argv[]) {
+
+    int x;
+    int t;
+    for ( x= 1; x < argc; ++x)
+    {
+        switch (argv[x][1])
+        {
+            case 'h':
+                usage(argv[0]);
+                exit(1);
+                break;
+		case 'n':
+			sscanf(argv[++x], "%lu", &sizeA);
+			sscanf(argv[++x], "%lu", &sizeB);
+            break;
+		case 'e':       /* epsilon */
+			sscanf(argv[++x], "%lf", &epsilon);
+            break;
+		case 'D':
+			if (++x < argc) distributions = argv[x];
+            break;
+		case 'a':
+			if (++x < argc) configurations = argv[x];
+            break;
+		case 'w':
+			sscanf(argv[++x], "%d", &warmup);
+            break;
+		case 'r':
+			sscanf(argv[++x], "%d", &repetitions);
+            break;
+		case 's':
+			sscanf(argv[++x], "%u", &seed);
+            break;
+		case 'l':
+			sscanf(argv[++x], "%d", &leafsize);
+            break;
+		case 'b':
+			sscanf(argv[++x], "%d", &nodesize);
+            break;
+		case 'g':
+			sscanf(argv[++x], "%d", &localPartitions);
+            break;
+		case 'd':
+			if (++x < argc) dataDir = argv[x];
+            break;
+		case 'o':
+			if (++x < argc) outputFile = argv[x];
+            break;
+		case 'f':
+			sscanf(argv[++x], "%d", &t);
+			csv = (t == 1);
+            break;
+		case 'v':       /* verbose */
+                        t = 1;
+			sscanf(argv[++x], "%u", &t);
+                        verbose = (t == 1) ? true : false;
+            break;
+        default:
+            fprintf(stderr, "Error: Invalid command line parameter, %c\n", argv[x][1]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+}
+
+std::string configurationName(int configuration)
+{
+    switch (configuration)
+    {
+        case bench_NL:          return "NL";
+        case bench_PS:          return "PS";
+        case bench_SGrid:       return "SGrid";
+        case bench_S3:          return "S3";
+        case bench_PBSM:        return "PBSM";
+        case bench_TOUCH_TD:    return "TOUCH:TD";
+        case bench_TOUCH_BU:    return "TOUCH:BU";
+        case bench_TOUCH_TDD:   return "TOUCH:TDD";
+        case bench_TOUCH_TDF:   return "TOUCH:TDF";
+    }
+    return "Undefined";
+}
+
+/*
+ * TOUCH uses the SGrid local join where the traversal supports it;
+ * TDD and TDF (JOINdown) need grids for the Ans lists and use NL.
+ */
+JoinAlgorithm* createAlgorithm(int configuration)
+{
+    JoinAlgorithm* algorithm = NULL;
+    TOUCH* touch;
+    switch (configuration)
+    {
+        case bench_NL:
+            algorithm = new algoNL();
+            break;
+        case bench_PS:
+            algorithm = new algoPS();
+            break;
+        case bench_SGrid:
+            algorithm = new SpatialGridHash();
+            algorithm->localPartitions = localPartitions;
+            break;
+        case bench_S3:
+            algorithm = new S3Hash();
+            break;
+        case bench_PBSM:
+            algorithm = new PBSMHash();
+            break;
+        default:
+            touch = new TOUCH();
+            touch->PartitioningType = Hilbert_Sort;
+            touch->nodesize         = nodesize;
+            touch->leafsize         = leafsize;
+            touch->localPartitions  = localPartitions;
+            touch->SGResol          = Dynamic_Flex_SG_Resolution;
+            touch->maxLevelCoef     = 1;
+            switch (configuration)
+            {
+                case bench_TOUCH_TD:
+                    touch->treeTraversal = join_TD;
+                    touch->localJoin = algo_SGrid;
+                    break;
+                case bench_TOUCH_BU:
+                    touch->treeTraversal = join_BU;
+                    touch->localJoin = algo_SGrid;
+                    break;
+                case bench_TOUCH_TDD:
+                    touch->treeTraversal = join_TDD;
+                    touch->localJoin = algo_NL;
+                    break;
+                case bench_TOUCH_TDF:
+                    touch->treeTraversal = join_TDF;
+                    touch->localJoin = algo_NL;
+                    break;
+            }
+            algorithm = touch;
+            break;
+    }
+    algorithm->verbose = false;
+    algorithm->epsilon = epsilon;
+    return algorithm;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec*1000.0 + ts.tv_nsec/1000000.0;
+}
+
+double milliseconds(FLAT::Timer& timer)
+{
+    return (double)timer._elapsed_milliseconds;
+}
+
+class Measurement
+{
+public:
+    std::string distribution;
+    std::string algorithm;
+    std::vector<double> latency;       // wall time of run() on the loaded datasets in ms
+    std::vector<double> joinLatency;   // without loading the data
+    double loading;
+    double building;
+    double probing;
+    double peakRSS;                    // KB, maximum over the repetitions
+    double baseRSS;                    // KB before the run
+    FLAT::uint64 results;
+    FLAT::uint64 compared;
+};
+
+double median(std::vector<double> values)
+{
+    if (values.empty()) return 0;
+    std::sort(values.begin(),values.end());
+    size_t n = values.size();
+    return (n%2 == 1) ? values[n/2] : (values[n/2-1]+values[n/2])/2;
+}
+
+double minimum(const std::vector<double>& values)
+{
+    if (values.empty()) return 0;
+    return *std::min_element(values.begin(),values.end());
+}
+
+/*
+ * Both datasets in memory, shared by all configurations and repetitions
+ */
+JoinAlgorithm* loadDatasets(const std::string& fileA, const std::string& fileB)
+{
+    JoinAlgorithm* data = new JoinAlgorithm();
+    data->verbose = false;
+    data->epsilon = epsilon;
+    data->readBinaryInput(fileA, fileB);
+    return data;
+}
+
+void freeDatasets(JoinAlgorithm* data)
+{
+    for (SpatialObjectList::iterator it = data->vdsAll.begin(); it != data->vdsAll.end(); ++it)
+    {
+        delete (*it)->obj;
+        delete (*it);
+    }
+    delete data;
+}
+
+void measure(int configuration, JoinAlgorithm* loaded, Measurement& m)
+{
+    m.algorithm = configurationName(configuration);
+    m.loading = milliseconds(loaded->dataLoad);
+    m.building = m.probing = 0;
+    m.peakRSS = 0;
+    m.baseRSS = 0;
+    for (int run = 0; run < warmup + repetitions; run++)
+    {
+        JoinAlgorithm* algorithm = createAlgorithm(configuration);
+        algorithm->useDatasets(loaded);
+
+        FLAT::MemoryUsage::resetPeak();
+        double base = FLAT::MemoryUsage::peakResident();
+        double start = now();
+        algorithm->run();
+        double end = now();
+        double peak = FLAT::MemoryUsage::peakResident();
+
+        if (verbose)
+            std::cout << m.distribution << " " << m.algorithm << ((run < warmup) ? " warmup " : " run ")
+                      << end-start << " ms " << algorithm->resultPairs.results << " results" << std::endl;
+
+        if (run >= warmup)
+        {
+            m.latency.push_back(end-start);
+            m.joinLatency.push_back(end-start-milliseconds(algorithm->dataLoad));
+            m.building += milliseconds(algorithm->building)/repetitions;
+            m.probing += milliseconds(algorithm->probing)/repetitions;
+            if (peak-base > m.peakRSS - m.baseRSS)
+            {
+                m.peakRSS = peak;
+                m.baseRSS = base;
+            }
+            m.results = algorithm->resultPairs.results;
+            m.compared = algorithm->ItemsCompared;
+        }
+        delete algorithm;
+    }
+}
+
+void writeJSON(std::vector<Measurement>& measurements)
+{
+    std::ofstream fout(outputFile.c_str());
+    fout << "{\n  \"sizeA\": " << sizeA << ", \"sizeB\": " << sizeB << ", \"epsilon\": " << epsilon
+         << ", \"seed\": " << seed << ", \"warmup\": " << warmup << ", \"repetitions\": " << repetitions << ",\n"
+         << "  \"results\": [\n";
+    for (size_t i = 0; i < measurements.size(); i++)
+    {
+        Measurement& m = measurements[i];
+        double join = median(m.joinLatency);
+        fout << "    {\"distribution\": \"" << m.distribution << "\", \"algorithm\": \"" << m.algorithm << "\""
+             << ", \"latency_ms\": {\"min\": " << minimum(m.latency) << ", \"median\": " << median(m.latency) << "}"
+             << ", \"join_ms\": {\"min\": " << minimum(m.joinLatency) << ", \"median\": " << join << "}"
+             << ", \"loading_ms\": " << m.loading << ", \"building_ms\": " << m.building << ", \"probing_ms\": " << m.probing
+             << ", \"throughput_objects_per_s\": " << ((join > 0) ? (sizeA+sizeB)*1000.0/join : 0)
+             << ", \"peak_rss_kb\": " << m.peakRSS << ", \"peak_rss_growth_kb\": " << m.peakRSS-m.baseRSS
+             << ", \"results\": " << m.results << ", \"compared\": " << m.compared << "}"
+             << ((i+1 < measurements.size()) ? "," : "") << "\n";
+    }
+    fout << "  ]\n}\n";
+}
+
+void writeCSV(std::vector<Measurement>& measurements)
+{
+    std::ofstream fout(outputFile.c_str());
+    fout << "Distribution, Algorithm, #A, #B, Epsilon, Repetitions, latency min, latency median, join min, join median, "
+         << "loading, building, probing, throughput, peak RSS, peak RSS growth, Results, Compared\n";
+    for (size_t i = 0; i < measurements.size(); i++)
+    {
+        Measurement& m = measurements[i];
+        double join = median(m.joinLatency);
+        fout << m.distribution << "," << m.algorithm << "," << sizeA << "," << sizeB << "," << epsilon << "," << repetitions << ","
+             << minimum(m.latency) << "," << median(m.latency) << "," << minimum(m.joinLatency) << "," << join << ","
+             << m.loading << "," << m.building << "," << m.probing << ","
+             << ((join > 0) ? (sizeA+sizeB)*1000.0/join : 0) << ","
+             << m.peakRSS << "," << m.peakRSS-m.baseRSS << "," << m.results << "," << m.compared << "\n";
+    }
+}
+
+std::string datasetFile(FLAT::DataDistribution distribution, FLAT::uint64 count, unsigned int datasetSeed)
+{
+    std::stringstream name;
+    name << dataDir << "/Bench-" << FLAT::DataGenerator::getTitle(distribution) << "-" << count << "-" << datasetSeed << ".bin";
+    return name.str();
+}
+
+// generate the dataset unless it is there from an earlier run
+std::string prepareDataset(FLAT::DataDistribution distribution, FLAT::uint64 count, unsigned int datasetSeed)
+{
+    std::string file = datasetFile(distribution,count,datasetSeed);
+    if (access(file.c_str(), F_OK) == -1)
+    {
+        if (verbose) std::cout << "Generating " << file << std::endl;
+        FLAT::DataGenerator generator(datasetSeed);
+        if (!generator.generate(distribution,count,file))
+        {
+            std::cout << "Could not generate " << file << std::endl;
+            exit(1);
+        }
+    }
+    return file;
+}
+
+int main(int argc, const char* argv[])
+{
+    parse_args(argc, argv);
+
+    std::vector<Measurement> measurements;
+    for (size_t d = 0; d < distributions.size(); d++)
+    {
+        int dist = distributions[d]-'0';
+        if (dist < 0 || dist >= FLAT::DISTRIBUTIONS)
+        {
+            std::cout << "No such distribution " << distributions[d] << std::endl;
+            continue;
+        }
+        FLAT::DataDistribution distribution = (FLAT::DataDistribution)dist;
+        std::string fileA = prepareDataset(distribution,sizeA,seed);
+        std::string fileB = prepareDataset(distribution,sizeB,seed+1);
+        JoinAlgorithm* loaded = loadDatasets(fileA,fileB);
+
+        for (size_t c = 0; c < configurations.size(); c++)
+        {
+            int configuration = configurations[c]-'0';
+            if (configuration < 0 || configuration >= bench_Configurations)
+            {
+                std::cout << "No such algorithm " << configurations[c] << std::endl;
+                continue;
+            }
+            Measurement m;
+            m.distribution = FLAT::DataGenerator::getTitle(distribution);
+            measure(configuration,loaded,m);
+            std::cout << m.distribution << " " << m.algorithm << ": median " << median(m.latency) << " ms, "
+                      << m.results << " results" << std::endl;
+            measurements.push_back(m);
+        }
+        freeDatasets(loaded);
+    }
+
+    if (csv)
+        writeCSV(measurements);
+    else
+        writeJSON(measurements);
+    std::cout << "Results written to " << outputFile << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,633 @@
+/*
+ *  File: JoinCheck.cpp
+ *
+ *  Differential check of the spatial join algorithms
+ *
+ *  - generates small datasets of every distribution with a fixed seed
+ *  - finds the touching pairs by brute force (JoinAlgorithm::touches on
+ *    every pair of A and B), independently of the join kernels
+ *  - runs every algorithm, TOUCH traversal and local join in every result
+ *    mode and compares the deduplicated (idA, idB) pairs, the result count
+ *    and the partners per A object to the brute force
+ *  - applies insert, move and delete steps to IncrementalTOUCH and compares
+ *    the reported added/removed pairs and the resulting join to the brute
+ *    force on the changed B
+ *  - exits with 1 if any configuration differs, so it can run after a build
+ *
+ */
+
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <iterator>
+
+#include "algoPS.h"
+#include "algoNL.h"
+#include "S3Hash.h"
+#include "PBSMHash.h"
+#include "TOUCH.h"
+#include "ResidentTOUCH.h"
+#include "IncrementalTOUCH.h"
+#include "DataGenerator.hpp"
+
+#define check_Resident                  100     // ResidentTOUCH::run
+#define check_Incremental               101     // IncrementalTOUCH::run
+
+typedef std::pair<int,int> IdPair;              // (idA, idB)
+typedef std::set<IdPair> IdPairSet;
+typedef std::map<int,TreeEntry*> EntriesById;
+
+/*
+ * Input parameters
+ */
+FLAT::uint64 sizeA                      = 500;              // objects in A
+FLAT::uint64 sizeB                      = 700;              // objects in B
+double epsilon                          = 5;                // the epsilon of the similarity join
+double universeSize                     = 250;              // the universe is [0,universeSize]^3
+unsigned int seed                       = 7;                // seed of the generated datasets
+int objectType                          = FLAT::BOX;
+std::string distributions               = "0123";           // datasets to generate
+std::string modes                       = "012";            // result modes to check
+int leafsize                            = 10;               // TOUCH leaf size, small for deep trees
+int nodesize                            = 2;                // TOUCH fanout
+int localPartitions                     = 10;               // SGrid resolution
+std::string dataDir                     = ".";              // where the datasets are written
+bool verbose                            = false;
+
+void usage(const char *program_name) {
+
+    printf("   Usage: %s\n", program_name);
+    printf("   -h               Print this help menu.\n");
+    printf("   -n               #A #B  number of objects to generate\n");
+    printf("   -e               Epsilon of the similarity join\n");
+    printf("   -u               size of the universe per dimension\n");
+    printf("   -t               object type (0 - Vertex; 1 - Box; 2 - Cone; 5 - Segment)\n");
+    printf("   -D               distributions, e.g. 0123 (0 - Uniform; 1 - Clustered; 2 - Skewed; 3 - Normal)\n");
+    printf("   -m               result modes, e.g. 012 (0 - pairs; 1 - count only; 2 - partners per A object)\n");
+    printf("   -s               seed of the datasets\n");
+    printf("   -l               TOUCH leaf size\n");
+    printf("   -b               TOUCH fanout\n");
+    printf("   -g               number of SGH cells per dimension\n");
+    printf("   -d               <path> directory of the generated datasets\n");
+    printf("   -v               verbose: print every run and the differing pairs\n");
+
+}
+
+//Parsing Arguments
+void parse_args(int argc, const char* argv[]) {
+
+    int x;
+    int t;
+    for ( x= 1; x < argc; ++x)
+    {
+        switch (argv[x][1])
+        {
+            case 'h':
+                usage(argv[0]);
+                exit(1);
+                break;
+		case 'n':
+			sscanf(argv[++x], "%lu", &sizeA);
+			sscanf(argv[++x], "%lu", &sizeB);
+            break;
+		case 'e':       /* epsilon */
+			sscanf(argv[++x], "%lf", &epsilon);
+            break;
+		case 'u':
+			sscanf(argv[++x], "%lf", &universeSize);
+            break;
+		case 't':
+			sscanf(argv[++x], "%d", &objectType);
+            break;
+		case 'D':
+			if (++x < argc) distributions = argv[x];
+            break;
+		case 'm':
+			if (++x < argc) modes = argv[x];
+            break;
+		case 's':
+			sscanf(argv[++x], "%u", &seed);
+            break;
+		case 'l':
+			sscanf(argv[++x], "%d", &leafsize);
+            break;
+		case 'b':
+			sscanf(argv[++x], "%d", &nodesize);
+            break;
+		case 'g':
+			sscanf(argv[++x], "%d", &localPartitions);
+            break;
+		case 'd':
+			if (++x < argc) dataDir = argv[x];
+            break;
+		case 'v':       /* verbose */
+                        t = 1;
+			sscanf(argv[++x], "%u", &t);
+                        verbose = (t == 1) ? true : false;
+            break;
+        default:
+            fprintf(stderr, "Error: Invalid command line parameter, %c\n", argv[x][1]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+}
+
+// an algorithm, for TOUCH with its traversal, local join and threads
+class Configuration
+{
+public:
+    int algorithm;
+    int traversal;
+    int localJoin;
+    int threads;
+
+    Configuration(int nalgorithm, int ntraversal = join_TD, int nlocalJoin = algo_NL, int nthreads = 1)
+    {
+        algorithm = nalgorithm;
+        traversal = ntraversal;
+        localJoin = nlocalJoin;
+        threads = nthreads;
+    }
+
+    std::string name()
+    {
+        std::stringstream s;
+        switch (algorithm)
+        {
+            case algo_NL:           return "NL";
+            case algo_PS:           return "PS";
+            case algo_SGrid:        return "SGrid";
+            case algo_S3:           return "S3";
+            case algo_PBSM:         return "PBSM";
+            case check_Resident:    return (localJoin == algo_SGrid) ? "ResidentTOUCH/SGrid" : "ResidentTOUCH";
+            case check_Incremental: return "IncrementalTOUCH";
+        }
+        const char* traversals[] = {"BU","TD","TDD","TDF"};
+        s << "TOUCH:" << traversals[traversal] << ((localJoin == algo_SGrid) ? "/SGrid" : "/NL");
+        if (threads > 1) s << " p" << threads;
+        return s.str();
+    }
+};
+
+void configurations(std::vector<Configuration>& all)
+{
+    all.push_back(Configuration(algo_NL));
+    all.push_back(Configuration(algo_PS));
+    all.push_back(Configuration(algo_SGrid));
+    all.push_back(Configuration(algo_S3));
+    all.push_back(Configuration(algo_PBSM));
+    for (int traversal = join_BU; traversal <= join_TDF; traversal++)
+    {
+        all.push_back(Configuration(algo_TOUCH,traversal,algo_NL));
+        all.push_back(Configuration(algo_TOUCH,traversal,algo_SGrid));
+    }
+    all.push_back(Configuration(algo_TOUCH,join_BU,algo_NL,2));
+    all.push_back(Configuration(algo_TOUCH,join_BU,algo_SGrid,2));
+    all.push_back(Configuration(check_Resident));
+    all.push_back(Configuration(check_Resident,join_TD,algo_SGrid));
+    all.push_back(Configuration(check_Incremental));
+}
+
+void setupTOUCH(CommonTOUCH* touch, const Configuration& c)
+{
+    touch->PartitioningType = Hilbert_Sort;
+    touch->nodesize         = nodesize;
+    touch->leafsize         = leafsize;
+    touch->localPartitions  = localPartitions;
+    touch->SGResol          = Dynamic_Flex_SG_Resolution;
+    touch->maxLevelCoef     = 1;
+    touch->treeTraversal    = c.traversal;
+    touch->localJoin        = c.localJoin;
+    touch->threads          = c.threads;
+    touch->skewFactor       = 1;                // split many nodes into small chunks
+    touch->skewChunk        = 3;
+}
+
+JoinAlgorithm* createAlgorithm(const Configuration& c)
+{
+    JoinAlgorithm* algorithm = NULL;
+    CommonTOUCH* touch;
+    switch (c.algorithm)
+    {
+        case algo_NL:
+            algorithm = new algoNL();
+            break;
+        case algo_PS:
+            algorithm = new algoPS();
+            break;
+        case algo_SGrid:
+            algorithm = new SpatialGridHash();
+            algorithm->localPartitions = localPartitions;
+            break;
+        case algo_S3:
+            algorithm = new S3Hash();
+            break;
+        case algo_PBSM:
+            algorithm = new PBSMHash();
+            break;
+        case check_Resident:
+            touch = new ResidentTOUCH();
+            setupTOUCH(touch,c);
+            algorithm = touch;
+            break;
+        case check_Incremental:
+            touch = new IncrementalTOUCH();
+            setupTOUCH(touch,c);
+            algorithm = touch;
+            break;
+        default:
+            touch = new TOUCH();
+            setupTOUCH(touch,c);
+            algorithm = touch;
+            break;
+    }
+    algorithm->verbose = false;
+    algorithm->epsilon = epsilon;
+    return algorithm;
+}
+
+/*
+ * The expected result: every pair of A and B tested with the predicate of
+ * the joins. Pairs whose expanded MBRs are apart are skipped, they cannot
+ * come within epsilon.
+ */
+void touchingPairs(const SpatialObjectList& dsA, const SpatialObjectList& dsB, IdPairSet& pairs)
+{
+    for (FLAT::uint64 a = 0; a < dsA.size(); a++)
+        for (FLAT::uint64 b = 0; b < dsB.size(); b++)
+            if (FLAT::Box::overlap(dsA[a]->mbr,dsB[b]->mbr)
+                    && JoinAlgorithm::touches(dsA[a]->obj,dsB[b]->obj,epsilon))
+                pairs.insert(IdPair(dsA[a]->id,dsB[b]->id));
+}
+
+void freeEntries(SpatialObjectList& entries)
+{
+    for (FLAT::uint64 i = 0; i < entries.size(); i++)
+    {
+        delete entries[i]->obj;
+        delete entries[i];
+    }
+    entries.clear();
+}
+
+void bruteForce(const std::string& fileA, const std::string& fileB, IdPairSet& pairs)
+{
+    JoinAlgorithm data;
+    data.verbose = false;
+    data.epsilon = epsilon;
+    data.readBinaryInput(fileA,fileB);
+    touchingPairs(data.dsA,data.dsB,pairs);
+    freeEntries(data.dsA);
+    freeEntries(data.dsB);
+}
+
+void printDifference(const char* title, const IdPairSet& pairs, const IdPairSet& other)
+{
+    int shown = 0;
+    for (IdPairSet::const_iterator it = pairs.begin(); it != pairs.end() && shown < 10; ++it)
+        if (other.find(*it) == other.end())
+        {
+            std::cout << "      " << title << " (" << it->first << "," << it->second << ")" << std::endl;
+            shown++;
+        }
+}
+
+// compares the results of the run with the brute force, empty if they agree
+std::string compare(JoinAlgorithm* algorithm, const IdPairSet& expected)
+{
+    std::stringstream problem;
+    ResultPairs& result = algorithm->resultPairs;
+    switch (result.mode)
+    {
+        case result_Pairs:
+        {
+            IdPairSet found;
+            for (FLAT::uint64 i = 0; i < result.objA.size(); i++)
+            {
+                if (result.objA[i]->type != 0 || result.objB[i]->type != 1)
+                {
+                    problem << "pair of types " << result.objA[i]->type << "," << result.objB[i]->type;
+                    return problem.str();
+                }
+                found.insert(IdPair(result.objA[i]->id,result.objB[i]->id));
+            }
+            if (found != expected)
+            {
+                FLAT::uint64 missing = 0, extra = 0;
+                for (IdPairSet::const_iterator it = expected.begin(); it != expected.end(); ++it)
+                    if (found.find(*it) == found.end()) missing++;
+                for (IdPairSet::const_iterator it = found.begin(); it != found.end(); ++it)
+                    if (expected.find(*it) == expected.end()) extra++;
+                problem << missing << " pairs missing, " << extra << " wrong pairs";
+                if (verbose)
+                {
+                    printDifference("missing",expected,found);
+                    printDifference("wrong",found,expected);
+                }
+            }
+            break;
+        }
+        case result_Count:
+            if (result.results != expected.size())
+                problem << result.results << " results";
+            break;
+        case result_Degree:
+        {
+            std::vector<FLAT::uint64> degrees(sizeA,0);
+            for (IdPairSet::const_iterator it = expected.begin(); it != expected.end(); ++it)
+                degrees[it->first]++;
+            FLAT::uint64 wrong = 0;
+            for (FLAT::uint64 i = 0; i < sizeA; i++)
+                if (i >= algorithm->degrees.size() || algorithm->degrees[i] != degrees[i])
+                    wrong++;
+            if (wrong > 0)
+                problem << wrong << " A objects with wrong partners";
+            else if (result.results != expected.size())
+                problem << result.results << " results";
+            break;
+        }
+    }
+    return problem.str();
+}
+
+// a copy of the geometry, through its serialized form
+FLAT::SpatialObject* copyObject(FLAT::SpatialObject* obj)
+{
+    std::vector<FLAT::int8> buffer(obj->getSize());
+    obj->serialize(&buffer[0]);
+    FLAT::SpatialObject* copy = FLAT::SpatialObjectFactory::create(obj->getType());
+    copy->unserialize(&buffer[0]);
+    return copy;
+}
+
+// one time step of B changes, applied to the expected B as well
+class UpdateStep
+{
+public:
+    UpdateList updates;
+    EntriesById& currentB;
+
+    UpdateStep(EntriesById& current) : currentB(current) {}
+
+    void insert(int id, FLAT::SpatialObject* geometry)
+    {
+        updates.push_back(UpdateB(update_Insert,id,copyObject(geometry)));
+        currentB[id] = new TreeEntry(copyObject(geometry),1,id,epsilon);
+    }
+
+    void move(int id, FLAT::SpatialObject* geometry)
+    {
+        FLAT::SpatialObject* copy = copyObject(geometry);
+        updates.push_back(UpdateB(update_Move,id,copyObject(geometry)));
+        delete currentB[id]->obj;
+        currentB[id]->setObject(copy,epsilon);
+    }
+
+    void remove(int id)
+    {
+        updates.push_back(UpdateB(update_Delete,id,NULL));
+        delete currentB[id]->obj;
+        delete currentB[id];
+        currentB.erase(id);
+    }
+};
+
+void pairIds(const ResultPairs& result, IdPairSet& pairs)
+{
+    for (FLAT::uint64 i = 0; i < result.objA.size(); i++)
+        pairs.insert(IdPair(result.objA[i]->id,result.objB[i]->id));
+}
+
+void printDelta(const char* title, const IdPairSet& found, const IdPairSet& expected, std::stringstream& problem)
+{
+    FLAT::uint64 missing = 0, extra = 0;
+    for (IdPairSet::const_iterator it = expected.begin(); it != expected.end(); ++it)
+        if (found.find(*it) == found.end()) missing++;
+    for (IdPairSet::const_iterator it = found.begin(); it != found.end(); ++it)
+        if (expected.find(*it) == expected.end()) extra++;
+    problem << title << " " << missing << " pairs missing, " << extra << " wrong pairs; ";
+    if (verbose)
+    {
+        printDifference("missing",expected,found);
+        printDifference("wrong",found,expected);
+    }
+}
+
+// compares one update() with the brute force before and after it, empty if they agree
+std::string compareUpdate(IncrementalTOUCH* touch, const IdPairSet& before, const IdPairSet& after,
+                          const EntriesById& currentB)
+{
+    std::stringstream problem;
+    IdPairSet added, removed, expectedAdded, expectedRemoved;
+    pairIds(touch->added,added);
+    pairIds(touch->removed,removed);
+    std::set_difference(after.begin(),after.end(),before.begin(),before.end(),
+                        std::inserter(expectedAdded,expectedAdded.begin()));
+    std::set_difference(before.begin(),before.end(),after.begin(),after.end(),
+                        std::inserter(expectedRemoved,expectedRemoved.begin()));
+    if (added != expectedAdded)
+        printDelta("added:",added,expectedAdded,problem);
+    if (removed != expectedRemoved)
+        printDelta("removed:",removed,expectedRemoved,problem);
+    // the join after the step, in its result mode: the pairs, the partners per A object or the count
+    std::string result = compare(touch,after);
+    if (!result.empty())
+        problem << "result: " << result << "; ";
+
+    std::set<int> idsB;
+    for (FLAT::uint64 i = 0; i < touch->dsB.size(); i++)
+        idsB.insert(touch->dsB[i]->id);
+    bool sameB = touch->dsB.size() == currentB.size() && touch->size_dsB == currentB.size()
+                 && idsB.size() == currentB.size();
+    for (EntriesById::const_iterator it = currentB.begin(); sameB && it != currentB.end(); ++it)
+        sameB = idsB.find(it->first) != idsB.end();
+    if (!sameB)
+        problem << "dsB holds " << touch->dsB.size() << " objects (size_dsB " << touch->size_dsB
+                << "), expected " << currentB.size();
+    return problem.str();
+}
+
+/*
+ * IncrementalTOUCH::update: after the initial run B gets a step of inserts,
+ * one of moves, one of deletes and a mixed step with re-inserted ids and
+ * updates that are ignored. New geometry is a copy of an A object (new
+ * partners) or of another B object. Every step is compared to the brute
+ * force on the changed B, in the result mode of the join.
+ */
+void checkUpdates(const std::string& title, const std::string& fileA, const std::string& fileB,
+                  const IdPairSet& expected, int mode, int& checked, int& failed)
+{
+    JoinAlgorithm data;
+    data.verbose = false;
+    data.epsilon = epsilon;
+    data.readBinaryInput(fileA,fileB);
+    EntriesById currentB;
+    for (FLAT::uint64 i = 0; i < data.dsB.size(); i++)
+        currentB[data.dsB[i]->id] = data.dsB[i];
+    SpatialObjectList& dsA = data.dsA;
+
+    IncrementalTOUCH* touch = (IncrementalTOUCH*)createAlgorithm(Configuration(check_Incremental));
+    touch->file_dsA = fileA;
+    touch->file_dsB = fileB;
+    touch->resultPairs.mode = mode;
+    touch->run();
+
+    const char* steps[] = {"insert","move","delete","mixed"};
+    IdPairSet before = expected;
+    int nextId = sizeB;
+    for (int step = 0; step < 4; step++)
+    {
+        UpdateStep changes(currentB);
+        std::vector<int> ids;
+        for (EntriesById::iterator it = currentB.begin(); it != currentB.end(); ++it)
+            ids.push_back(it->first);
+        switch (step)
+        {
+            case 0:
+                for (FLAT::uint64 i = 0; i < sizeB/10; i++)
+                    changes.insert(nextId++,dsA[(i*7) % dsA.size()]->obj);
+                break;
+            case 1:
+                for (size_t i = 0; i < ids.size(); i++)
+                    if (ids[i] % 10 == 0)
+                        changes.move(ids[i],dsA[(ids[i]*3) % dsA.size()]->obj);
+                    else if (ids[i] % 5 == 0)
+                        changes.move(ids[i],currentB[ids[(i+1) % ids.size()]]->obj);
+                break;
+            case 2:
+                for (size_t i = 0; i < ids.size(); i++)
+                    if (ids[i] % 4 == 1 || (ids[i] >= (int)sizeB && ids[i] % 3 == 0))
+                        changes.remove(ids[i]);
+                break;
+            case 3:
+                if (currentB.find(1) == currentB.end())
+                    changes.insert(1,dsA[0]->obj);                     // deleted in the last step
+                changes.insert(nextId++,currentB[ids[0]]->obj);
+                changes.move(ids[1],dsA[1]->obj);
+                changes.remove(ids[2]);
+                changes.updates.push_back(UpdateB(update_Delete,-1,NULL));
+                changes.updates.push_back(UpdateB(update_Move,-2,copyObject(dsA[2]->obj)));
+                changes.updates.push_back(UpdateB(update_Insert,ids[1],copyObject(dsA[3]->obj)));
+                break;
+        }
+        touch->update(changes.updates);
+
+        SpatialObjectList listB;
+        for (EntriesById::iterator it = currentB.begin(); it != currentB.end(); ++it)
+            listB.push_back(it->second);
+        IdPairSet after;
+        touchingPairs(dsA,listB,after);
+
+        std::string problem = compareUpdate(touch,before,after,currentB);
+        checked++;
+        if (!problem.empty())
+        {
+            failed++;
+            std::cout << "  FAILED " << title << " IncrementalTOUCH update " << steps[step]
+                      << " mode " << mode << ": " << problem << std::endl;
+        }
+        else if (verbose)
+            std::cout << "  ok IncrementalTOUCH update " << steps[step] << " mode " << mode << ": +" << touch->added.results
+                      << " -" << touch->removed.results << " pairs" << std::endl;
+        before.swap(after);
+    }
+    delete touch;
+
+    freeEntries(dsA);
+    for (EntriesById::iterator it = currentB.begin(); it != currentB.end(); ++it)
+    {
+        delete it->second->obj;
+        delete it->second;
+    }
+}
+
+std::string datasetFile(FLAT::DataDistribution distribution, FLAT::uint64 count, unsigned int datasetSeed)
+{
+    std::stringstream name;
+    name << dataDir << "/Check-" << FLAT::DataGenerator::getTitle(distribution) << "-" << count << "-" << datasetSeed << ".bin";
+    return name.str();
+}
+
+std::string generateDataset(FLAT::DataDistribution distribution, FLAT::uint64 count, unsigned int datasetSeed)
+{
+    std::string file = datasetFile(distribution,count,datasetSeed);
+    FLAT::DataGenerator generator(datasetSeed);
+    generator.universe.low  = FLAT::Vertex(0,0,0);
+    generator.universe.high = FLAT::Vertex(universeSize,universeSize,universeSize);
+    generator.objectType    = (FLAT::SpatialObjectType)objectType;
+    if (!generator.generate(distribution,count,file))
+        exit(1);
+    return file;
+}
+
+int main(int argc, const char* argv[])
+{
+    parse_args(argc, argv);
+
+    std::vector<Configuration> all;
+    configurations(all);
+    int checked = 0, failed = 0;
+    for (size_t d = 0; d < distributions.size(); d++)
+    {
+        int dist = distributions[d]-'0';
+        if (dist < 0 || dist >= FLAT::DISTRIBUTIONS)
+        {
+            std::cout << "No such distribution " << distributions[d] << std::endl;
+            continue;
+        }
+        FLAT::DataDistribution distribution = (FLAT::DataDistribution)dist;
+        std::string title = FLAT::DataGenerator::getTitle(distribution);
+        std::string fileA = generateDataset(distribution,sizeA,seed);
+        std::string fileB = generateDataset(distribution,sizeB,seed+1);
+
+        IdPairSet expected;
+        bruteForce(fileA,fileB,expected);
+        std::cout << title << ": " << expected.size() << " touching pairs" << std::endl;
+
+        for (size_t c = 0; c < all.size(); c++)
+            for (size_t m = 0; m < modes.size(); m++)
+            {
+                int mode = modes[m]-'0';
+                if (mode < result_Pairs || mode > result_Degree) continue;
+                JoinAlgorithm* algorithm = createAlgorithm(all[c]);
+                algorithm->file_dsA = fileA;
+                algorithm->file_dsB = fileB;
+                algorithm->resultPairs.mode = mode;
+                FLAT::Timer timer;
+                timer.start();
+                algorithm->run();
+                timer.stop();
+
+                std::string problem = compare(algorithm,expected);
+                checked++;
+                if (!problem.empty())
+                {
+                    failed++;
+                    std::cout << "  FAILED " << title << " " << all[c].name() << " mode " << mode
+                              << ": " << problem << std::endl;
+                }
+                else if (verbose)
+                    std::cout << "  ok " << all[c].name() << " mode " << mode << " in " << timer << " s" << std::endl;
+                delete algorithm;
+            }
+
+        for (size_t m = 0; m < modes.size(); m++)
+        {
+            int mode = modes[m]-'0';
+            if (mode >= result_Pairs && mode <= result_Degree)
+                checkUpdates(title,fileA,fileB,expected,mode,checked,failed);
+        }
+
+        unlink(fileA.c_str());
+        unlink(fileB.c_str());
+    }
+
+    std::cout << checked-failed << " of " << checked << " runs agree with the brute force" << std::endl;
+    return (failed > 0) ? 1 : 0;
+}
@@ -19,12 +19,15 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <algorithm>
 
 #include "algoPS.h"
 #include "algoNL.h"
 #include "S3Hash.h"
 #include "PBSMHash.h"
 #include "TOUCH.h"
+#include "JoinEstimator.h"
+#include "RunStatistics.h"
 
 //#include "test.h" //test CUDA
 
@@ -36,15 +39,31 @@ int localPartitions                     = 100;              //The local join res
 bool verbose				=  false;           // Output everything or not?
 int algorithm				=  algo_NL;         // Choose the algorithm
 int localJoin				=  algo_NL;         // Choose the algorithm for joining the buckets, The local join
-int runs				=  1;               // # of runs //@todo unsupported
+int runs				=  1;               // # of measured runs on the same loaded datasets
+int warmupRuns                          = 1;                // runs before the measured ones (with runs > 1)
 double epsilon				=  0.5;             // the epsilon of the similarity join
 int leafsize				=  100;             // # of partitions: in S3 is # of levels; in SGrid is resolution. Leafnode size.
 unsigned int numA = 0 ,numB = 0;                            //number of elements to be read from datasets
 int nodesize                            = 2;                // number of children per node if not leaf
 int maxLevelCoef                        = 1;                // not used
 int traversalType                       = join_TD;          // join traversal of a tree
+int resultMode                          = result_Pairs;     // store pairs, count only or count per A object
+std::string degreeFile                  = "";               // result_Degree: write the partners per A object here
+int threads                             = 1;                // TOUCH: workers of the BU traversal
+double skewFactor                       = 4;                // TOUCH: split nodes with this times the median work, 0 = off
+int skewChunk                           = 16;               // TOUCH: B objects per chunk of a split node
 int SGridResolution                     = Dynamic_Flex_SG_Resolution;          // SGrid resolution type
 
+std::string indexLoad = "";                                  // TOUCH: load the tree of A from this file
+std::string indexSave = "";                                  // TOUCH: save the tree of A to this file
+std::string traceFile = "";                                  // write the phases as a Chrome trace
+std::string metricsFile = "";                                // write the metrics per node, level or cell as JSON
+bool perfCounters = false;                                   // hardware counters of the phases in the log
+bool memoryUsage = true;                                     // resident memory of the phases in the log
+bool estimateOnly = false;                                   // print the estimate of the join and stop
+FLAT::uint64 expectedPairs = 0;                              // result buffers are sized for these
+FLAT::uint64 reservedPerObject = 4;                          // but for no more pairs per object of A and B
+
 std::string input_dsA = "../data/RandomData-100K.bin";
 std::string input_dsB = "../data/RandomData-1600K.bin";
 
@@ -59,6 +78,7 @@ void usage(const char *program_name) {
     printf("      3:Size Separation Spatial\n");
     printf("      4:Partition Based Spatial-Merge Join\n");
     printf("      5:TOUCH:Spatial Hierarchical Hash\n");
+    printf("      6:The least costly as estimated from the datasets\n");
     printf("\n");
     printf("   -J               Algorithm for joining the buckets\n");
     printf("   -l               leaf size\n");
@@ -68,8 +88,22 @@ void usage(const char *program_name) {
     printf("   -e               Epsilon of the similarity join\n");
     printf("   -i               <path> <path>  Dataset A followed by B\n");
     printf("   -n               #A #B  number of element to be read\n");
+    printf("   -r               number of runs on the datasets loaded once, prints min/median/p95 per phase\n");
+    printf("   -W               warmup runs before them (with -r, default 1)\n");
     printf("   -y               type of tree traversal ( 0 - BU(Case4); 1 - TD(Case1))\n");
     printf("   -s               type of SGrid resolution ( 0 - Static; 1 - Dynamic Square; 2 - Dynamic Mean-Length )\n");
+    printf("   -m               results ( 0 - store pairs; 1 - count only; 2 - partners per A object )\n");
+    printf("   -d               <path> write the partners per A object (with -m 2)\n");
+    printf("   -p               TOUCH: number of threads for the BU traversal\n");
+    printf("   -k               TOUCH: split the B objects of nodes with k times the median work (0 - off; default 4)\n");
+    printf("   -K               TOUCH: B objects per chunk of a split node (default 16)\n");
+    printf("   -w               <path> TOUCH: save the tree over A to an index file\n");
+    printf("   -x               <path> TOUCH: load the tree over A from an index file instead of building it\n");
+    printf("   -T               <path> write a Chrome trace of the join phases (built with TRACING)\n");
+    printf("   -j               <path> write the metrics per tree node and level or per grid cell as JSON\n");
+    printf("   -C               hardware counters of the phases in the log (0 - off; 1 - on)\n");
+    printf("   -E               estimate the results and the comparisons of every algorithm and stop\n");
+    printf("   -M               resident memory of the phases in the log (0 - off; 1 - on)\n");
     printf("   -v               verbose\n");
 
 }
@@ -117,6 +151,9 @@ void parse_args(int argc, const char* argv[]) {
 			break;
 		case 'r':       /* # of runs */
 			sscanf(argv[++x], "%u", &runs);
+            break;
+		case 'W':       /* # of warmup runs */
+			sscanf(argv[++x], "%u", &warmupRuns);
             break;
 		case 't':       /* Partition type */
 			sscanf(argv[++x], "%u", &PartitioningTypeMain);
@@ -138,6 +175,46 @@ void parse_args(int argc, const char* argv[]) {
             break;
 		case 's':       /* type of SGrid resolution */
 			sscanf(argv[++x], "%u", &SGridResolution);
+            break;
+		case 'm':       /* result mode */
+			sscanf(argv[++x], "%u", &resultMode);
+            break;
+		case 'd':       /* output of the partners per A object */
+			if (++x < argc) degreeFile = argv[x];
+            break;
+		case 'p':       /* threads of the BU traversal */
+			sscanf(argv[++x], "%u", &threads);
+            break;
+		case 'k':       /* skew factor of overloaded nodes */
+			sscanf(argv[++x], "%lf", &skewFactor);
+            break;
+		case 'K':       /* chunk size of overloaded nodes */
+			sscanf(argv[++x], "%u", &skewChunk);
+            break;
+		case 'w':       /* save the index of A */
+			if (++x < argc) indexSave = argv[x];
+            break;
+		case 'x':       /* load the index of A */
+			if (++x < argc) indexLoad = argv[x];
+            break;
+		case 'T':       /* trace of the phases */
+			if (++x < argc) traceFile = argv[x];
+            break;
+		case 'j':       /* metrics as JSON */
+			if (++x < argc) metricsFile = argv[x];
+            break;
+		case 'C':       /* hardware counters */
+			t = 1;
+			sscanf(argv[++x], "%u", &t);
+			perfCounters = (t == 1);
+            break;
+		case 'E':       /* estimate only */
+			estimateOnly = true;
+            break;
+		case 'M':       /* resident memory */
+			t = 1;
+			sscanf(argv[++x], "%u", &t);
+			memoryUsage = (t == 1);
             break;
 		case 'v':       /* verbose */
                         t = 1;
@@ -151,143 +228,184 @@ void parse_args(int argc, const char* argv[]) {
     }
 }
 
-void TOUCHrun()
-{
-    TOUCH* touch = new TOUCH();
-
-    touch->PartitioningType = PartitioningTypeMain;
-    touch->nodesize         = nodesize;
-    touch->leafsize         = leafsize;
-    touch->localPartitions  = localPartitions;	
-    touch->verbose          = verbose;		
-    touch->localJoin        = localJoin;	
-    touch->epsilon          = epsilon;	
-    touch->numA             = numA;
-    touch->numB             = numB;
-    touch->treeTraversal    = traversalType;
-    touch->maxLevelCoef     = maxLevelCoef;
-    touch->file_dsA         = input_dsA;
-    touch->file_dsB         = input_dsB;
-    touch->SGResol          = SGridResolution;
-
-    touch->run();
-    touch->saveLog();
-    touch->print();
-}
-
-void algoNLrun()
+/*
+ * The algorithm with the parameters of the command line, NULL if unknown
+ */
+JoinAlgorithm* createAlgorithm(int id)
 {
-    algoNL* nl = new algoNL();
-            
-    nl->verbose             = verbose;
-    nl->epsilon             = epsilon;
-    nl->numA                = numA;
-    nl->numB                = numB;
-    nl->file_dsA            = input_dsA;
-    nl->file_dsB            = input_dsB;
+    JoinAlgorithm* alg;
+    TOUCH* touch;
+    switch (id)
+    {
+        case algo_NL:
+            alg = new algoNL();
+        break;
+        case algo_PS:
+            alg = new algoPS();
+        break;
+        case algo_SGrid:
+            alg = new SpatialGridHash();
+            alg->localPartitions    = localPartitions;
+        break;
+        case algo_S3:
+            alg = new S3Hash();
+        break;
+        case algo_PBSM:
+            alg = new PBSMHash();
+        break;
+        case algo_TOUCH:
+            touch = new TOUCH();
+            touch->PartitioningType = PartitioningTypeMain;
+            touch->nodesize         = nodesize;
+            touch->leafsize         = leafsize;
+            touch->localPartitions  = localPartitions;
+            touch->localJoin        = localJoin;
+            touch->treeTraversal    = traversalType;
+            touch->maxLevelCoef     = maxLevelCoef;
+            touch->SGResol          = SGridResolution;
+            touch->threads          = threads;
+            touch->skewFactor       = skewFactor;
+            touch->skewChunk        = skewChunk;
+            touch->loadIndexFile    = indexLoad;
+            touch->saveIndexFile    = indexSave;
+            alg = touch;
+        break;
+        default:
+            return NULL;
+    }
     
-    nl->run();
-    nl->saveLog();
-    nl->print();
+    alg->verbose            = verbose;
+    alg->epsilon            = epsilon;
+    alg->numA               = numA;
+    alg->numB               = numB;
+    alg->file_dsA           = input_dsA;
+    alg->file_dsB           = input_dsB;
+    alg->resultPairs.mode   = resultMode;
+    alg->resultPairs.reserve(expectedPairs);
+    if (perfCounters) alg->enablePerfCounters();
+    if (memoryUsage) alg->enableMemoryUsage();
+    return alg;
 }
 
-void algoPSrun()
+/*
+ * Log and print a finished run; the files of the metrics and the partners
+ * are only written for the last one
+ */
+void report(JoinAlgorithm* alg, bool last)
 {
-    algoPS* ps = new algoPS();
-            
-    ps->verbose             = verbose;
-    ps->epsilon             = epsilon;
-    ps->numA                = numA;
-    ps->numB                = numB;
-    ps->file_dsA            = input_dsA;
-    ps->file_dsB            = input_dsB;
-    
-    ps->run();
-    ps->saveLog();
-    ps->print();
+    alg->countMemory();
+    alg->saveLog();
+    if (last && !metricsFile.empty()) alg->saveMetrics(metricsFile);
+    alg->print();
+    if (last && !degreeFile.empty()) alg->saveDegrees(degreeFile);
 }
 
-void S3run()
+/*
+ * Both datasets in memory, shared by the estimate and the repeated runs
+ */
+JoinAlgorithm* loadDatasets()
 {
-    S3Hash* ps = new S3Hash();
-            
-    ps->verbose             = verbose;
-    ps->epsilon             = epsilon;
-    ps->numA                = numA;
-    ps->numB                = numB;
-    ps->file_dsA            = input_dsA;
-    ps->file_dsB            = input_dsB;
-    
-    ps->run();
-    ps->saveLog();
-    ps->print();
+    JoinAlgorithm* data = new JoinAlgorithm();
+    data->verbose           = verbose;
+    data->epsilon           = epsilon;
+    data->numA              = numA;
+    data->numB              = numB;
+    data->readBinaryInput(input_dsA, input_dsB);
+    return data;
 }
 
-void SGridrun()
+void freeDatasets(JoinAlgorithm* data)
 {
-    SpatialGridHash* ps = new SpatialGridHash();
-    
-    ps->verbose             = verbose;
-    ps->epsilon             = epsilon;
-    ps->numA                = numA;
-    ps->numB                = numB;
-    ps->file_dsA            = input_dsA;
-    ps->file_dsB            = input_dsB;
-    ps->localPartitions     = localPartitions;	
-    
-    ps->run();
-    ps->saveLog();
-    ps->print();
+    for (SpatialObjectList::iterator it = data->vdsAll.begin(); it != data->vdsAll.end(); ++it)
+    {
+        delete (*it)->obj;
+        delete (*it);
+    }
+    delete data;
 }
 
-void algoPBSMrun()
+/*
+ * Estimate the join on the loaded datasets; chooses the algorithm for
+ * algo_Auto and the size of the result buffers
+ */
+void estimateJoin(JoinAlgorithm* data)
 {
-    PBSMHash* ps = new PBSMHash();
-    
-    ps->verbose             = verbose;
-    ps->epsilon             = epsilon;
-    ps->numA                = numA;
-    ps->numB                = numB;
-    ps->file_dsA            = input_dsA;
-    ps->file_dsB            = input_dsB;
-    
-    ps->run();
-    ps->saveLog();
-    ps->print();
-}
+    JoinEstimator estimator(data);
+    estimator.gridResolution = localPartitions;
+    estimator.leafsize       = leafsize;
+    estimator.localJoin      = localJoin;
+    estimator.estimate();
+    estimator.print();
 
+    if (algorithm == algo_Auto) algorithm = estimator.best();
+    expectedPairs = (FLAT::uint64)(estimator.pairs*1.2);   // room for the error of the estimate
+    // an estimate far off must not reserve the memory, the buffers still grow past the cap
+    expectedPairs = std::min(expectedPairs, reservedPerObject*(data->size_dsA+data->size_dsB));
+}
 
 int main(int argc, const char* argv[])
 {
     //Parsing the arguments
     parse_args(argc, argv);
+    if (!traceFile.empty()) FLAT::Tracer::enable();
+    
+    if (runs < 1) runs = 1;
+    if (runs == 1) warmupRuns = 0;
+    
+    // with several runs the datasets are read once, a single run reads them itself
+    // unless they were read for the estimate
+    JoinAlgorithm* loaded = NULL;
+    if (estimateOnly || algorithm == algo_Auto || runs > 1)
+        loaded = loadDatasets();
+    
+    if (estimateOnly || algorithm == algo_Auto)
+    {
+        estimateJoin(loaded);
+        if (estimateOnly)
+        {
+            freeDatasets(loaded);
+            return 0;
+        }
+    }
+    if (runs > 1)
+        std::cout << "Loaded #A " << loaded->size_dsA << " #B " << loaded->size_dsB
+                << " in " << loaded->dataLoad << " s" << std::endl;
 
-    switch(algorithm)
+    RunStatistics statistics;
+    for (int run = 0; run < warmupRuns + runs; run++)
     {
-        case algo_NL:
-            algoNLrun();
-        break;
-        case algo_PS:
-            algoPSrun();
-        break;
-        case algo_TOUCH:
-            TOUCHrun();
-        break;
-        case algo_S3:
-            S3run();
-        break;
-        case algo_PBSM:
-            algoPBSMrun();
-        break;
-        case algo_SGrid:
-            SGridrun();
-        break;
-        default:
+        JoinAlgorithm* alg = createAlgorithm(algorithm);
+        if (alg == NULL)
+        {
             std::cout << "No such algorithm!" << std::endl;
             exit(0);
-        break;
+        }
+        if (loaded != NULL) alg->useDatasets(loaded);
+        if (loaded != NULL && runs == 1) alg->dataLoad = loaded->dataLoad;   // read for the estimate
+        
+        alg->run();
+        if (run < warmupRuns)
+        {
+            std::cout << "Warmup " << run+1 << ": " << alg->total << " s" << std::endl;
+        }
+        else
+        {
+            report(alg, run == warmupRuns + runs - 1);
+            statistics.add(alg);
+        }
+        delete alg;
+        indexSave.clear();      // the index is written by the first run only
     }
     
+    if (runs > 1) statistics.print();
+    if (loaded != NULL) freeDatasets(loaded);
+    
+    if (!traceFile.empty())
+    {
+        FLAT::Tracer::disable();
+        FLAT::Tracer::write(traceFile);
+    }
+
     double a1, a2;
     std::cout << "Terminated." << std::endl;
     
@@ -21,6 +21,32 @@
 #include "FlexLocalSpatialGridHash.h"
 #include "SpatialGridHash.h"
 
+/*
+ * Adds the comparisons, results and time of sink (the algorithm or the
+ * buffer of a worker) during its lifetime to the counters of node.
+ */
+class NodeWork
+{
+public:
+    NodeWork(TreeNode* nnode, JoinAlgorithm* nsink)
+        : node(nnode), sink(nsink), compared(nsink->ItemsCompared),
+          results(nsink->resultPairs.results), begin(FLAT::Tracer::now()) {}
+    
+    ~NodeWork()
+    {
+        node->compared += sink->ItemsCompared - compared;
+        node->results += sink->resultPairs.results - results;
+        node->joinTime += FLAT::Tracer::now() - begin;
+    }
+    
+private:
+    TreeNode* node;
+    JoinAlgorithm* sink;
+    FLAT::uint64 compared;
+    FLAT::uint64 results;
+    FLAT::Nanosecond begin;
+};
+
 class CommonTOUCH : public JoinAlgorithm {
 public:
     CommonTOUCH();
@@ -30,16 +56,37 @@ public:
     
     NodeList probingList;
     
+    int threads;                            // workers of the BU traversal, 1 = serial
+    thrust::host_vector<JoinAlgorithm*> workerSinks;  // per worker results of the parallel BU
+    
+    /*
+     * B objects overlapping two children stay at the inner node, with
+     * clustered data whole regions of B end at the root and are joined with
+     * everything below it. Such overloaded nodes have their B objects cut
+     * into chunks along the Hilbert curve, every chunk is only joined with
+     * the subtrees it overlaps.
+     */
+    double skewFactor;                      // overloaded: more work than this times the median, 0 = off
+    unsigned int skewChunk;                 // B objects per chunk
+    unsigned int overloadedNodes;
+    unsigned int chunkCount;
+    
+    void splitOverloaded();
+    
     void probeDownUp();
+    void probeDownUpParallel();
     void probeUpDown();
     void probeUpDownFilter();
     void pathWayJoin(TreeNode* node);
+    void pathWayJoinNode(TreeNode* node, NodeList& path, JoinAlgorithm* sink);
     void pathWayJoinDown(TreeNode* node);
     void JoinDownR(TreeNode* node, TreeNode* nodeObj);
     void pathWayJoinFilter(TreeNode* node);
     void pathWayJoinDownFilter(TreeNode* node);
     void JoinDownRFilter(TreeNode* node, TreeNode* nodeObj);
     void JOIN(TreeNode* node, TreeNode* nodeObj);
+    void JOIN(TreeNode* node, TreeNode* nodeObj, JoinAlgorithm* sink);
+    void JOINobjects(TreeNode* node, int type, SpatialObjectList& objs, JoinAlgorithm* sink);
     void JOINdown(TreeNode* node, TreeNode* nodeObj);
     
     virtual void joinNodeToDesc(TreeNode* ancestorNode);
@@ -50,8 +97,10 @@ public:
     
     void countSpatialGrid();
     void countSpatialGrid(TreeNode* node);
+    void countSpatialGrid(TreeNode* node, JoinAlgorithm* sink);
     void deduplicateSpatialGrid();
     void deduplicateSpatialGrid(TreeNode* node);
+    void deduplicateSpatialGrid(TreeNode* node, JoinAlgorithm* sink);
     
     unsigned int countObjBelow(TreeNode* node, int type);
     void countObjBelowStart();
@@ -70,6 +119,20 @@ public:
     }
     
     TreeNode* root;
+    
+    /*
+     * The tree over A can be saved after createPartitions and loaded by a
+     * later run instead of reading and partitioning A again (see TreeFile.h).
+     */
+    std::string loadIndexFile;      // load the tree of A from here if not empty
+    std::string saveIndexFile;      // save the tree of A here if not empty
+    bool ownsEntriesA;              // A was loaded in place of shared datasets, freed with the tree
+    
+    bool saveIndex(std::string indexFile);
+    bool loadIndex(std::string indexFile);
+    
+    void writeMetrics(std::ostream& out);
+    void countMemory();
 protected:
     
     /*
@@ -82,6 +145,10 @@ protected:
     void createTreeLevel(SpatialObjectList& input);
     void createTreeLevel(NodeList& input, int Level);
     void createPartitions(SpatialObjectList& vds);
+    void loadOrBuildA();
+    TreeNode* findAssignment(TreeEntry* obj);
+    void leavesBelow(TreeNode* node, const FLAT::Box& mbr, std::queue<TreeNode*>& nodes,
+                     NodeList& leaves, FLAT::uint64* skippedA);
     
     void analyze();
     
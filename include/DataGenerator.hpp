@@ -0,0 +1,93 @@
+#ifndef DATA_GENERATOR_HPP_
+#define DATA_GENERATOR_HPP_
+
+#include "SpatialObject.hpp"
+#include "Box.hpp"
+#include <iostream>
+#include <string>
+#include <boost/random.hpp>
+using namespace std;
+
+namespace FLAT
+{
+	/*
+	 * Spatial distributions of generated datasets
+	 */
+	enum DataDistribution
+	{
+		UNIFORM,        // centers uniform in the universe
+		CLUSTERED,      // centers normal around a few uniform cluster centers (gaussian mixture)
+		SKEWED,         // centers crowded towards the low corner of the universe
+		NORMAL,         // centers normal around the center of the universe
+		DISTRIBUTIONS
+	};
+
+	/*
+	 * Distributions of the object sizes (box side, segment and cone length)
+	 */
+	enum SizeDistribution
+	{
+		SIZE_CONSTANT,      // maxSize
+		SIZE_UNIFORM,       // uniform in [minSize,maxSize]
+		SIZE_NORMAL,        // normal around the middle of [minSize,maxSize], clamped to it
+		SIZE_EXPONENTIAL,   // minSize plus exponential, mean a tenth of the range, clamped
+		SIZE_DISTRIBUTIONS
+	};
+
+	/*
+	 * Generates synthetic datasets of VERTEX, BOX, SEGMENT or CONE objects in
+	 * the binary input format (see DataFileReader).
+	 *
+	 * The objects are generated in chunks of chunkSize objects with a random
+	 * sequence of their own, by several threads that write every chunk at its
+	 * place in the file. The same seed gives the same dataset for any number
+	 * of threads.
+	 */
+	class DataGenerator
+	{
+	public:
+		Box universe;                   // object centers are placed inside
+		SpatialObjectType objectType;
+		SizeDistribution sizeDistribution;
+		spaceUnit minSize;              // box side or segment/cone length
+		spaceUnit maxSize;
+		spaceUnit minRadius;            // SEGMENT/CONE: radii, uniform in [minRadius,maxRadius]
+		spaceUnit maxRadius;
+		uint32 clusters;                // CLUSTERED: number of clusters
+		double sigma;                   // CLUSTERED: deviation as a fraction of the universe width
+		double normalSigma;             // NORMAL: deviation as a fraction of the universe width
+		uint32 clusterSeed;             // CLUSTERED: seed of the cluster centers, same for joined datasets
+		double skew;                    // SKEWED: exponent of the coordinates, 1 is uniform
+		int threads;
+		uint64 chunkSize;
+
+		DataGenerator(uint32 seed);
+
+		// returns false if the file could not be written
+		bool generate(DataDistribution distribution, uint64 count, string fileName);
+
+		static string getTitle(DataDistribution distribution);
+		static string getTitle(SizeDistribution distribution);
+
+	private:
+		class Chunk;
+		class Task;
+
+		uint32 seed;
+		DataDistribution distribution;
+		std::vector<Vertex> centers;
+		uint64 count;
+		uint32 objectByteSize;
+		int file;
+		uint64 nextChunk;               // taken by the threads with __sync_fetch_and_add
+		bool failed;
+
+		void generateChunk(uint64 chunk, int8* buffer, Box& mbr);
+		void makeObject(Chunk& random, uint64 id, int8* buffer, Box& mbr);
+		double objectSize(Chunk& random);
+
+		static void* worker(void* task);
+	};
+}
+
+#endif
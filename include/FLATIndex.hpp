@@ -2,18 +2,31 @@
 #define FLAT_INDEX_HPP_
 
 #include <SpatialIndex.h>
+#include <map>
 #include "PayLoad.hpp"
+#include "Prefetcher.hpp"
 #include "SeedBuilder.hpp"
 #include "SpatialQuery.hpp"
 
 namespace FLAT
 {
+	// is the object in the region? most object types leave their MBR marked empty
+	inline bool overlapsRegion(SpatialObject* object, Box& region)
+	{
+		Box mbr = object->getMBR();
+		mbr.isEmpty = false;
+		return Box::overlap(region,mbr) && object->IsResult(region);
+	}
+
 	class seedVisitor : public SpatialIndex::IVisitor
 	{
 	public:
 		SpatialQuery* query;
 		bool done;
 		PayLoad* payload;
+		bool ownPayload;
+		PageView view;
+		SpatialObject* scratch;     // records are decoded into it
 
 		seedVisitor(SpatialQuery* query, string indexFileStem)
 		{
@@ -21,11 +34,25 @@ namespace FLAT
 			done = false;
 			payload   = new PayLoad();
 			payload->load(indexFileStem);
+			ownPayload = true;
+			scratch = SpatialObjectFactory::create(payload->objType);
+		}
+
+		// seeding through the payload (and its page cache) of a loaded index
+		seedVisitor(SpatialQuery* query, PayLoad* payload)
+		{
+			this->query = query;
+			done = false;
+			this->payload = payload;
+			ownPayload = false;
+			scratch = SpatialObjectFactory::create(payload->objType);
 		}
 
 		~seedVisitor()
 		{
-			delete payload;
+			view.release();
+			delete scratch;
+			if (ownPayload) delete payload;
 		}
 
 		virtual void visitNode(const SpatialIndex::INode& in)
@@ -62,19 +89,23 @@ namespace FLAT
 			MetadataEntry m = MetadataEntry(b, l);
 			delete[] b;
 
-			vector<SpatialObject*> so;
-			payload->getPage(so, m.pageId);
-			for (vector<SpatialObject*>::iterator it = so.begin(); it != so.end(); ++it)
-				if (Box::overlap(query->Region, (*it)->getMBR()))
+			bool hit;
+			if (!payload->getPage(view, m.pageId, &hit)) return;
+			query->stats.FLAT_payLoadIOs++;
+			if (hit) query->stats.FLAT_payLoadCacheHits++; else query->stats.FLAT_payLoadCacheMisses++;
+
+			for (uint32 i=0; i<view.objects; i++)
+			{
+				view.read(i, scratch);
+				if (overlapsRegion(scratch, query->Region))
 				{
 					//cout << "Found seed : " << id << endl;
 					done = true;
 					query->stats.FLAT_seedId = id;
 					break;
 				}
-
-			for (vector<SpatialObject*>::iterator it = so.begin(); it != so.end(); ++it)
-					delete (*it);
+			}
+			view.release();
 		}
 
 		virtual void visitData(std::vector<const SpatialIndex::IData *>& v
@@ -83,13 +114,19 @@ namespace FLAT
 		}
 	};
 
+	/*
+	 * Seeding of a kNN query: the nearest neighbour of the query point on the
+	 * seed tree is the partition nearest to it, the leaf it was found in is
+	 * the metadata page the crawl starts from.
+	 */
 	class kNNVisitor : public SpatialIndex::IVisitor
 	{
 	public:
 		SpatialQuery* query;
 		bool done;
+		std::map<SpatialIndex::id_type,SpatialIndex::id_type> leafOf;   // pageId to the leaf holding its entry
 
-		kNNVisitor(SpatialQuery* query, string indexFileStem)
+		kNNVisitor(SpatialQuery* query)
 		{
 			this->query = query;
 			done = false;
@@ -101,41 +138,11 @@ namespace FLAT
 
 		virtual void visitNode(const SpatialIndex::INode& in)
 		{
-//			cout << "visited node\n";
-//			uint32 children = in.getChildrenCount();
-//
-//			Box Parent;
-//			SpatialIndex::IShape* shape;
-//			in.getShape(&shape);
-//			SpatialIndex::Region reg;
-//			shape->getMBR(reg);
-//			for (int d=0;d<DIMENSION;d++)
-//			{
-//				Parent.low[d] = reg.m_pLow[d];
-//				Parent.high[d] = reg.m_pHigh[d];
-//			}
-//			cout << "PARENT NODE: LEVEL= " << in.getLevel() << " ID= " << in.getIdentifier() << "   MBR= " << Parent << endl;
-//			delete shape;
-//
-//			for (int i=0;i<children;i++)
-//			{
-//				Box Child;
-//				SpatialIndex::IShape* childShape;
-//				in.getChildShape(i,&childShape);
-//				SpatialIndex::Region reg;
-//				childShape->getMBR(reg);
-//				for (int d=0;d<DIMENSION;d++)
-//				{
-//					Child.low[d] = reg.m_pLow[d];
-//					Child.high[d] = reg.m_pHigh[d];
-//				}
-//				cout << "\tCHILD NODE: ID= " << in.getChildIdentifier(i) << "   MBR= " << Child << endl;
-//				delete childShape;
-//			}
-
 	    	if (in.isLeaf())
 	    	{
 	    		query->stats.FLAT_metaDataIOs++;
+	    		for (uint32 c=0;c<in.getChildrenCount();c++)
+	    			leafOf[in.getChildIdentifier(c)] = in.getIdentifier();
 	    	}
 	    	else
 	    	{
@@ -145,6 +152,11 @@ namespace FLAT
 
 		virtual void visitData(const SpatialIndex::IData& in)
 		{
+			if (done) return;
+			std::map<SpatialIndex::id_type,SpatialIndex::id_type>::iterator leaf = leafOf.find(in.getIdentifier());
+			if (leaf==leafOf.end()) return;
+			done = true;
+			query->stats.FLAT_seedId = leaf->second;
 		}
 
 		virtual void visitUseless()
@@ -158,8 +170,6 @@ namespace FLAT
 
 		virtual void visitData(const SpatialIndex::IData& in, SpatialIndex::id_type id)
 		{
-			done = true;
-			query->stats.FLAT_seedId = id;
 		}
 
 		virtual void visitData(std::vector<const SpatialIndex::IData *>& v
@@ -168,6 +178,12 @@ namespace FLAT
 		}
 	};
 
+	/*
+	 * Entry of the kNN priority queue, keyed by the distance to the query
+	 * point: a metadata entry by its partition, its payload page by the page
+	 * MBR, and an object by its own distance. Each key bounds the distance of
+	 * every object found through the entry.
+	 */
 	class kNNEntry
 	{
 	public:
@@ -178,12 +194,14 @@ namespace FLAT
 		id metapageId;
 		id metaentryId;
 		bool isMetaPage;
+		bool isPayLoadPage;
 
 		kNNEntry(SpatialObject* object,Vertex P,id metaPageId,id metaEntryId)
 		{
 			sobj = object;
 			minDist = sobj->pointDistance(P);
 			isMetaPage=false;
+			isPayLoadPage=false;
 			me = NULL;
 			metapageId = metaPageId;
 			metaentryId = metaEntryId;
@@ -194,12 +212,29 @@ namespace FLAT
 			me = metaEntry;
 			minDist = me->partitionMbr.pointDistance(P);
 			isMetaPage=true;
-			sobj=false;
+			isPayLoadPage=false;
+			sobj=NULL;
 			metapageId = metaPageId;
+			metaentryId = me->pageId;
+		}
+
+		// the payload page of a metadata entry, the entry is handed over
+		kNNEntry(kNNEntry* metaEntry,Vertex P)
+		{
+			me = metaEntry->me;
+			metaEntry->me = NULL;
+			minDist = me->pageMbr.pointDistance(P);
+			isMetaPage=false;
+			isPayLoadPage=true;
+			sobj=NULL;
+			metapageId = metaEntry->metapageId;
+			metaentryId = me->pageId;
 		}
 
 		~kNNEntry()
-		{}
+		{
+			delete me;
+		}
 
 		struct ascending : public std::binary_function<kNNEntry*, kNNEntry*, bool>
 		{
@@ -217,14 +252,20 @@ namespace FLAT
 	   PayLoad* payload;
 	   SpatialIndex::ISpatialIndex* seedtree;
 	   SpatialIndex::IStorageManager* rtreeStorageManager;
+	   Prefetcher* prefetcher;     // NULL without prefetching
+	   ResidentMetadata* metadata; // NULL unless the index is in memory
 
-	   static void buildIndexWithCount(std::string sourceConfig,string type,std::string indexStem,int count);
+	   static void buildIndexWithCount(std::string sourceConfig,string type,std::string indexStem,int count,int threads=1,PageFormat format=RAW_PAGES);
 
 	   static void buildIndex(std::string sourceConfig,string type,std::string indexStem);
 
 	   static FLATIndex* loadIndex(std::string indexStem);
 
-	   static FLATIndex* loadIndexMemory(std::string indexStem);
+	   // the metadata (links in one adjacency array) and the payload in memory, queries
+	   // are seeded on the partition tree of the metadata and do not read storage;
+	   // optionally on huge pages. A payload that gets no memory is read from disk,
+	   // with a message
+	   static FLATIndex* loadIndexMemory(std::string indexStem,bool hugePages=false);
 
 	   static std::vector< vector<float> > windowQuery(FLATIndex* index,float xlo,float ylo,float zlo,float xhi,float yhi,float zhi);
 
@@ -236,9 +277,80 @@ namespace FLAT
 
 	   static void rangeQuery(FLATIndex* index,SpatialQuery& query,vector<SpatialObject*>& results);
 
+	   // range queries in one go: the queries are ordered along the Hilbert curve and those that
+	   // overlap (up to maxGroup) share a seed descent and a crawl, every page is read once for all
+	   // of them. results[q] are the objects of queries[q]; the statistics of a query count its own
+	   // results and pages and the time of its group, batch counts the I/O actually done
+	   static void batchRangeQuery(FLATIndex* index,vector<SpatialQuery>& queries,
+			   vector< vector<SpatialObject*> >& results,QueryStatistics& batch,uint32 maxGroup);
+
+	   // the k objects nearest to query.Point, nearest first
 	   static void kNearestNeighbour(FLATIndex* index,SpatialQuery& query,vector<SpatialObject*>& results, uint32 k);
 
 	   static void unLoadIndex(FLATIndex* index);
+
+	   // cache payload pages in budgetBytes over shards, 0 bytes reads every page from disk
+	   static void setPageCache(FLATIndex* index,uint64 budgetBytes,uint32 shards);
+
+	   // read ahead of the crawl on threads, 0 threads turns it off; needs the page cache
+	   static void setPrefetching(FLATIndex* index,int threads,uint32 maxInFlight);
+
+	   // queries on many threads at once: the metadata is read into memory and crawls are seeded on
+	   // its read-only partition tree, the seed tree and its storage are not touched by queries any
+	   // more; payload pages are read with pread through the (sharded) page cache. No prefetching
+	   static void setConcurrentReaders(FLATIndex* index);
+	};
+
+	/*
+	 * Executes a moving query one region at a time. Between steps it keeps the
+	 * metadata pages of the last crawl and, for every payload page in the last
+	 * region, the objects of the page overlapping the region it was read for.
+	 * A step starts crawling from the kept metadata pages instead of a seed
+	 * descent, reads only the metadata pages it has not kept, and rereads a
+	 * payload page only when the new region reaches a part of the page outside
+	 * the one it was read for. Pages the region has left are dropped. With a
+	 * prefetcher, the pages of the next region, extrapolated from the last
+	 * two, are requested at the end of every step.
+	 */
+	class MovingCrawl
+	{
+	public:
+		// a metadata page kept between steps
+		class CrawlPage
+		{
+		public:
+			vector<MetadataPage::Entry> entries;
+			vector<id> links;
+		};
+
+		// the objects of a payload page overlapping covered
+		class HeldPage
+		{
+		public:
+			Box covered;
+			vector<SpatialObject*> objects;
+		};
+
+		FLATIndex* index;
+		map<SpatialIndex::id_type,CrawlPage*> metadata;
+		map<int,HeldPage*> pages;
+		Box last;                       // region of the last step
+		uint64 steps;
+		uint64 pagesRead;
+		uint64 pagesReused;
+
+		MovingCrawl(FLATIndex* index);
+
+		~MovingCrawl();
+
+		// the objects in region, they belong to the crawl and live until the next step
+		void step(Box& region,vector<SpatialObject*>& results,QueryStatistics& stats);
+
+	private:
+		void prefetch(Box& next);
+
+		MovingCrawl(const MovingCrawl&);
+		MovingCrawl& operator=(const MovingCrawl&);
 	};
 }
 #endif
@@ -116,6 +116,7 @@ public:
         void init(const FLAT::Box& universeExtent,const double gridResolutionPerDimension0,
                 const double gridResolutionPerDimension1,const double gridResolutionPerDimension2);	
 	void analyze(const SpatialObjectList& dsA,const SpatialObjectList& dsB);
+	HashTable& cells() { return gridHashTable; }     // the non-empty cells
 };
 
 #endif	/* FLEXLOCALSPATIALGRIDHASH_H */
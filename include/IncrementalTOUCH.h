@@ -0,0 +1,94 @@
+/*
+ * File:   IncrementalTOUCH.h
+ *
+ * Persistent TOUCH over a fixed dataset A for time-stepped B datasets.
+ * After the initial run() the tree of A stays in memory and update() takes
+ * a batch of B changes (insert, delete, move). Only the changed objects are
+ * re-assigned and only the paths below their nodes are probed again.
+ * The difference to the previous step is reported in added/removed and
+ * applied to resultPairs in every result mode.
+ * dsB follows the updates. Inserted objects belong to the index. Deleted
+ * objects of the datasets stay in vdsAll and are freed with them.
+ *
+ */
+
+#ifndef INCREMENTALTOUCH_H
+#define	INCREMENTALTOUCH_H
+
+#include "TOUCH.h"
+
+#include <boost/unordered_set.hpp>
+
+#define update_Insert                   0
+#define update_Delete                   1
+#define update_Move                     2
+
+class UpdateB
+{
+public:
+    int type;                   // update_Insert, update_Delete or update_Move
+    int id;                     // id of the B object (TreeEntry::id)
+    FLAT::SpatialObject* obj;   // new geometry, NULL for update_Delete. Owned by the join afterwards
+
+    UpdateB(int ntype, int nid, FLAT::SpatialObject* object)
+    {
+        type = ntype;
+        id = nid;
+        obj = object;
+    }
+};
+
+typedef thrust::host_vector<UpdateB> UpdateList;
+
+class IncrementalTOUCH : public TOUCH {
+public:
+    IncrementalTOUCH();
+    virtual ~IncrementalTOUCH();
+
+    void run();
+    void update(UpdateList& updates);
+
+    /*
+     * Result delta of the last update() call, always as pairs. Pairs of
+     * deleted B objects stay valid until the next update() call.
+     */
+    ResultPairs added;
+    ResultPairs removed;
+
+    FLAT::Timer updating;
+    FLAT::uint64 updatedObjects;
+    FLAT::uint64 dirtyNodes;
+
+private:
+    typedef boost::unordered_map<int,TreeEntry*> EntryMap;
+    typedef boost::unordered_map<TreeEntry*,TreeNode*> AssignMap;
+    typedef boost::unordered_map<TreeEntry*,SpatialObjectList> PartnerMap;
+    typedef boost::unordered_map<ResultPair,FLAT::uint64> PairSlotMap;
+
+    // where a B object is, so that it leaves its lists in constant time
+    class Slots
+    {
+    public:
+        FLAT::uint64 inB;       // in dsB
+        FLAT::uint64 inNode;    // in attachedObjs[1] of its node
+    };
+    typedef boost::unordered_map<TreeEntry*,Slots> SlotMap;
+
+    EntryMap entriesB;          // B objects by id
+    AssignMap assignedTo;       // node every B object is attached to (NULL if filtered)
+    PartnerMap partners;        // current partners in A of every B object, sorted
+    SlotMap slots;
+    PairSlotMap pairSlots;      // position of every pair in resultPairs (result_Pairs)
+    boost::unordered_set<TreeEntry*> ownedB;    // inserted by update()
+    SpatialObjectList retired;  // deleted objects of ownedB, freed on the next update
+
+    void attach(TreeEntry* obj);
+    void detach(TreeEntry* obj);
+    void removeFromB(TreeEntry* obj);
+    void addResult(TreeEntry* objA, TreeEntry* objB);
+    void removeResult(TreeEntry* objA, TreeEntry* objB);
+    void probeObject(TreeEntry* obj, TreeNode* node, SpatialObjectList& found);
+};
+
+#endif	/* INCREMENTALTOUCH_H */
+
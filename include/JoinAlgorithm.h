@@ -15,6 +15,7 @@
 #include "Hilbert.hpp"
 #include "Box.hpp"
 #include "DataFileReader.hpp"
+#include "Tracer.hpp"
 
 #define algo_NL				0	//Nested Loop
 #define algo_PS				1	//Plane-Sweeping
@@ -22,6 +23,7 @@
 #define	algo_S3				3	//Size Separation Spatial
 #define	algo_PBSM			4	//Partition Based Spatial-Merge Join
 #define	algo_TOUCH			5	//TOUCH:Spatial Hierarchical Hash Join
+#define	algo_Auto			6	//The least costly as estimated by JoinEstimator
 
 #define No_Sort				0
 #define Hilbert_Sort                    1
@@ -71,6 +73,7 @@ public:
 
     
     ResultPairs resultPairs;
+    thrust::host_vector<FLAT::uint64> degrees;   // partners per A object (result_Degree)
     bool verbose;		// Output everything or not?
     
     double ramMem;
@@ -145,6 +148,13 @@ public:
     virtual void probe() {};
 
     void readBinaryInput(string file_dsA, string file_dsB);
+    void readBinaryInputA(string file_dsA);
+    void readBinaryInputB(string file_dsB);
+    // share the datasets loaded by another instance, the reads become no-ops
+    void useDatasets(JoinAlgorithm* loaded);
+    bool loadedA, loadedB;
+    void initDegrees();
+    void saveDegrees(std::string filename);
 
     SpatialObjectList vdsAll;	//vector of the mixed Objects and their MBRs
     SpatialObjectList vdsA;	//vector of the Objects and their MBRs of the smaller dataset ??@todo smallest?
@@ -196,6 +206,26 @@ public:
 	FLAT::Timer partition;
     FLAT::Timer gridCalculate;
     FLAT::Timer sizeCalculate;
+
+    // hardware counters of the phases, see enablePerfCounters()
+    bool perfCounters;
+    FLAT::PerfCounters buildingCounters;
+    FLAT::PerfCounters probingCounters;
+    FLAT::PerfCounters sortingCounters;
+    FLAT::PerfCounters partitionCounters;
+    
+    // resident memory of the phases, see enableMemoryUsage()
+    bool memoryUsage;
+    FLAT::MemoryUsage loadingMemory;
+    FLAT::MemoryUsage partitionMemory;
+    FLAT::MemoryUsage buildingMemory;
+    FLAT::MemoryUsage probingMemory;
+    
+    // bytes of the structures of the join, see countMemory()
+    FLAT::uint64 memEntries;        // TreeEntry objects, their geometry and the lists of them
+    FLAT::uint64 memNodes;          // tree nodes and their lists of children and objects
+    FLAT::uint64 memGrids;          // hash tables of the grids, the most held at once
+    FLAT::uint64 memResults;        // stored pairs and partners per A object
     
     int Levels;
     int LevelsD;
@@ -252,6 +282,21 @@ public:
             }
     };
     
+    // strict weak ordering along the Hilbert curve, for std::sort
+    struct ComparatorHilbertEntryAsc : public std::binary_function<TreeEntry* const, TreeEntry* const, bool>
+    {
+            bool operator()(TreeEntry* const r1, TreeEntry* const r2) const
+            {
+                    FLAT::Vertex r1p,r2p;
+                    r1p = r1->mbr.getCenter();
+                    r2p = r2->mbr.getCenter();
+                    double d1[3],d2[3];
+                    d1[0]=r1p[0];d1[1]=r1p[1];d1[2]=r1p[2];
+                    d2[0]=r2p[0];d2[1]=r2p[1];d2[2]=r2p[2];
+                    return hilbert_ieee_cmp(3,d1,d2)<0;
+            }
+    };
+    
     struct ComparatorHilbert : public std::binary_function<TreeNode* const, TreeNode* const, bool>
     {
             bool operator()(TreeNode* const r1, TreeNode* const r2)
@@ -302,14 +347,20 @@ public:
     std::set<int> s;
     // Returns true if touch and false if not by comparing The corners of the MBRs
     inline bool istouchingV(FLAT::SpatialObject* sobj1, FLAT::SpatialObject* sobj2)
+    {
+            ItemsCompared++;
+            return touches(sobj1,sobj2,epsilon);
+    }
+    
+    // The test of istouchingV without counting, safe to call from several threads
+    static inline bool touches(FLAT::SpatialObject* sobj1, FLAT::SpatialObject* sobj2, double epsilon)
     {
             std::vector<FLAT::Vertex> vertices1;
             std::vector<FLAT::Vertex> vertices2;
             FLAT::Box mbr1 = sobj1->getMBR();
             FLAT::Box mbr2 = sobj2->getMBR();
-            FLAT::Box::getAllVertices(sobj1->getMBR(),vertices1);
-            FLAT::Box::getAllVertices(sobj2->getMBR(),vertices2);
-            ItemsCompared++;
+            FLAT::Box::getAllVertices(mbr1,vertices1);
+            FLAT::Box::getAllVertices(mbr2,vertices2);
             
             for (unsigned int i=0;i<vertices1.size();++i)
             {
@@ -384,7 +435,25 @@ public:
     void totalTimeStop() { total.stop(); };
     
     void process_mem_usage(double& vm_usage, double& resident_set);
+    bool enablePerfCounters();
+    void enableMemoryUsage();
+    virtual void countMemory();
+    static FLAT::uint64 tableBytes(HashTable& table);
     void saveLog();
+    
+    /*
+     * Metrics of the run as a JSON object: the parameters, counters and
+     * times of saveLog and the sections of writeMetrics, e.g. the work per
+     * tree node and level or the occupancy of the grid cells.
+     */
+    bool saveMetrics(std::string filename);
+    virtual void writeMetrics(std::ostream& out) {};    // appends ,"section":value
+    
+    // {"count","sum","max","mean","log2"}, log2[0] counts the zeros and
+    // log2[i] the values in [2^(i-1),2^i)
+    static void writeHistogram(std::ostream& out, const std::vector<FLAT::uint64>& values);
+    // occupancy of the cells of table with an index in [first,last)
+    static void writeCells(std::ostream& out, HashTable& table, FLAT::uint64 first, FLAT::uint64 last);
     virtual void run() {};
     
 };
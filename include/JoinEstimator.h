@@ -0,0 +1,74 @@
+/*
+ * File:   JoinEstimator.h
+ *
+ * Estimates the result size and the work of the join algorithms from a
+ * histogram of the epsilon-expanded MBRs of the loaded datasets, before
+ * any of them runs.
+ *
+ * The universe is cut into cells about as wide as the objects. Two objects
+ * in a cell are taken as uniformly placed in it, so they come within w of
+ * each other in a dimension with probability (a+b+w)/L for extents a, b
+ * and cell length L. The comparisons of an algorithm are the pairs that
+ * share its partition (w is its cell or leaf width), or for PS that overlap
+ * along x. The results are the pairs within epsilon of the raw boxes.
+ */
+
+#ifndef JOINESTIMATOR_H
+#define	JOINESTIMATOR_H
+
+#include "JoinAlgorithm.h"
+
+#define ESTIMATED_ALGORITHMS            6       // algo_NL .. algo_TOUCH
+#define S3_LEVELS                       8       // as in S3Hash::run
+
+class JoinEstimator {
+public:
+    JoinEstimator(JoinAlgorithm* loaded);
+
+    FLAT::uint64 maxSample;         // objects of a dataset in the histogram, 0 for all
+    int maxResolution;              // cells of the histogram per dimension
+    int gridResolution;             // SGrid: cells per dimension
+    int leafsize;                   // TOUCH: objects per leaf
+    int localJoin;                  // TOUCH: algo_NL or algo_SGrid
+
+    FLAT::Box universe;
+    int resolution[DIMENSION];
+    double sizeA, sizeB;
+    double pairs;
+    double selectivity;             // pairs in % of #A * #B
+    double compared[ESTIMATED_ALGORITHMS];
+    double cost[ESTIMATED_ALGORITHMS];  // in object tests: comparisons, sorting, replication
+
+    void estimate();
+    int best();                     // the algorithm of least cost
+    void print();
+
+private:
+    // objects per cell and the sum of their extents
+    class Histogram
+    {
+    public:
+        std::vector<double> count;
+        std::vector<double> extent[DIMENSION];
+        double average[DIMENSION];
+    };
+
+    JoinAlgorithm* join;
+    Histogram histA, histB;
+    FLAT::Vertex cellWidth;
+
+    void averageExtents(SpatialObjectList& ds, Histogram& hist);
+    void fill(SpatialObjectList& ds, Histogram& hist);
+    FLAT::uint64 cellIndex(const FLAT::Vertex& v);
+    double results();
+    double candidates(const double width[DIMENSION]);
+    double candidatesShared(const double width[DIMENSION], double grow);
+    void levelShares(const double extent[DIMENSION], double share[S3_LEVELS]);
+    double pairsInCells(int level);
+    double candidatesLevels();
+    double candidatesLeaves();
+    double candidatesX();
+    double replicas(double objects, const double extent[DIMENSION], double cells);
+};
+
+#endif	/* JOINESTIMATOR_H */
@@ -115,6 +115,7 @@ public:
         void probe(TreeEntry*& obj);
         void init(const FLAT::Box& universeExtent,const double gridResolutionPerDimension);	
 	void analyze(const SpatialObjectList& dsA,const SpatialObjectList& dsB);
+	HashTable& cells() { return gridHashTable; }     // the non-empty cells
 };
 
 #endif	/* LOCALSPATIALGRIDHASH_H */
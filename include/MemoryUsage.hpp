@@ -0,0 +1,47 @@
+#ifndef MEMORY_USAGE_HPP
+#define MEMORY_USAGE_HPP
+
+#include "GlobalCommon.hpp"
+#include <iostream>
+#include <string>
+
+namespace FLAT
+{
+	/*
+	 * Resident memory of a phase, sampled with the start and stop of its
+	 * Timer like PerfCounters.
+	 *
+	 * start() sets the peak of the process back to the current size where
+	 * the kernel allows it (clear_refs 5), so peak is the high-water mark
+	 * within the phase, otherwise the one since the process started. Phases
+	 * sampled this way must not nest.
+	 */
+	class MemoryUsage
+	{
+	public:
+		static uint64 resident();               // VmRSS in KB, 0 if unknown
+		static uint64 peakResident();           // VmHWM in KB, 0 if unknown
+		static bool resetPeak();
+
+		uint64 peak;                            // KB, highest of all start/stop
+		int64 growth;                           // KB, resident after minus before, summed
+		bool running;
+
+		MemoryUsage();
+
+		void start();
+		void stop();
+		void reset();
+
+		// CSV column names for the given phase
+		static std::string header(const std::string& phase);
+
+		// peak and growth as CSV fields
+		friend std::ostream & operator << (std::ostream & lhs, MemoryUsage& rhs);
+
+	private:
+		uint64 begin;
+	};
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include "Box.hpp"
 #include <SpatialIndex.h>
 #include <set>
+#include <pthread.h>
 
 using namespace std;
 namespace FLAT
@@ -63,6 +64,118 @@ typedef uint32_t id;
 		virtual bool doneVisiting();
 	};
 
+	/*
+	 * Read-only tree over the partition MBRs, packed once in memory along the
+	 * Hilbert curve. Queries do not change it, so any number of threads can
+	 * search it at the same time to induce the links or to seed crawls.
+	 */
+	class LinkerTree
+	{
+	public:
+		class Node
+		{
+		public:
+			Box mbr;
+			uint32 first;       // first child node, or first position in order for a leaf
+			uint32 count;
+			bool leaf;
+		};
+
+		vector<Box> partitions;     // by pageId
+		vector<id> order;           // pageIds along the Hilbert curve
+		vector<Node> nodes;         // level by level from the leaves, the root is the last one
+
+		LinkerTree(vector<MetadataEntry*>* metadataStructure,uint32 fanout);
+
+		// over the partitions of the pageIds 0 .. partitions.size()-1
+		LinkerTree(const vector<Box>& partitions,uint32 fanout);
+
+		// pageIds of the partitions intersecting region (touching counts)
+		void intersects(const Box& region,vector<id>& found) const;
+
+		// the pageId of a partition intersecting region, false if there is none
+		bool intersectsAny(const Box& region,id& found) const;
+
+		// the pageId of the partition nearest to point, false without partitions
+		bool nearest(const Vertex& point,id& found) const;
+
+	private:
+		void pack(uint32 fanout);
+	};
+
+	class nodeSkeleton;     // Avoid Circular Includes
+
+	/*
+	 * The entries of a metadata page (a leaf of the seed tree) as the crawl
+	 * walks them, with the links of all the entries in one array. A page read
+	 * from the storage manager is parsed into the page itself, a page of a
+	 * memory resident index points into its ResidentMetadata.
+	 */
+	class MetadataPage
+	{
+	public:
+		class Entry
+		{
+		public:
+			Box partition;
+			Box pageMbr;
+			id pageId;
+			uint32 firstLink;
+			uint32 links;
+		};
+
+		const Entry* entries;
+		uint32 count;
+		const id* links;
+
+		MetadataPage();
+
+		// the entries of a leaf node, copied into the page
+		void assign(nodeSkeleton* node);
+
+	private:
+		vector<Entry> ownEntries;
+		vector<id> ownLinks;
+	};
+
+	/*
+	 * Every metadata page of an index parsed once: the entries of all the
+	 * pages in one array, their links in a flat adjacency array, and the
+	 * first entry of every page by the id of its seed tree leaf. Crawls are
+	 * seeded on a LinkerTree over the partitions instead of the seed tree,
+	 * so that nothing is written while queries run on many threads.
+	 */
+	class ResidentMetadata
+	{
+	public:
+		vector<MetadataPage::Entry> entries;
+		vector<id> links;
+		vector<uint32> firstEntry;      // by slot, one more than the pages
+		vector<int32> slot;             // of a leaf id, -1 for the other pages
+		vector<SpatialIndex::id_type> leafOf;   // the leaf holding the entry of every pageId
+		LinkerTree* partitions;
+
+		// reads every leaf of the seed tree in storage
+		ResidentMetadata(SpatialIndex::IStorageManager* storage);
+
+		~ResidentMetadata();
+
+		// false if the id is not a metadata page
+		bool page(SpatialIndex::id_type leaf,MetadataPage& page) const;
+
+		// the metadata page of a partition intersecting region, false if there is none
+		bool seed(const Box& region,SpatialIndex::id_type& leaf) const;
+
+		// the metadata page of the partition nearest to point
+		bool nearest(const Vertex& point,SpatialIndex::id_type& leaf) const;
+
+		uint64 bytes() const;
+
+	private:
+		ResidentMetadata(const ResidentMetadata&);
+		ResidentMetadata& operator=(const ResidentMetadata&);
+	};
+
 	class MetaDataStream : public SpatialIndex::IDataStream
 	{
 	public:
@@ -83,6 +196,8 @@ typedef uint32_t id;
 
 		MetaDataStream (vector<MetadataEntry*>* metadataStructure,SpatialIndex::ISpatialIndex *linkerTree);
 		MetaDataStream (vector<MetadataEntry*>* metadataStructure);
+		// the links of all the entries are induced up front on threads
+		MetaDataStream (vector<MetadataEntry*>* metadataStructure,int threads);
 
 		virtual ~MetaDataStream();
 
@@ -95,6 +210,22 @@ typedef uint32_t id;
 		virtual SpatialIndex::IData* getNext();
 
 		void GenerateLinks(MetadataEntry* me,uint32_t i);
+
+		// links every entry to the partitions its partition intersects, on threads
+		// sharing one LinkerTree; each entry is written by the thread that took it
+		static void induceLinks(vector<MetadataEntry*>* metadataStructure,int threads);
+
+	private:
+		class Task
+		{
+		public:
+			pthread_t thread;
+			vector<MetadataEntry*>* metadataStructure;
+			LinkerTree* tree;
+			uint32* nextChunk;
+		};
+
+		static void* linkWorker(void* arg);
 	};
 
 }
@@ -56,6 +56,27 @@ private:
 
 	}
 
+	/*
+	 * Cell holding the low corner of the overlap of both MBRs as expanded by
+	 * build(). Every touching pair is found in it exactly once.
+	 */
+	bool isReferenceCell(TreeEntry* sobjA, TreeEntry* sobjB, const FLAT::uint64 cell)
+	{
+		double exp = epsilon * 0.5;
+		FLAT::Box mbrA = sobjA->getMBR();
+		FLAT::Box mbrB = sobjB->getMBR();
+		FLAT::Box::expand(mbrA,exp);
+		FLAT::Box::expand(mbrB,exp);
+		if (!FLAT::Box::overlap(mbrA,mbrB)) return false;
+
+		FLAT::Vertex corner;
+		for (int i=0;i<DIMENSION;++i)
+			corner[i] = std::max(mbrA.low[i],mbrB.low[i]);
+		int x,y,z;
+		vertex2GridLocation(corner,x,y,z);
+		return gridLocation2Index(x,y,z) == cell;
+	}
+
 public:
 
 	PBSMHash() {
@@ -69,6 +90,12 @@ public:
 	void joincells(const FLAT::uint64 indexA, const FLAT::uint64 indexB);
 	void probe();
 	void analyze(const SpatialObjectList& dsA,const SpatialObjectList& dsB);
+	void writeMetrics(std::ostream& out);
+	void countMemory()
+	{
+		memGrids = tableBytes(hashTableA) + tableBytes(hashTableB);
+		JoinAlgorithm::countMemory();
+	}
         void init(FLAT::uint64 partitionPerDim);
         void run()
         {
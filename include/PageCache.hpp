@@ -0,0 +1,119 @@
+#ifndef PAGE_CACHE_HPP
+#define PAGE_CACHE_HPP
+
+#include "SpatialObject.hpp"
+#include <map>
+#include <vector>
+#include <pthread.h>
+
+using namespace std;
+
+namespace FLAT
+{
+	class PayLoad;      // Avoid Circular Includes
+
+	class CachedPage
+	{
+	public:
+		int pageId;
+		int8* data;             // the raw page: object counter followed by the records
+		int pins;               // views using the page, it is not evicted while pinned
+		bool referenced;        // CLOCK bit
+		bool prefetched;        // read ahead and not used yet
+	};
+
+	/*
+	 * Cache of payload pages with a byte budget. The pages are spread over
+	 * shards by page id, every shard has its own lock and its share of the
+	 * budget and evicts with the CLOCK policy (second chance).
+	 */
+	class PageCache
+	{
+	public:
+		class Shard
+		{
+		public:
+			pthread_mutex_t lock;
+			map<int,CachedPage*> pages;
+			vector<CachedPage*> clock;
+			uint32 hand;
+			uint64 bytes;
+			uint64 budget;
+			uint64 hits;
+			uint64 misses;
+			uint64 evictions;
+		};
+
+		uint32 pageSize;
+		vector<Shard*> shards;
+
+		PageCache(uint64 budgetBytes,uint32 shardCount,uint32 pageSize);
+
+		~PageCache();
+
+		// pinned page, read through the payload on a miss; NULL if it cannot be read.
+		// prefetched tells if it is the first use of a page read ahead
+		CachedPage* pin(int pageId,PayLoad* payload,bool* hit,bool* prefetched=NULL);
+
+		// a page read ahead, unpinned and first in line for eviction; takes data
+		void insert(int pageId,int8* data);
+
+		bool contains(int pageId);
+
+		void unpin(CachedPage* page);
+
+		uint64 hits();
+		uint64 misses();
+		uint64 evictions();
+		uint64 bytes();
+
+	private:
+		void evict(Shard* shard);
+	};
+
+	/*
+	 * Read-only view of the objects of a payload page. The records are
+	 * decoded in place into an object of the caller, so scanning a page
+	 * allocates nothing. The page stays pinned until the view is released
+	 * or reused for another page.
+	 */
+	class PageView
+	{
+	public:
+		PageCache* cache;
+		CachedPage* page;       // pinned page of the cache, NULL without a cache
+		int8* buffer;           // own copy of the page without a cache
+		int8* unpacked;         // records of a packed page
+		const int8* data;
+		uint32 objects;
+		uint32 objectByteSize;
+		SpatialObjectType objType;
+		bool prefetched;        // first use of a page read ahead
+
+		PageView();
+
+		~PageView();
+
+		void release();
+
+		const int8* record(uint32 i) const
+		{
+			return data + sizeof(uint32) + i*objectByteSize;
+		}
+
+		// decode record i into an object of the page type
+		void read(uint32 i,SpatialObject* object) const
+		{
+			object->unserialize((int8*)record(i));
+		}
+
+		// a new object for record i, owned by the caller
+		SpatialObject* create(uint32 i) const;
+
+	private:
+		PageView(const PageView&);
+		PageView& operator=(const PageView&);
+	};
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PAGE_CODEC_HPP
+#define PAGE_CODEC_HPP
+
+#include "GlobalCommon.hpp"
+
+namespace FLAT
+{
+	// format of the payload pages, stamped in the payload header (old headers read as RAW_PAGES)
+	enum PageFormat
+	{
+		RAW_PAGES,
+		PACKED_PAGES
+	};
+
+	/*
+	 * Packed payload pages: frame of reference coding over the 32 bit word
+	 * columns of the records (a double is two columns, a float or an id
+	 * one). Every word is mapped to a key that keeps the order of IEEE
+	 * floats and a column is stored as the differences of its keys to its
+	 * base, the smallest key of the column in the page, shifted right by
+	 * the zero bits they all end with and bit packed at the width of the
+	 * largest. The coding is lossless; the value of record i is at bit
+	 * i*width of its column stream.
+	 *
+	 * Layout: uint32 objects, then per column uint32 base, uint8 width and
+	 * uint8 shift rounded up to a word, then the streams of the columns in
+	 * 32 bit words and two words of padding, as the decoder reads every
+	 * value as two words.
+	 */
+	class PageCodec
+	{
+	public:
+		// bytes of the packed page, records are objects of objectSize bytes
+		static uint32 packedSize(const int8* records,uint32 objects,uint32 objectSize);
+
+		// page must hold packedSize bytes
+		static void pack(const int8* records,uint32 objects,uint32 objectSize,int8* page);
+
+		// the page as a raw one: object counter followed by the records. False, and raw
+		// is not written, if a width or shift is out of range or the streams end past pageSize
+		static bool unpack(const int8* page,uint32 pageSize,uint32 objectSize,int8* raw);
+
+		// the bit widths of the columns of a page of records, summed
+		static uint32 recordBits(const int8* records,uint32 objects,uint32 objectSize);
+	};
+}
+
+#endif
@@ -3,7 +3,11 @@
 
 #include "SpatialObject.hpp"
 #include "BufferedFile.hpp"
+#include "PageCache.hpp"
+#include "PageCodec.hpp"
+#include "ResidentMemory.hpp"
 #include <vector>
+#include <pthread.h>
 using namespace std;
 
 namespace FLAT
@@ -21,18 +25,41 @@ namespace FLAT
 		uint32 objectSize;
 		bool isCreated;
 		SpatialObjectType objType;
+		PageFormat format;       // packed pages hold up to objectsPerPage objects in pageSize bytes
+		PageCache* cache;        // NULL reads every page from the file
+		ResidentArena* resident; // all the pages in memory, NULL on disk
+		uint64 residentPages;
+		int fd;                  // the loaded file for pread, -1 reads through file under fileLock
+		pthread_mutex_t fileLock;
 
 		PayLoad();
 
 		~PayLoad();
 
-		void create(string indexFileStem,uint32 pageSize,uint64 objectsPerPage,uint32 objectSize,SpatialObjectType objectType);
+		void create(string indexFileStem,uint32 pageSize,uint64 objectsPerPage,uint32 objectSize,SpatialObjectType objectType,PageFormat format=RAW_PAGES);
 
 		void load(string indexFileStem);
 
 		bool putPage(vector<SpatialObject*>& itemArray);
 
+		// does the page fit in pageSize bytes in the format of the payload
+		bool fits(vector<SpatialObject*>& itemArray,uint64 begin,uint64 end);
+
  		bool getPage(vector<SpatialObject*>& itemArray,int pageId);
+
+		// view of the page through the cache; hit tells whether it was cached
+		bool getPage(PageView& view,int pageId,bool* hit=NULL);
+
+		// the page as it is in the file, safe on many threads
+		bool readPage(int pageId,int8* page);
+
+		void setCache(uint64 budgetBytes,uint32 shards);
+
+		// reads every page into memory, views then point straight at them
+		bool loadMemory(bool hugePages);
+
+		// bytes an object takes in the file, about pageSize/objectsPerPage when packed
+		uint32 storedObjectSize();
 	};
 }
 
@@ -0,0 +1,59 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include "GlobalCommon.hpp"
+#include <iostream>
+#include <string>
+
+namespace FLAT
+{
+	#define PERF_CYCLES         0
+	#define PERF_INSTRUCTIONS   1
+	#define PERF_LLC_MISSES     2
+	#define PERF_BRANCH_MISSES  3
+	#define PERF_DTLB_MISSES    4
+	#define PERF_EVENTS         5
+
+	/*
+	 * Hardware counters of a phase, accumulated over start/stop like Timer.
+	 *
+	 * The events are opened once (perf_event_open, user space only) by the
+	 * thread calling open() and are inherited by the threads it creates later,
+	 * whose counts are included once they have exited. Events the machine or
+	 * the kernel settings do not allow are left out; without any, start and
+	 * stop do nothing and the counters are written as empty fields.
+	 */
+	class PerfCounters
+	{
+	public:
+		static bool open();                     // true if any event counts
+		static bool available[PERF_EVENTS];
+		static const char* names[PERF_EVENTS];
+
+		uint64 values[PERF_EVENTS];
+		bool running;
+
+		PerfCounters();
+
+		void start();
+		void stop();
+		void reset();
+		void add(PerfCounters& counters);
+
+		// CSV column names of the events for the given phase
+		static std::string header(const std::string& phase);
+
+		// the values as CSV fields, empty for missing events
+		friend std::ostream & operator << (std::ostream & lhs, PerfCounters& rhs);
+
+	private:
+		uint64 begin[PERF_EVENTS];
+
+		static bool opened;
+		static int fds[PERF_EVENTS];
+
+		static void read(uint64* counts);
+	};
+}
+
+#endif
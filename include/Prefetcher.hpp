@@ -0,0 +1,78 @@
+#ifndef PREFETCHER_HPP
+#define PREFETCHER_HPP
+
+#include "PayLoad.hpp"
+#include "SeedBuilder.hpp"
+#include <deque>
+#include <map>
+#include <set>
+#include <pthread.h>
+
+namespace FLAT
+{
+	/*
+	 * Asynchronous reads ahead of a FLAT crawl on a pool of threads.
+	 *
+	 * The crawl asks for the metadata pages it puts on its frontier. When a
+	 * metadata page arrives, the payload pages of its entries that overlap
+	 * the query are requested as well. Payload pages are read with pread
+	 * straight into the page cache of the payload. Metadata pages are read
+	 * through the seed tree storage manager, which is not thread safe, so
+	 * every access to it goes through storageLock and the prefetched nodes
+	 * wait in a map until the crawl takes them.
+	 *
+	 * Requests beyond maxInFlight (queued or being read) are dropped.
+	 */
+	class Prefetcher
+	{
+	public:
+		class Request
+		{
+		public:
+			bool metadata;
+			SpatialIndex::id_type page;
+			Box region;
+		};
+
+		PayLoad* payload;
+		SpatialIndex::IStorageManager* storage;
+		pthread_mutex_t storageLock;
+		int fd;                                     // payload file for pread
+
+		uint32 maxInFlight;
+		uint64 issued;
+		uint64 dropped;
+
+		Prefetcher(PayLoad* payload,SpatialIndex::IStorageManager* storage,int threads,uint32 maxInFlight);
+
+		~Prefetcher();
+
+		void prefetchMetadata(SpatialIndex::id_type page,const Box& region);
+
+		void prefetchPayLoad(int pageId);
+
+		// the metadata page, prefetched if possible; prefetched tells which
+		nodeSkeleton* readMetadata(SpatialIndex::id_type page,bool* prefetched);
+
+		// drop the queued requests, wait for the reads in progress and free unused metadata
+		void drain();
+
+	private:
+		pthread_mutex_t lock;
+		pthread_cond_t queued;
+		pthread_cond_t finished;
+		deque<Request> requests;
+		set<SpatialIndex::id_type> pendingMetadata;   // queued or being read
+		set<int> pendingPayLoad;
+		map<SpatialIndex::id_type,nodeSkeleton*> metadata;
+		uint32 reading;
+		bool stopping;
+		vector<pthread_t> workers;
+
+		bool enqueue(const Request& request);
+		void read(Request& request);
+		static void* workerMain(void* arg);
+	};
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef RESIDENT_MEMORY_HPP
+#define RESIDENT_MEMORY_HPP
+
+#include "GlobalCommon.hpp"
+
+namespace FLAT
+{
+	/*
+	 * One block of anonymous memory for the parts of a memory resident
+	 * index. With huge pages it is asked for on explicit huge pages first
+	 * and falls back to ordinary pages advised as transparent huge pages.
+	 */
+	class ResidentArena
+	{
+	public:
+		int8* data;
+		uint64 bytes;
+		uint64 mapped;          // bytes rounded up to the page size
+		bool huge;              // on explicit huge pages
+
+		ResidentArena();
+
+		~ResidentArena();
+
+		bool allocate(uint64 bytes,bool hugePages);
+
+	private:
+		ResidentArena(const ResidentArena&);
+		ResidentArena& operator=(const ResidentArena&);
+	};
+}
+
+#endif
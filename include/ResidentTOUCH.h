@@ -0,0 +1,110 @@
+/*
+ * File:   ResidentTOUCH.h
+ *
+ * TOUCH with the tree over A kept in memory for many small joins.
+ * build() reads A (or loads it, see loadIndexFile) and partitions it once.
+ * join() takes a set of B objects and reports the touching pairs to a
+ * ResultSink. It does not modify the tree: the B objects are assigned into
+ * scratch lists of the calling thread, so several threads may call join()
+ * at the same time on one ResidentTOUCH. The lists of a thread are freed
+ * when the thread exits, those of the threads still running with the
+ * index. The index must not be destroyed while such a thread exits.
+ * localJoin chooses the join of the objects of a node with the leaves
+ * below it: algo_NL, or algo_SGrid with a grid over the B objects.
+ *
+ */
+
+#ifndef RESIDENTTOUCH_H
+#define	RESIDENTTOUCH_H
+
+#include <pthread.h>
+
+#include "CommonTOUCH.h"
+
+class ResultSink
+{
+public:
+    virtual ~ResultSink() {}
+
+    // called for every touching pair, by the thread that called join()
+    virtual void report(TreeEntry* objA, TreeEntry* objB) = 0;
+};
+
+// Collects the pairs into a ResultPairs
+class PairSink : public ResultSink
+{
+public:
+    ResultPairs& pairs;
+
+    PairSink(ResultPairs& resultPairs) : pairs(resultPairs) {}
+
+    void report(TreeEntry* objA, TreeEntry* objB)
+    {
+        pairs.addPair(objA,objB);
+    }
+};
+
+// Statistics of one join() call, reset at its start
+class JoinStats
+{
+public:
+    FLAT::uint64 objects;       // B objects of the call
+    FLAT::uint64 filtered;      // B objects overlapping no leaf of A
+    FLAT::uint64 compared;      // touch tests
+    FLAT::uint64 results;
+
+    FLAT::Timer assigning;
+    FLAT::Timer probing;
+
+    JoinStats()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        objects = 0;
+        filtered = 0;
+        compared = 0;
+        results = 0;
+        assigning.reset();
+        probing.reset();
+    }
+};
+
+class ResidentTOUCH : public CommonTOUCH {
+public:
+    ResidentTOUCH();
+    virtual ~ResidentTOUCH();
+
+    void build();
+    void join(const SpatialObjectList& B, ResultSink& sink, JoinStats& stats);
+
+    // one-shot join of file_dsB, like TOUCH::run
+    void run();
+
+private:
+    // per thread buffers of join(), indexed by node id
+    class Scratch
+    {
+    public:
+        std::vector<SpatialObjectList> assigned;   // B objects assigned to the node
+        std::vector<FLAT::Box> mbr;                // their combined MBR
+        std::vector<unsigned int> used;            // nodes with assigned objects
+        std::queue<TreeNode*> nodes;
+        NodeList leaves;
+        ResidentTOUCH* owner;
+    };
+
+    pthread_key_t scratchKey;
+    pthread_mutex_t scratchLock;
+    std::vector<Scratch*> scratches;            // buffers of the running threads, freed with the index
+
+    Scratch* getScratch();
+    static void freeScratch(void* buffers);
+    void probeGrid(SpatialObjectList& assigned, const FLAT::Box& mbr, NodeList& leaves,
+                   ResultSink& sink, JoinStats& stats);
+};
+
+#endif	/* RESIDENTTOUCH_H */
+
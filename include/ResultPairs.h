@@ -8,6 +8,12 @@
  * 
  * Objects are saved in pairs <object type 0, object type 1>
  * Swapped automatically if needed
+ *
+ * In the aggregation modes no pair is stored: result_Count only counts,
+ * result_Degree also counts the partners of every A object in a dense
+ * array indexed by TreeEntry::id. The join algorithms then avoid
+ * duplicates themselves (see SpatialGridHash::isReferenceCell) and
+ * deDuplicate does nothing.
  */
 
 #ifndef RESULTPAIRS_H
@@ -15,6 +21,7 @@
 
 #include "TreeEntry.h"
 #include "TreeNode.h"
+#include "Tracer.hpp"
 #include <vector>
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
@@ -29,6 +36,10 @@
 typedef thrust::host_vector<TreeNode*> NodeList;
 typedef thrust::host_vector<TreeEntry*> SpatialObjectList;
 
+#define result_Pairs                    0       // store every pair
+#define result_Count                    1       // count only
+#define result_Degree                   2       // count and partners per A object
+
 typedef std::pair<TreeEntry*,TreeEntry*> ResultPair; //no boost set for thrust
 typedef boost::unordered_set< ResultPair > ResultList; // storing unique results
 
@@ -43,10 +54,15 @@ public:
     FLAT::Timer deDuplicateTime;
     FLAT::uint64 duplicates;
 
+    int mode;
+    FLAT::uint64* degree;       // partners per A object, shared with the sub-joins
+
     ResultPairs()
     {
         results = 0;
         duplicates = 0;
+        mode = result_Pairs;
+        degree = NULL;
     }
     ~ResultPairs()
     {
@@ -55,6 +71,33 @@ public:
     }
     void addPair(TreeEntry* sobjA, TreeEntry* sobjB);
     void deDuplicate();
+    
+    bool storesPairs()
+    {
+        return mode == result_Pairs;
+    }
+    
+    // room for the expected number of pairs, e.g. from JoinEstimator
+    void reserve(FLAT::uint64 pairs)
+    {
+        if (!storesPairs()) return;
+        objA.reserve(pairs);
+        objB.reserve(pairs);
+    }
+    
+    // aggregate the same way as other, e.g. in the grid of a tree node
+    void useMode(const ResultPairs& other)
+    {
+        mode = other.mode;
+        degree = other.degree;
+    }
+    void clear()
+    {
+        objA.clear();
+        objB.clear();
+        results = 0;
+        duplicates = 0;
+    }
     void printAllResults()
     {
         FLAT::Box b1; 
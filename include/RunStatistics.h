@@ -0,0 +1,35 @@
+/*
+ * File:   RunStatistics.h
+ *
+ * Times of the phases over repeated runs of a join on the same data, with
+ * the minimum, median and 95th percentile of every phase. The percentile
+ * is nearest-rank, so with few runs it is the slowest one.
+ */
+
+#ifndef RUNSTATISTICS_H
+#define	RUNSTATISTICS_H
+
+#include <string>
+#include <vector>
+
+#include "JoinAlgorithm.h"
+
+#define RUN_PHASES                      10
+
+class RunStatistics {
+public:
+    RunStatistics();
+
+    std::vector<double> seconds[RUN_PHASES];    // per phase, one per run
+    std::vector<FLAT::uint64> results;
+    std::vector<FLAT::uint64> compared;
+
+    void add(JoinAlgorithm* run);
+    void print();
+
+    static std::string phaseName(int phase);
+    static double percentile(std::vector<double> values, double p);
+    static double median(std::vector<double> values);
+};
+
+#endif	/* RUNSTATISTICS_H */
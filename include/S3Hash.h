@@ -25,14 +25,28 @@ private:
 	{
 		return  indexOffset[level]+(x + (y*resolution[level]) + (z*resolution[level]*resolution[level]));
 	}
+	// level and cell coordinates of a hash table index
+	void index2GridLocation(FLAT::uint64 index,int& x,int& y,int& z,int& level)
+	{
+		level = levels-1;
+		while (index < indexOffset[level]) level--;
+		index -= indexOffset[level];
+		x = index % resolution[level];
+		y = (index / resolution[level]) % resolution[level];
+		z = index / ((FLAT::uint64)resolution[level]*resolution[level]);
+	}
+	// index of the cell at the coarser level enclosing the given cell
+	FLAT::uint64 enclosingCell(const int x,const int y,const int z, const int level, const int coarser)
+	{
+		int ratio = resolution[level]/resolution[coarser];
+		return gridLocation2Index(x/ratio,y/ratio,z/ratio,coarser);
+	}
 	void vertex2GridLocation(const FLAT::Vertex& v,int& x,int& y,int &z, const int level)
 	{
 		x = (v[0] > universe.low[0])?(int)floor( (v[0] - universe.low[0]) / universeWidth[level][0]):0;
 		y = (v[1] > universe.low[1])?(int)floor( (v[1] - universe.low[1]) / universeWidth[level][1]):0;
 		z = (v[2] > universe.low[2])?(int)floor( (v[2] - universe.low[2]) / universeWidth[level][2]):0;
                 
-                if (v[0] < 1034.06 && v[0] > 1034.04)
-
 		// if cell not valid assign last corner cells
 		if (x>=resolution[level]) x=resolution[level]-1;
 		if (y>=resolution[level]) y=resolution[level]-1;
@@ -45,8 +59,7 @@ public:
     {
         totalTimeStart();
         readBinaryInput(file_dsA, file_dsB);
-        this->base = 100;
-        init(10);
+        init(8);
         build(dsA,dsB);
         probe();
         totalTimeStop();
@@ -62,20 +75,22 @@ public:
 	void joincells(const FLAT::uint64 indexA, const FLAT::uint64 indexB)
 	{
 		// join objects in the cells A and B
-		SpatialObjectList A,B;
-
 		HashTable::iterator hA = hashTableA.find(indexA);
 		if (hA==hashTableA.end()) return;
-		A = *( hA->second );
 
 		HashTable::iterator hB = hashTableB.find(indexB);
 		if (hB==hashTableB.end()) return;
-		B = *( hB->second );
-		NL(A,B);
+		NL(*( hA->second ),*( hB->second ));
 	}
     
 	void probe();
 	void analyze(const SpatialObjectList& dsA,const SpatialObjectList& dsB);
+	void writeMetrics(std::ostream& out);
+	void countMemory()
+	{
+		memGrids = tableBytes(hashTableA) + tableBytes(hashTableB);
+		JoinAlgorithm::countMemory();
+	}
 };
 
 
@@ -99,6 +99,25 @@ private:
 		return true;
 	}
 
+protected:
+
+	/*
+	 * A pair found in several cells is tested only in the cell holding the
+	 * low corner of the overlap of both MBRs. Used instead of deDuplicate
+	 * when the pairs are not stored.
+	 */
+	bool isReferenceCell(TreeEntry* sobj1, TreeEntry* sobj2, const FLAT::uint64 cell)
+	{
+		if (!FLAT::Box::overlap(sobj1->mbr,sobj2->mbr)) return false;
+
+		FLAT::Vertex corner;
+		for (int i=0;i<DIMENSION;++i)
+			corner[i] = std::max(sobj1->mbr.low[i],sobj2->mbr.low[i]);
+		int x,y,z;
+		vertex2GridLocation(corner,x,y,z);
+		return (FLAT::uint64)gridLocation2Index(x,y,z) == cell;
+	}
+
 public:
 
 	SpatialGridHash()
@@ -116,6 +135,14 @@ public:
         virtual void init(const FLAT::Box& universeExtent,const double gridResolutionPerDimension0,
                 const double gridResolutionPerDimension1,const double gridResolutionPerDimension2) {};
 	void analyze(const SpatialObjectList& dsA,const SpatialObjectList& dsB);
+	virtual HashTable& cells() { return gridHashTable; }     // the non-empty cells
+	void writeMetrics(std::ostream& out);
+	FLAT::uint64 gridBytes() { return sizeof(*this) + tableBytes(cells()); }
+	void countMemory()
+	{
+		memGrids = std::max(memGrids,gridBytes());
+		JoinAlgorithm::countMemory();
+	}
         
         static void transferInfo(SpatialGridHash* sgh, JoinAlgorithm* alg);
         
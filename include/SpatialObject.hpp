@@ -43,6 +43,7 @@ class Vertex;   // To avoid Circular Includes
                     std::cout << "Error! No random expansion implementation." << std::endl;
                 };
                 
+		// euclidean distance from p to the object, 0 inside it
 		virtual bigSpaceUnit pointDistance(Vertex& p)=0;
 	};
 
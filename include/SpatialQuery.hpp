@@ -37,6 +37,8 @@ namespace FLAT
 		uint64 FLAT_metaDataIOs;
 		uint64 FLAT_payLoadIOs;
 		uint64 FLAT_metaDataEntryLookup;
+		uint64 FLAT_payLoadCacheHits;
+		uint64 FLAT_payLoadCacheMisses;
 		int32 FLAT_seedId;
 		uint64 FLAT_prefetchMetaHits;
 		uint64 FLAT_prefetchPayLoadHit;
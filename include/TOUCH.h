@@ -16,9 +16,11 @@ public:
     virtual ~TOUCH();
     
     void run();
-private:
+protected:
     void joinNodeToDesc(TreeNode* ancestorNode);
+    void joinToLeaves(TreeNode* ancestorNode, SpatialObjectList& objs, thrust::host_vector<FLAT::Box>& mbrs);
     void assignment();
+    TreeNode* assignObject(TreeEntry* obj);
 };
 
 #endif	/* TOUCH_H */
@@ -11,6 +11,8 @@
 typedef size_t Count;
 #endif
 #include <iostream>
+#include "PerfCounters.hpp"
+#include "MemoryUsage.hpp"
 
 namespace FLAT
 {
@@ -23,6 +25,9 @@ namespace FLAT
 	public:
 		Timer();
 
+		// copies the time as operator= does, the counters stay with the original
+		Timer(const Timer &rhs);
+
 		void start();
 
 		void start(const std::string& label);
@@ -40,6 +45,8 @@ namespace FLAT
 		bool    _is_running;
 		bool    _at_zero;
 		std::string   _label;
+		PerfCounters* _counters;   // if set, sampled with every start and stop (not copied)
+		MemoryUsage*  _memory;     // the same for the resident memory
 	#ifdef WIN32
 		DWORD   _start;
 		DWORD   _elapsed_milliseconds;
@@ -60,11 +67,15 @@ namespace FLAT
             - (_start.tv_sec * 1000 + _start.tv_usec / 1000);
 #endif
         _is_running = false;
+        if (_counters != NULL) _counters->stop();
+        if (_memory != NULL) _memory->stop();
         return (Millisecond) _elapsed_milliseconds;
     }
 
     inline void Timer::start()
     {
+        if (_memory != NULL) _memory->start();
+        if (_counters != NULL) _counters->start();
         _is_running = true;
 #ifdef WIN32
         _start = GetTickCount();
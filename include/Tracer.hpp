@@ -0,0 +1,124 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include "GlobalCommon.hpp"
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+namespace FLAT
+{
+	typedef uint64 Nanosecond;
+
+	/*
+	 * Records nested spans of every thread on a steady clock and writes them
+	 * in the Chrome trace format (chrome://tracing, ui.perfetto.dev).
+	 *
+	 * Spans are compiled in with TRACING defined and recorded only while
+	 * Tracer::enabled is set, otherwise a span costs one branch.
+	 */
+	class Tracer
+	{
+	public:
+		static bool enabled;
+
+		static void enable();     // start recording; the time origin of the trace
+		static void disable();
+		static void clear();      // drop the recorded spans of all threads
+
+		static Nanosecond now();
+
+		// a finished span of the calling thread, arg is shown if argName is set
+		static void record(const char* name, Nanosecond begin, Nanosecond end,
+		                   const char* argName = NULL, int64 arg = 0);
+
+		// call when no thread is recording
+		static bool write(const std::string& fileName);
+
+	private:
+		class Event
+		{
+		public:
+			const char* name;
+			const char* argName;
+			int64 arg;
+			Nanosecond begin;
+			Nanosecond end;
+		};
+
+		class Buffer
+		{
+		public:
+			uint32 thread;
+			std::vector<Event> events;
+		};
+
+		static Nanosecond origin;
+		static pthread_key_t key;
+		static pthread_once_t once;
+		static pthread_mutex_t lock;
+		static std::vector<Buffer*> buffers;
+
+		static void createKey();
+		static Buffer* buffer();
+	};
+
+	// Records its lifetime as a span
+	class TraceScope
+	{
+	public:
+		TraceScope(const char* name, const char* argName = NULL, int64 arg = 0)
+			: _name(name), _argName(argName), _arg(arg), _begin(0)
+		{
+			if (Tracer::enabled) _begin = Tracer::now();
+		}
+
+		~TraceScope()
+		{
+			if (_begin != 0) Tracer::record(_name,_begin,Tracer::now(),_argName,_arg);
+		}
+
+		// end the span and start the next one of a sequence (e.g. tree levels),
+		// unless arg is the one of the current span
+		void next(int64 arg)
+		{
+			if (_begin == 0 || arg == _arg) return;
+			Nanosecond now = Tracer::now();
+			Tracer::record(_name,_begin,now,_argName,_arg);
+			_begin = now;
+			_arg = arg;
+		}
+
+		// end the span before the end of the scope
+		void stop()
+		{
+			if (_begin != 0) Tracer::record(_name,_begin,Tracer::now(),_argName,_arg);
+			_begin = 0;
+		}
+
+	private:
+		const char* _name;
+		const char* _argName;
+		int64 _arg;
+		Nanosecond _begin;
+	};
+}
+
+#define TRACE_CONCAT2(a,b) a##b
+#define TRACE_CONCAT(a,b) TRACE_CONCAT2(a,b)
+
+#ifdef TRACING
+	#define TRACE_SCOPE(name) FLAT::TraceScope TRACE_CONCAT(traceScope,__LINE__)(name)
+	#define TRACE_SCOPE_ARG(name,argName,arg) FLAT::TraceScope TRACE_CONCAT(traceScope,__LINE__)(name,argName,arg)
+	#define TRACE_SPAN(var,name,argName,arg) FLAT::TraceScope var(name,argName,arg)
+	#define TRACE_NEXT(var,arg) var.next(arg)
+	#define TRACE_STOP(var) var.stop()
+#else
+	#define TRACE_SCOPE(name)
+	#define TRACE_SCOPE_ARG(name,argName,arg)
+	#define TRACE_SPAN(var,name,argName,arg)
+	#define TRACE_NEXT(var,arg)
+	#define TRACE_STOP(var)
+#endif
+
+#endif
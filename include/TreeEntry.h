@@ -26,9 +26,25 @@ public:
     // make a Leaf item
     TreeEntry(FLAT::SpatialObject* object, int ntype, int nid, double epsilon)
     {
-        obj = object;
         type = ntype;
         id = nid;
+        setObject(object, epsilon);
+    }
+    
+    // make a Leaf item with an already expanded mbr (e.g. from a saved tree)
+    TreeEntry(FLAT::SpatialObject* object, int ntype, int nid, const FLAT::Box& expandedMbr)
+    {
+        type = ntype;
+        id = nid;
+        obj = object;
+        mbr = expandedMbr;
+        mbr.isEmpty = false;
+    }
+    
+    // replace the geometry (e.g. a moved object) and recompute the expanded mbr
+    void setObject(FLAT::SpatialObject* object, double epsilon)
+    {
+        obj = object;
         
         mbr = obj->getMBR();
         
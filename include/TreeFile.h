@@ -0,0 +1,76 @@
+/*
+ * File:   TreeFile.h
+ *
+ * On-disk layout of a built TOUCH tree over dataset A, written by
+ * CommonTOUCH::saveIndex and mapped by CommonTOUCH::loadIndex.
+ * All sections are arrays of fixed size records in the native layout of
+ * the writer, so the file can be mapped and read in place:
+ *
+ *   TreeFileHeader
+ *   TreeFileNode  [nodeCount]      node i is tree[i], leaves first
+ *   uint64        [childCount]     child node ids of the inner nodes
+ *   TreeFileEntry [entryCount]     objects of A, grouped by leaf
+ *   int8          [entryCount * objectByteSize]   serialized objects
+ *
+ */
+
+#ifndef TREEFILE_H
+#define	TREEFILE_H
+
+#include "GlobalCommon.hpp"
+
+#define TREEFILE_MAGIC                  "TOUCHIDX"
+#define TREEFILE_VERSION                1
+
+struct TreeFileHeader
+{
+    char magic[8];
+    FLAT::uint32 version;
+    FLAT::uint32 spaceUnitSize;         // sizeof(FLAT::spaceUnit) of the writer
+
+    // build parameters
+    double epsilon;                     // the MBRs below are expanded by epsilon/2
+    FLAT::uint32 leafsize;
+    FLAT::uint32 nodesize;
+    FLAT::int32 partitioningType;
+    FLAT::int32 levels;
+    FLAT::uint32 objectType;            // FLAT::SpatialObjectType of A
+    FLAT::uint32 objectByteSize;
+    char source[256];                   // dataset A the tree was built from
+
+    FLAT::uint64 nodeCount;
+    FLAT::uint64 childCount;
+    FLAT::uint64 entryCount;
+    FLAT::uint64 rootId;
+    FLAT::spaceUnit universeLow[DIMENSION];
+    FLAT::spaceUnit universeHigh[DIMENSION];
+
+    // byte offsets of the sections from the start of the file
+    FLAT::uint64 nodeOffset;
+    FLAT::uint64 childOffset;
+    FLAT::uint64 entryOffset;
+    FLAT::uint64 objectOffset;
+};
+
+struct TreeFileNode
+{
+    FLAT::spaceUnit low[DIMENSION];
+    FLAT::spaceUnit high[DIMENSION];
+    FLAT::int32 level;
+    FLAT::uint32 leaf;
+    FLAT::uint64 firstChild;            // range in the child id section
+    FLAT::uint64 children;
+    FLAT::uint64 firstEntry;            // range in the entry section (leaves)
+    FLAT::uint64 entries;
+};
+
+struct TreeFileEntry
+{
+    FLAT::spaceUnit low[DIMENSION];     // expanded MBR
+    FLAT::spaceUnit high[DIMENSION];
+    FLAT::int32 id;
+    FLAT::uint32 reserved;
+};
+
+#endif	/* TREEFILE_H */
+
@@ -8,6 +8,7 @@
 
 #include "TreeEntry.h"
 #include "ResultPairs.h"
+#include "Tracer.hpp"
 
 class LocalSpatialGridHash;
 class SpatialGridHash;
@@ -45,9 +46,23 @@ public:
         double stdSize[TYPES][DIMENSION];
         
         FLAT::uint64 objBelow[TYPES];
+        
+        // attachedObjs[1] of an overloaded node cut into spatial chunks,
+        // empty otherwise (see CommonTOUCH::splitOverloaded)
+        thrust::host_vector< thrust::host_vector<TreeEntry*> > chunks;
+        thrust::host_vector<FLAT::Box> chunkMbrs;
+        
+        // work of the joins started at this node (see CommonTOUCH::NodeWork)
+        FLAT::uint64 compared;
+        FLAT::uint64 results;
+        FLAT::Nanosecond joinTime;
+        FLAT::uint64 gridCells[TYPES];      // non-empty cells of the local grids
     
 	TreeNode(int Level)
 	{
+                resetWork();
+                for (int type = 0; type < TYPES; type++)
+                        spatialGridHash[type] = spatialGridHashAns[type] = NULL;
 		level = Level;
                 root = 0;
 		if (Level==0) leafnode = true;
@@ -57,12 +72,24 @@ public:
 	
 	TreeNode(const FLAT::Box& MbrA, const FLAT::Box& MbrB)
 	{
+                resetWork();
+                for (int type = 0; type < TYPES; type++)
+                        spatialGridHash[type] = spatialGridHashAns[type] = NULL;
 		mbrL[1] = MbrB;
 		mbrL[0] = MbrA;
                 mbrK[0] = MbrA;
                 mbrK[1] = MbrB;
                 mbr = FLAT::Box::combineSafe(MbrA,MbrB);
 	}
+        
+        void resetWork()
+        {
+                compared = 0;
+                results = 0;
+                joinTime = 0;
+                for (int type = 0; type < TYPES; type++)
+                        gridCells[type] = 0;
+        }
 };
 
 
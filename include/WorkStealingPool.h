@@ -0,0 +1,70 @@
+/*
+ * File:   WorkStealingPool.h
+ *
+ * Minimal pthread pool for recursive tasks. Every worker keeps its own
+ * deque: it pushes the tasks it spawns and pops them from the back, idle
+ * workers steal from the front of the others (the oldest, largest tasks).
+ * A worker that finds nothing retries a few rounds and then sleeps until
+ * a task is spawned or the last one is done. run() returns when all
+ * spawned tasks are done.
+ *
+ */
+
+#ifndef WORKSTEALINGPOOL_H
+#define	WORKSTEALINGPOOL_H
+
+#include <deque>
+#include <vector>
+#include <pthread.h>
+
+#include "GlobalCommon.hpp"
+
+class WorkStealingPool;
+
+class PoolTask
+{
+public:
+    virtual ~PoolTask() {}
+
+    // worker is the index of the executing thread, 0 .. threads-1
+    virtual void run(WorkStealingPool& pool, int worker) = 0;
+};
+
+class WorkStealingPool
+{
+public:
+    WorkStealingPool(int nthreads);
+    ~WorkStealingPool();
+
+    void run(PoolTask* task);               // execute task and everything it spawns
+    void spawn(PoolTask* task, int worker); // from inside PoolTask::run
+
+    int threads;
+    FLAT::uint64 steals;
+
+private:
+    class Worker
+    {
+    public:
+        WorkStealingPool* pool;
+        int id;
+        pthread_t thread;
+        pthread_mutex_t lock;
+        std::deque<PoolTask*> tasks;
+    };
+
+    std::vector<Worker*> workers;
+    volatile long pending;                  // spawned but not finished tasks
+    volatile long queued;                   // tasks in the deques, not taken yet
+    volatile long sleeping;                 // workers waiting for work
+    pthread_mutex_t idleLock;
+    pthread_cond_t workAvailable;
+
+    PoolTask* take(int worker);
+    void waitForWork();
+    void wakeAll();
+    static void* workerMain(void* arg);
+};
+
+#endif	/* WORKSTEALINGPOOL_H */
+
@@ -21,7 +21,9 @@ public:
     {
         totalTimeStart();
         readBinaryInput(file_dsA, file_dsB);
+        TRACE_SPAN(joinSpan,"nested loop",NULL,0);
         NL(dsA,dsB);
+        TRACE_STOP(joinSpan);
         totalTimeStop();
     }
 };
@@ -29,10 +29,13 @@ public:
     {
 
 	//Sort the datasets based on their lower x coordinate
+	TRACE_SPAN(sortSpan,"sort",NULL,0);
 	sorting.start();
 	thrust::sort(A.begin(), A.end(), Comparator_Xaxis());
 	thrust::sort(B.begin(), B.end(), Comparator_Xaxis());
 	sorting.stop();
+	TRACE_STOP(sortSpan);
+	TRACE_SCOPE("sweep");
 
 	//sweep
 	FLAT::uint64 iA=0,iB=0;
@@ -56,7 +59,7 @@ public:
                 {
                     if ( istouching(B[iB] , A[i]) )
                     {
-                        resultPairs.addPair( B[i] , A[iA] );
+                        resultPairs.addPair( A[i] , B[iB] );
                     }
                     i++;
                 }
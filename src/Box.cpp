@@ -549,6 +549,7 @@ namespace FLAT
 		memcpy(&(low.Vector), ptr,DIMENSION * sizeof(spaceUnit));
 		ptr += DIMENSION * sizeof(spaceUnit);
 		memcpy(&(high.Vector), ptr,DIMENSION * sizeof(spaceUnit));
+		isEmpty = false;
 	}
 
 	void Box::expand(Box& b1,spaceUnit width)
@@ -5,13 +5,44 @@
  */
 
 #include "CommonTOUCH.h"
+#include "WorkStealingPool.h"
+#include "TreeFile.h"
+#include "SpatialObjectFactory.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 CommonTOUCH::CommonTOUCH() {
+    threads = 1;
     localPartitions = 100;
     addFilter = 0;
+    skewFactor = 4;
+    skewChunk = 16;
+    overloadedNodes = 0;
+    chunkCount = 0;
+    ownsEntriesA = false;
 }
 
 CommonTOUCH::~CommonTOUCH() {
+    // the nodes and their grids, the entries belong to the datasets
+    for (NodeList::iterator it = tree.begin(); it != tree.end(); ++it)
+    {
+        for (int type = 0; type < TYPES; type++)
+        {
+            delete (*it)->spatialGridHash[type];
+            delete (*it)->spatialGridHashAns[type];
+        }
+        delete (*it);
+    }
+    if (ownsEntriesA)
+        for (SpatialObjectList::iterator it = vdsA.begin(); it != vdsA.end(); ++it)
+        {
+            delete (*it)->obj;
+            delete (*it);
+        }
 }
 
 /*
@@ -23,6 +54,7 @@ void CommonTOUCH::joinObjectToDesc(TreeEntry* obj, TreeNode* ancestorNode)
     queue<TreeNode*> nodes;
     nodes.push(ancestorNode);
     TreeNode* node;
+    comparing.start();
     while(nodes.size()>0)
     {
         //start from checking children, each for intersection of MBR
@@ -41,7 +73,6 @@ void CommonTOUCH::joinObjectToDesc(TreeEntry* obj, TreeNode* ancestorNode)
             
                 //if intersects
                 ItemsMaxCompared += (*it)->attachedObjs[!obj->type].size();
-                comparing.start();
                 if(localJoin == algo_SGrid && (*it)->attachedObjs[!obj->type].size() > 0)
                 {
                     (*it)->spatialGridHash[!obj->type]->probe(obj);
@@ -50,7 +81,6 @@ void CommonTOUCH::joinObjectToDesc(TreeEntry* obj, TreeNode* ancestorNode)
                 {
                     NL(obj, (*it)->attachedObjs[!obj->type]);
                 }
-                comparing.stop();
             
             if (FLAT::Box::overlap(obj->mbr, (*it)->mbr))
             {
@@ -63,10 +93,12 @@ void CommonTOUCH::joinObjectToDesc(TreeEntry* obj, TreeNode* ancestorNode)
         }
 
     }
+    comparing.stop();
 }
 
 void CommonTOUCH::joinNodeToDesc(TreeNode* node)
 {
+    NodeWork work(node,this);
     /*
      * A -> B_below
      */
@@ -99,15 +131,15 @@ void CommonTOUCH::joinNodeToDesc(TreeNode* node)
         }
         else
         {
+            comparing.start();
             for (SpatialObjectList::iterator it = node->attachedObjs[0].begin();
                                                             it != node->attachedObjs[0].end(); it++)
             {
                 ItemsMaxCompared += node->attachedObjs[1].size();                                
-                comparing.start();
                     if (FLAT::Box::overlap((*it)->mbr, node->mbrSelfD[1]))
                         NL((*it), node->attachedObjs[1]);
-                comparing.stop();
             }
+            comparing.stop();
         }
         
         
@@ -122,22 +154,23 @@ void CommonTOUCH::joinNodeToDesc(TreeNode* node)
         }
         else
         {
+            comparing.start();
             for (SpatialObjectList::iterator it = node->attachedObjs[1].begin();
                                     it != node->attachedObjs[1].end(); it++)
             {
                 ItemsMaxCompared += node->attachedObjs[0].size();
-                comparing.start();
                 
                     if (FLAT::Box::overlap((*it)->mbr, node->mbrSelfD[0]))
                         NL((*it), node->attachedObjs[0]);
-                comparing.stop();
             }
+            comparing.stop();
         }
     }
 }
 
 void CommonTOUCH::probe()
 {
+    TRACE_SCOPE("probe");
     if(localJoin == algo_SGrid && treeTraversal == join_TD && algorithm != algo_TOUCH)
         countSpatialGrid();
     
@@ -147,7 +180,10 @@ void CommonTOUCH::probe()
     switch (treeTraversal)
     {
         case join_BU:
-            probeDownUp();
+            if (threads > 1)
+                probeDownUpParallel();
+            else
+                probeDownUp();
             break;
         case join_TDD:
             probeUpDown();
@@ -162,6 +198,7 @@ void CommonTOUCH::probe()
             Qnodes.push(root);
 
             int lvl = Levels;
+            TRACE_SPAN(levelSpan,"level","level",root->level);
             // A BFS on the tree then for each find all its leaf nodes by another BFS
             while(Qnodes.size()>0)
             {
@@ -175,12 +212,12 @@ void CommonTOUCH::probe()
                     }
 
                 // just to display the level of the BFS traversal
-                if (verbose)
-                    if(lvl!=currentNode->level)
-                    {
-                            lvl = currentNode->level;
-                            cout << "\n### Level " << lvl <<endl;
-                    }
+                if(lvl!=currentNode->level)
+                {
+                        lvl = currentNode->level;
+                        if (verbose) cout << "\n### Level " << lvl <<endl;
+                        TRACE_NEXT(levelSpan,lvl);
+                }
 
                 // If the current node has no objects assigned to it, no join is needed for the current node to the leaf nodes.
 
@@ -211,6 +248,15 @@ void CommonTOUCH::probe()
 }
 
 void CommonTOUCH::JOIN(TreeNode* node, TreeNode* nodeObj)
+{
+    JOIN(node,nodeObj,this);
+}
+
+/*
+ * Results and counters go to sink, which is this or the buffer of a worker
+ * of the parallel traversal.
+ */
+void CommonTOUCH::JOIN(TreeNode* node, TreeNode* nodeObj, JoinAlgorithm* sink)
 {
     int type;
     if (node == nodeObj)
@@ -241,35 +287,52 @@ void CommonTOUCH::JOIN(TreeNode* node, TreeNode* nodeObj)
         }
         else
         {
-            NL(node->attachedObjs[type],nodeObj->attachedObjs[!type]);
-            NL(node->attachedObjsAns[type],nodeObj->attachedObjs[!type]);
-            NL(node->attachedObjs[type],nodeObj->attachedObjsAns[!type]);
-            NL(node->attachedObjsAns[type],nodeObj->attachedObjsAns[!type]);
+            sink->NL(node->attachedObjs[type],nodeObj->attachedObjs[!type]);
+            sink->NL(node->attachedObjsAns[type],nodeObj->attachedObjs[!type]);
+            sink->NL(node->attachedObjs[type],nodeObj->attachedObjsAns[!type]);
+            sink->NL(node->attachedObjsAns[type],nodeObj->attachedObjsAns[!type]);
         }
         
-        ItemsMaxCompared += (node->attachedObjs[type].size()+node->attachedObjsAns[type].size())*
+        sink->ItemsMaxCompared += (node->attachedObjs[type].size()+node->attachedObjsAns[type].size())*
                             (nodeObj->attachedObjs[!type].size() + nodeObj->attachedObjsAns[!type].size());
         
         return;
     }
     for (int type = 0; type < TYPES; type++)
     {
-        
-        if (localJoin == algo_SGrid)
+        if (type == 0 && !nodeObj->chunks.empty())
         {
-            if (node->attachedObjs[type].size() > 0) node->spatialGridHash[type]->probe(nodeObj->attachedObjs[!type]);
-            if (node->attachedObjsAns[type].size() > 0) node->spatialGridHashAns[type]->probe(nodeObj->attachedObjs[!type]);
+            // the B objects of an overloaded ancestor: only the chunks near node
+            for (unsigned int c = 0; c < nodeObj->chunks.size(); c++)
+                if (FLAT::Box::overlap(nodeObj->chunkMbrs[c], node->mbr))
+                    JOINobjects(node,type,nodeObj->chunks[c],sink);
         }
         else
         {
-            NL(node->attachedObjs[type],nodeObj->attachedObjs[!type]);
-            NL(node->attachedObjsAns[type],nodeObj->attachedObjs[!type]);
+            JOINobjects(node,type,nodeObj->attachedObjs[!type],sink);
         }
-        ItemsMaxCompared += (node->attachedObjs[type].size()+node->attachedObjsAns[type].size())*
+        sink->ItemsMaxCompared += (node->attachedObjs[type].size()+node->attachedObjsAns[type].size())*
                             (nodeObj->attachedObjs[!type].size());
     }
 }
 
+/*
+ * The objects of node of the given type with objs of the other type
+ */
+void CommonTOUCH::JOINobjects(TreeNode* node, int type, SpatialObjectList& objs, JoinAlgorithm* sink)
+{
+    if (localJoin == algo_SGrid)
+    {
+        if (node->attachedObjs[type].size() > 0) node->spatialGridHash[type]->probe(objs);
+        if (node->attachedObjsAns[type].size() > 0) node->spatialGridHashAns[type]->probe(objs);
+    }
+    else
+    {
+        sink->NL(node->attachedObjs[type],objs);
+        sink->NL(node->attachedObjsAns[type],objs);
+    }
+}
+
 void CommonTOUCH::JOINdown(TreeNode* node, TreeNode* nodeObj)
 {
     int type;
@@ -287,10 +350,16 @@ void CommonTOUCH::JOINdown(TreeNode* node, TreeNode* nodeObj)
         
         if (localJoin == algo_SGrid)
         {
-            node->spatialGridHash[type]->probe(nodeObj->attachedObjs[!type]);
-            node->spatialGridHashAns[type]->probe(nodeObj->attachedObjs[!type]);
-            node->spatialGridHash[type]->probe(nodeObj->attachedObjsAns[!type]);
-            node->spatialGridHashAns[type]->probe(nodeObj->attachedObjsAns[!type]);
+            if (node->attachedObjs[type].size() > 0)
+            {
+                node->spatialGridHash[type]->probe(nodeObj->attachedObjs[!type]);
+                node->spatialGridHash[type]->probe(nodeObj->attachedObjsAns[!type]);
+            }
+            if (node->attachedObjsAns[type].size() > 0)
+            {
+                node->spatialGridHashAns[type]->probe(nodeObj->attachedObjs[!type]);
+                node->spatialGridHashAns[type]->probe(nodeObj->attachedObjsAns[!type]);
+            }
         }
         else
         {
@@ -310,8 +379,20 @@ void CommonTOUCH::JOINdown(TreeNode* node, TreeNode* nodeObj)
         
         if (localJoin == algo_SGrid)
         {
-            node->spatialGridHash[type]->probe(nodeObj->attachedObjs[!type]);
-            node->spatialGridHash[type]->probe(nodeObj->attachedObjsAns[!type]);
+            if (node->attachedObjs[type].size() > 0)
+            {
+                node->spatialGridHash[type]->probe(nodeObj->attachedObjs[!type]);
+                node->spatialGridHash[type]->probe(nodeObj->attachedObjsAns[!type]);
+            }
+        }
+        else if (type == 1 && !node->chunks.empty())
+        {
+            for (unsigned int c = 0; c < node->chunks.size(); c++)
+                if (FLAT::Box::overlap(node->chunkMbrs[c], nodeObj->mbr))
+                {
+                    NL(node->chunks[c],nodeObj->attachedObjs[!type]);
+                    NL(node->chunks[c],nodeObj->attachedObjsAns[!type]);
+                }
         }
         else
         {
@@ -331,13 +412,7 @@ void CommonTOUCH::pathWayJoin(TreeNode* node)
         pathWayJoin((*cit));
     }
    
-    if (localJoin == algo_SGrid) countSpatialGrid(node);
-    
-    for (NodeList::iterator ancit = probingList.begin(); ancit != probingList.end(); ancit++)
-    {
-        JOIN(node,(*ancit));
-    }
-    if (localJoin == algo_SGrid) deduplicateSpatialGrid(node);
+    pathWayJoinNode(node,probingList,this);
     probingList.pop_back();
 }
 
@@ -366,9 +441,13 @@ void CommonTOUCH::JoinDownRFilter(TreeNode* node, TreeNode* nodeObj)
 
 void CommonTOUCH::pathWayJoinDown(TreeNode* node)
 {
-    if (localJoin == algo_SGrid) countSpatialGrid(node);
-    JoinDownR(node, node);
-    if (localJoin == algo_SGrid) deduplicateSpatialGrid(node);
+    {
+        TRACE_SCOPE_ARG("join node","level",node->level);
+        NodeWork work(node,this);
+        if (localJoin == algo_SGrid) countSpatialGrid(node);
+        JoinDownR(node, node);
+        if (localJoin == algo_SGrid) deduplicateSpatialGrid(node);
+    }
     
     for (NodeList::iterator cit = node->entries.begin(); cit != node->entries.end(); cit++)
     {
@@ -378,9 +457,13 @@ void CommonTOUCH::pathWayJoinDown(TreeNode* node)
 
 void CommonTOUCH::pathWayJoinDownFilter(TreeNode* node)
 {
-    if (localJoin == algo_SGrid) countSpatialGrid(node);
-    JoinDownRFilter(node, node);
-    if (localJoin == algo_SGrid) deduplicateSpatialGrid(node);
+    {
+        TRACE_SCOPE_ARG("join node","level",node->level);
+        NodeWork work(node,this);
+        if (localJoin == algo_SGrid) countSpatialGrid(node);
+        JoinDownRFilter(node, node);
+        if (localJoin == algo_SGrid) deduplicateSpatialGrid(node);
+    }
     
     for (NodeList::iterator cit = node->entries.begin(); cit != node->entries.end(); cit++)
     {
@@ -393,6 +476,85 @@ void CommonTOUCH::probeDownUp()
     pathWayJoin(root);
 }
 
+/*
+ * One subtree of the parallel bottom-up traversal. The task owns a copy of
+ * the path from the root to its node, so no stack is shared between workers.
+ */
+class PathWayTask : public PoolTask
+{
+public:
+    CommonTOUCH* touch;
+    TreeNode* node;
+    NodeList path;
+
+    PathWayTask(CommonTOUCH* ntouch, TreeNode* nnode, const NodeList& ancestors)
+        : touch(ntouch), node(nnode), path(ancestors)
+    {
+        path.push_back(node);
+    }
+
+    void run(WorkStealingPool& pool, int worker)
+    {
+        for (NodeList::iterator cit = node->entries.begin(); cit != node->entries.end(); cit++)
+            pool.spawn(new PathWayTask(touch,(*cit),path),worker);
+        touch->pathWayJoinNode(node,path,touch->workerSinks[worker]);
+    }
+};
+
+/*
+ * Same joins as pathWayJoin, every subtree is a task for the pool.
+ * Every worker collects results and counters in its own JoinAlgorithm,
+ * which are added up at the end.
+ */
+void CommonTOUCH::probeDownUpParallel()
+{
+    for (int i = 0; i < threads; i++)
+    {
+        JoinAlgorithm* sink = new JoinAlgorithm();
+        sink->epsilon = epsilon;
+        sink->verbose = false;
+        sink->repA = 0;
+        sink->repB = 0;
+        sink->resultPairs.useMode(resultPairs);
+        workerSinks.push_back(sink);
+    }
+
+    WorkStealingPool pool(threads);
+    pool.run(new PathWayTask(this,root,NodeList()));
+
+    for (int i = 0; i < threads; i++)
+    {
+        JoinAlgorithm* sink = workerSinks[i];
+        resultPairs.results += sink->resultPairs.results;
+        resultPairs.duplicates += sink->resultPairs.duplicates;
+        resultPairs.objA.insert(resultPairs.objA.end(),sink->resultPairs.objA.begin(),sink->resultPairs.objA.end());
+        resultPairs.objB.insert(resultPairs.objB.end(),sink->resultPairs.objB.begin(),sink->resultPairs.objB.end());
+        resultPairs.deDuplicateTime.add(sink->resultPairs.deDuplicateTime);
+        ItemsCompared += sink->ItemsCompared;
+        ItemsMaxCompared += sink->ItemsMaxCompared;
+        repA += sink->repA;
+        repB += sink->repB;
+        initialize.add(sink->initialize);
+        gridCalculate.add(sink->gridCalculate);
+        delete sink;
+    }
+    workerSinks.clear();
+    if (verbose) std::cout << "Parallel BU on " << threads << " threads, " << pool.steals << " steals" << std::endl;
+}
+
+void CommonTOUCH::pathWayJoinNode(TreeNode* node, NodeList& path, JoinAlgorithm* sink)
+{
+    TRACE_SCOPE_ARG("join node","level",node->level);
+    NodeWork work(node,sink);
+    if (localJoin == algo_SGrid) countSpatialGrid(node,sink);
+    
+    for (NodeList::iterator ancit = path.begin(); ancit != path.end(); ancit++)
+    {
+        JOIN(node,(*ancit),sink);
+    }
+    if (localJoin == algo_SGrid) deduplicateSpatialGrid(node,sink);
+}
+
 void CommonTOUCH::probeUpDown()
 {
     pathWayJoinDown(root);
@@ -454,6 +616,7 @@ void CommonTOUCH::countSizeStatistics()
 
 void CommonTOUCH::countSpatialGrid()
 {
+    TRACE_SCOPE("grids");
     for (NodeList::iterator it = tree.begin(); it != tree.end(); it++)
     { 
         countSpatialGrid((*it));
@@ -461,14 +624,22 @@ void CommonTOUCH::countSpatialGrid()
 }
 
 void CommonTOUCH::countSpatialGrid(TreeNode* node)
+{
+    countSpatialGrid(node,this);
+}
+
+void CommonTOUCH::countSpatialGrid(TreeNode* node, JoinAlgorithm* sink)
 {   
-    gridCalculate.start();
+    sink->gridCalculate.start();
     FLAT::Box mbr;
     double resolution;
     double resolution3d[DIMENSION];
     for (int type = 0; type < TYPES; type++)
     {
         
+        node->mbrSelfD[type] = FLAT::Box();
+        for (SpatialObjectList::iterator it = node->attachedObjs[type].begin(); it != node->attachedObjs[type].end(); it++)
+            node->mbrSelfD[type] = FLAT::Box::combineSafe(node->mbrSelfD[type],(*it)->mbr);
         mbr = node->mbrSelfD[type];
         
         switch (SGResol)
@@ -527,15 +698,22 @@ void CommonTOUCH::countSpatialGrid(TreeNode* node)
                 
                 break;
         }
+        node->spatialGridHash[type]->resultPairs.useMode(resultPairs);
+        node->gridCells[type] = node->spatialGridHash[type]->cells().size();
 
     }
-    gridCalculate.stop();
+    sink->gridCalculate.stop();
 }
 
+/*
+ * The grids are probed by the objects of all ancestors, so their
+ * comparisons are counted at the node of the grid.
+ */
 void CommonTOUCH::deduplicateSpatialGrid()
 {
     for (NodeList::iterator it = tree.begin(); it != tree.end(); it++)
     {
+        NodeWork work((*it),this);
         deduplicateSpatialGrid((*it));
     }
     
@@ -543,12 +721,17 @@ void CommonTOUCH::deduplicateSpatialGrid()
 }
 
 void CommonTOUCH::deduplicateSpatialGrid(TreeNode* node)
+{
+    deduplicateSpatialGrid(node,this);
+}
+
+void CommonTOUCH::deduplicateSpatialGrid(TreeNode* node, JoinAlgorithm* sink)
 {
     for (int type = 0; type < TYPES; type++)
     {
         node->spatialGridHash[type]->resultPairs.deDuplicate();
         
-        SpatialGridHash::transferInfo(node->spatialGridHash[type], this);
+        SpatialGridHash::transferInfo(node->spatialGridHash[type], sink);
    
     }
 }
@@ -593,6 +776,7 @@ void CommonTOUCH::writeNode(NodeList& nodelist, int Level)
 
 void CommonTOUCH::createPartitions(SpatialObjectList& vds)
 {
+    TRACE_SCOPE("partition");
     partition.start();
 
     Levels = 1;
@@ -620,6 +804,8 @@ void CommonTOUCH::createPartitions(SpatialObjectList& vds)
 
 void CommonTOUCH::createTreeLevel(SpatialObjectList& input)
 {
+    TRACE_SCOPE_ARG("tree level","level",0);
+    TRACE_SPAN(sortSpan,"sort",NULL,0);
     sorting.start();
 //    for (int i = 0; i < input.size(); i++)
 //    {
@@ -638,6 +824,7 @@ void CommonTOUCH::createTreeLevel(SpatialObjectList& input)
             break;
     }
     sorting.stop();
+    TRACE_STOP(sortSpan);
 
     if (verbose) std::cout << "Sort "<< input.size()<< " leaf objects in " << sorting << std::endl;
     
@@ -660,7 +847,8 @@ void CommonTOUCH::createTreeLevel(SpatialObjectList& input)
 
 void CommonTOUCH::createTreeLevel(NodeList& input, int Level)
 {
-    
+    TRACE_SCOPE_ARG("tree level","level",Level);
+    TRACE_SPAN(sortSpan,"sort",NULL,0);
     sorting.start();
     switch (PartitioningType)
     {
@@ -674,6 +862,7 @@ void CommonTOUCH::createTreeLevel(NodeList& input, int Level)
             break;
     }
     sorting.stop();
+    TRACE_STOP(sortSpan);
 
     if (verbose) std::cout << "Sort "<< input.size()<< " items in " << sorting << std::endl;
     
@@ -696,8 +885,365 @@ void CommonTOUCH::createTreeLevel(NodeList& input, int Level)
 
 
 
+/*
+ * Descend from the root while obj overlaps exactly one child.
+ * Returns the node obj belongs to, or NULL if it overlaps no leaf.
+ * The tree is not modified.
+ */
+TreeNode* CommonTOUCH::findAssignment(TreeEntry* obj)
+{
+    bool overlaps;
+    TreeNode* nextNode;
+    TreeNode* ptr = root;
+
+    nextNode = NULL;        
+    
+    if ( FLAT::Box::overlap(obj->mbr,root->mbrL[0]) && root->entries.size() == 0)
+        return root;
+
+    while(true)
+    {
+        overlaps = false;
+        for (NodeList::iterator it = ptr->entries.begin(); it != ptr->entries.end(); it++)
+        {    
+            if ( FLAT::Box::overlap(obj->mbr,(*it)->mbr) )
+            {
+                if(!overlaps)
+                {
+                    overlaps = true;
+                    nextNode = (*it);
+                }
+                else
+                {
+                    // assignment to current level
+                    return ptr;
+                }
+            }
+        }
+        if(!overlaps)
+            return NULL;
+        ptr = nextNode;
+        if(ptr->leafnode)
+            return ptr;
+    }
+}
+
+/*
+ * The probe below an assigned node: collect the leaves below node that
+ * overlap mbr, descending only into overlapping children (node itself is
+ * not tested). nodes is the work queue of the caller, empty on return. The
+ * A objects below the skipped children are added to skippedA if given.
+ * The tree is not modified.
+ */
+void CommonTOUCH::leavesBelow(TreeNode* node, const FLAT::Box& mbr, std::queue<TreeNode*>& nodes,
+                              NodeList& leaves, FLAT::uint64* skippedA)
+{
+    nodes.push(node);
+    while (nodes.size()>0)
+    {
+        node = nodes.front();
+        nodes.pop();
+        if (node->leafnode)
+        {
+            leaves.push_back(node);
+            continue;
+        }
+        for (NodeList::iterator it = node->entries.begin(); it != node->entries.end(); it++)
+        {
+            if (FLAT::Box::overlap(mbr,(*it)->mbr))
+                nodes.push((*it));
+            else if (skippedA != NULL)
+                *skippedA += (*it)->objBelow[0];
+        }
+    }
+}
+
+/*
+ * Tree over A for the join: mapped from loadIndexFile if possible, otherwise
+ * read from file_dsA and partitioned (and saved to saveIndexFile if given).
+ */
+void CommonTOUCH::loadOrBuildA()
+{
+    if (!loadIndexFile.empty())
+    {
+        if (verbose) std::cout << "Loading the tree of A from " << loadIndexFile << std::endl;
+        if (loadIndex(loadIndexFile))
+            return;
+        std::cout << "Building the tree of A from " << file_dsA << " instead" << std::endl;
+    }
+    readBinaryInputA(file_dsA);
+    if (verbose) std::cout << "Forming the partitions" << std::endl; 
+    createPartitions(vdsA);
+    if (!saveIndexFile.empty())
+    {
+        total.stop();           // writing the index is not part of the join
+        saveIndex(saveIndexFile);
+        total.start();
+    }
+}
+
+bool CommonTOUCH::saveIndex(std::string indexFile)
+{
+    TRACE_SCOPE("save index");
+    if (tree.empty() || dsA.empty())
+    {
+        std::cout << "No tree over A to save" << std::endl;
+        return false;
+    }
+
+    TreeFileHeader header;
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,TREEFILE_MAGIC,sizeof(header.magic));
+    header.version          = TREEFILE_VERSION;
+    header.spaceUnitSize    = sizeof(FLAT::spaceUnit);
+    header.epsilon          = epsilon;
+    header.leafsize         = leafsize;
+    header.nodesize         = nodesize;
+    header.partitioningType = PartitioningType;
+    header.levels           = Levels;
+    header.objectType       = dsA.front()->obj->getType();
+    header.objectByteSize   = dsA.front()->obj->getSize();
+    strncpy(header.source,file_dsA.c_str(),sizeof(header.source)-1);
+
+    thrust::host_vector<TreeFileNode> nodes(tree.size());
+    thrust::host_vector<FLAT::uint64> children;
+    SpatialObjectList entries;
+    for (unsigned int i = 0; i < tree.size(); i++)
+    {
+        TreeNode* node = tree[i];
+        TreeFileNode& n = nodes[i];
+        for (int d = 0; d < DIMENSION; d++)
+        {
+            n.low[d] = node->mbr.low.Vector[d];
+            n.high[d] = node->mbr.high.Vector[d];
+        }
+        n.level = node->level;
+        n.leaf = node->leafnode;
+        n.firstChild = children.size();
+        n.children = node->entries.size();
+        for (NodeList::iterator it = node->entries.begin(); it != node->entries.end(); it++)
+            children.push_back((*it)->id);
+        n.firstEntry = entries.size();
+        n.entries = node->attachedObjs[0].size();
+        for (SpatialObjectList::iterator it = node->attachedObjs[0].begin(); it != node->attachedObjs[0].end(); it++)
+            entries.push_back(*it);
+    }
+
+    header.nodeCount        = nodes.size();
+    header.childCount       = children.size();
+    header.entryCount       = entries.size();
+    header.rootId           = root->id;
+    for (int d = 0; d < DIMENSION; d++)
+    {
+        header.universeLow[d] = universeA.low.Vector[d];
+        header.universeHigh[d] = universeA.high.Vector[d];
+    }
+    header.nodeOffset       = sizeof(TreeFileHeader);
+    header.childOffset      = header.nodeOffset + header.nodeCount*sizeof(TreeFileNode);
+    header.entryOffset      = header.childOffset + header.childCount*sizeof(FLAT::uint64);
+    header.objectOffset     = header.entryOffset + header.entryCount*sizeof(TreeFileEntry);
+
+    std::ofstream fout(indexFile.c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
+    fout.write((const char*)&header,sizeof(header));
+    fout.write((const char*)&nodes[0],nodes.size()*sizeof(TreeFileNode));
+    if (!children.empty())
+        fout.write((const char*)&children[0],children.size()*sizeof(FLAT::uint64));
+
+    TreeFileEntry entry;
+    memset(&entry,0,sizeof(entry));
+    for (SpatialObjectList::iterator it = entries.begin(); it != entries.end(); it++)
+    {
+        for (int d = 0; d < DIMENSION; d++)
+        {
+            entry.low[d] = (*it)->mbr.low.Vector[d];
+            entry.high[d] = (*it)->mbr.high.Vector[d];
+        }
+        entry.id = (*it)->id;
+        fout.write((const char*)&entry,sizeof(entry));
+    }
+
+    FLAT::int8* buffer = new FLAT::int8[header.objectByteSize];
+    for (SpatialObjectList::iterator it = entries.begin(); it != entries.end(); it++)
+    {
+        (*it)->obj->serialize(buffer);
+        fout.write(buffer,header.objectByteSize);
+    }
+    delete[] buffer;
+
+    fout.close();
+    if (fout.fail())
+    {
+        std::cout << "Cannot write index file " << indexFile << std::endl;
+        return false;
+    }
+    if (verbose)
+        std::cout << "Saved the tree of A (" << header.nodeCount << " nodes, " << header.entryCount
+                  << " objects) to " << indexFile << std::endl;
+    return true;
+}
+
+/*
+ * Replaces reading and partitioning A. The parameters the tree was built with
+ * (leaf size, fanout, sorting) are taken from the file, epsilon has to match
+ * since the stored MBRs are expanded by it. Returns false if the file cannot
+ * be used; nothing is changed in that case.
+ */
+bool CommonTOUCH::loadIndex(std::string indexFile)
+{
+    TRACE_SCOPE("load index");
+    int fd = open(indexFile.c_str(),O_RDONLY);
+    if (fd == -1)
+    {
+        std::cout << "Cannot open index file " << indexFile << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd,&st) == -1 || (FLAT::uint64)st.st_size < sizeof(TreeFileHeader))
+    {
+        std::cout << "Index file " << indexFile << " is too small" << std::endl;
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        std::cout << "Cannot map index file " << indexFile << std::endl;
+        return false;
+    }
+
+    FLAT::int8* base = (FLAT::int8*)mapped;
+    const TreeFileHeader* header = (const TreeFileHeader*)base;
+    const TreeFileNode* nodes = (const TreeFileNode*)(base + header->nodeOffset);
+    const FLAT::uint64* children = (const FLAT::uint64*)(base + header->childOffset);
+    const TreeFileEntry* entries = (const TreeFileEntry*)(base + header->entryOffset);
+
+    std::string problem;
+    if (memcmp(header->magic,TREEFILE_MAGIC,sizeof(header->magic)) != 0)
+        problem = "not a TOUCH index";
+    else if (header->version != TREEFILE_VERSION)
+        problem = "unsupported format version";
+    else if (header->spaceUnitSize != sizeof(FLAT::spaceUnit))
+        problem = "written with a different coordinate type";
+    else if (header->epsilon != epsilon)
+        problem = "built for a different epsilon";
+    else if (header->objectByteSize != FLAT::SpatialObjectFactory::getSize((FLAT::SpatialObjectType)header->objectType))
+        problem = "unknown object type";
+    else if (header->nodeCount == 0 || header->rootId >= header->nodeCount
+             || header->nodeOffset != sizeof(TreeFileHeader)
+             || header->childOffset != header->nodeOffset + header->nodeCount*sizeof(TreeFileNode)
+             || header->entryOffset != header->childOffset + header->childCount*sizeof(FLAT::uint64)
+             || header->objectOffset != header->entryOffset + header->entryCount*sizeof(TreeFileEntry)
+             || header->objectOffset + header->entryCount*header->objectByteSize != (FLAT::uint64)st.st_size)
+        problem = "truncated or corrupt";
+    else
+        for (FLAT::uint64 i = 0; i < header->nodeCount && problem.empty(); i++)
+        {
+            if (nodes[i].firstChild + nodes[i].children > header->childCount
+                || nodes[i].firstEntry + nodes[i].entries > header->entryCount)
+                problem = "truncated or corrupt";
+            for (FLAT::uint64 c = 0; c < nodes[i].children && problem.empty(); c++)
+                if (children[nodes[i].firstChild+c] >= header->nodeCount)
+                    problem = "truncated or corrupt";
+        }
+    if (!problem.empty())
+    {
+        std::cout << "Index file " << indexFile << " not used: " << problem << std::endl;
+        munmap(mapped,st.st_size);
+        return false;
+    }
+
+    if (verbose && (header->leafsize != leafsize || header->nodesize != nodesize
+                    || header->partitioningType != PartitioningType))
+        std::cout << "Using leaf size " << header->leafsize << " fanout " << header->nodesize
+                  << " sorting " << header->partitioningType << " of the index" << std::endl;
+
+    dataLoad.start();
+
+    leafsize            = header->leafsize;
+    nodesize            = header->nodesize;
+    PartitioningType    = header->partitioningType;
+    Levels              = header->levels;
+    file_dsA            = std::string(header->source,strnlen(header->source,sizeof(header->source)));
+    size_dsA            = header->entryCount;
+
+    FLAT::Box mbr;
+    mbr.isEmpty = false;
+    TreeEntry* newEntry;
+    FLAT::SpatialObject* sobj;
+    FLAT::int8* objects = base + header->objectOffset;
+    if (loadedA)
+    {
+        // the datasets are shared with other runs: A is replaced, not appended to,
+        // vdsAll keeps the shared entries of B (the loaders fill dsB, not vdsB)
+        dsA.clear();
+        vdsA.clear();
+        vdsAll = dsB;
+        ownsEntriesA = true;
+    }
+    dsA.reserve(size_dsA);
+    vdsA.reserve(size_dsA);
+    for (FLAT::uint64 e = 0; e < header->entryCount; e++)
+    {
+        for (int d = 0; d < DIMENSION; d++)
+        {
+            mbr.low.Vector[d] = entries[e].low[d];
+            mbr.high.Vector[d] = entries[e].high[d];
+        }
+        sobj = FLAT::SpatialObjectFactory::create((FLAT::SpatialObjectType)header->objectType);
+        sobj->unserialize(objects + e*header->objectByteSize);
+        newEntry = new TreeEntry(sobj,0,entries[e].id,mbr);
+        vdsA.push_back(newEntry);
+        dsA.push_back(newEntry);
+        vdsAll.push_back(newEntry);
+    }
+
+    totalnodes = header->nodeCount;
+    tree.reserve(header->nodeCount);
+    for (FLAT::uint64 i = 0; i < header->nodeCount; i++)
+    {
+        TreeNode* node = new TreeNode(nodes[i].level);
+        for (int d = 0; d < DIMENSION; d++)
+        {
+            mbr.low.Vector[d] = nodes[i].low[d];
+            mbr.high.Vector[d] = nodes[i].high[d];
+        }
+        node->mbr = mbr;
+        node->mbrL[0] = mbr;
+        node->mbrL[1] = mbr;
+        node->leafnode = nodes[i].leaf;
+        node->id = i;
+        for (FLAT::uint64 e = 0; e < nodes[i].entries; e++)
+            node->attachedObjs[0].push_back(dsA[nodes[i].firstEntry+e]);
+        tree.push_back(node);
+    }
+    for (FLAT::uint64 i = 0; i < header->nodeCount; i++)
+        for (FLAT::uint64 c = 0; c < nodes[i].children; c++)
+            tree[i]->entries.push_back(tree[children[nodes[i].firstChild+c]]);
+
+    root = tree[header->rootId];
+    root->root = true;
+
+    for (int d = 0; d < DIMENSION; d++)
+    {
+        universeA.low.Vector[d] = header->universeLow[d];
+        universeA.high.Vector[d] = header->universeHigh[d];
+    }
+    universeA.isEmpty = false;
+
+    munmap(mapped,st.st_size);
+    dataLoad.stop();
+    initDegrees();
+
+    if (verbose)
+        std::cout << "Loaded the tree of A (" << tree.size() << " nodes, " << size_dsA
+                  << " objects, " << Levels << " levels) in " << dataLoad << std::endl;
+    return true;
+}
+
 void CommonTOUCH::analyze()
 {
+    TRACE_SCOPE("analyze");
     countSizeStatistics(); // must be before analysis to count average sizes
 
     analyzing.start();
@@ -789,4 +1335,163 @@ void CommonTOUCH::countObjBelowStart()
     {
         countObjBelow(root, i);
     }
-}
\ No newline at end of file
+}
+/*
+ * After the assignment and countObjBelowStart: the work of a node is taken
+ * as its B objects times the A objects in its subtree. Nodes with more than
+ * skewFactor times the median of the nodes with work get their B objects
+ * sorted along the Hilbert curve and cut into chunks of about skewChunk.
+ * The median, as the few overloaded nodes drive the mean up to their level.
+ */
+void CommonTOUCH::splitOverloaded()
+{
+    TRACE_SCOPE("split overloaded");
+    analyzing.start();
+    overloadedNodes = 0;
+    chunkCount = 0;
+    
+    std::vector<double> work(tree.size(),0);
+    std::vector<double> working;
+    for (unsigned int i = 0; i < tree.size(); i++)
+    {
+        TreeNode* node = tree[i];
+        node->chunks.clear();
+        node->chunkMbrs.clear();
+        work[i] = (double)node->attachedObjs[1].size() *
+                (node->objBelow[0] + node->attachedObjs[0].size() + node->attachedObjsAns[0].size());
+        if (work[i] > 0) working.push_back(work[i]);
+    }
+    if (skewFactor <= 0 || working.empty() || skewChunk == 0)
+    {
+        analyzing.stop();
+        return;
+    }
+    
+    std::nth_element(working.begin(),working.begin()+working.size()/2,working.end());
+    double median = working[working.size()/2];
+    for (unsigned int i = 0; i < tree.size(); i++)
+    {
+        TreeNode* node = tree[i];
+        if (work[i] <= skewFactor*median || node->attachedObjs[1].size() <= skewChunk)
+            continue;
+        
+        SpatialObjectList sorted = node->attachedObjs[1];
+        std::sort(sorted.begin(),sorted.end(),ComparatorHilbertEntryAsc());
+        unsigned int parts = (sorted.size() + skewChunk - 1)/skewChunk;
+        node->chunks.resize(parts);
+        node->chunkMbrs.resize(parts);
+        for (unsigned int c = 0; c < parts; c++)
+        {
+            FLAT::Box mbr;
+            for (FLAT::uint64 j = sorted.size()*c/parts; j < sorted.size()*(c+1)/parts; j++)
+            {
+                node->chunks[c].push_back(sorted[j]);
+                mbr = FLAT::Box::combineSafe(sorted[j]->mbr,mbr);
+            }
+            node->chunkMbrs[c] = mbr;
+        }
+        overloadedNodes++;
+        chunkCount += parts;
+    }
+    analyzing.stop();
+    
+    if (verbose) std::cout << "Overloaded nodes " << overloadedNodes << " split into "
+            << chunkCount << " chunks" << std::endl;
+}
+
+/*
+ * Work per tree level and node, and its distribution over the nodes
+ */
+void CommonTOUCH::writeMetrics(std::ostream& out)
+{
+    int levels = 0;
+    for (NodeList::iterator it = tree.begin(); it != tree.end(); it++)
+        levels = max(levels,(*it)->level+1);
+    
+    std::vector<FLAT::uint64> attached[TYPES];
+    std::vector<FLAT::uint64> compared, results, micros;
+    
+    out << ",\n\"nodes\":[";
+    for (NodeList::iterator it = tree.begin(); it != tree.end(); it++)
+    {
+        TreeNode* node = *it;
+        for (int type = 0; type < TYPES; type++)
+            attached[type].push_back(node->attachedObjs[type].size() + node->attachedObjsAns[type].size());
+        compared.push_back(node->compared);
+        results.push_back(node->results);
+        micros.push_back(node->joinTime/1000);
+        
+        out << (it == tree.begin() ? "\n" : ",\n")
+            << "{\"id\":" << node->id << ",\"level\":" << node->level
+            << ",\"attached\":[" << attached[0].back() << "," << attached[1].back() << "]"
+            << ",\"compared\":" << node->compared << ",\"results\":" << node->results
+            << ",\"seconds\":" << node->joinTime/1e9
+            << ",\"gridCells\":[" << node->gridCells[0] << "," << node->gridCells[1] << "]"
+            << ",\"chunks\":" << node->chunks.size() << "}";
+    }
+    out << "],\n\"levels\":[";
+    for (int level = 0; level < levels; level++)
+    {
+        FLAT::uint64 nodes = 0, levelCompared = 0, levelResults = 0, cells[TYPES] = {0,0};
+        FLAT::uint64 objects[TYPES] = {0,0}, maxObjects[TYPES] = {0,0};
+        double seconds = 0;
+        for (unsigned int i = 0; i < tree.size(); i++)
+        {
+            if (tree[i]->level != level) continue;
+            nodes++;
+            for (int type = 0; type < TYPES; type++)
+            {
+                objects[type] += attached[type][i];
+                maxObjects[type] = max(maxObjects[type],attached[type][i]);
+                cells[type] += tree[i]->gridCells[type];
+            }
+            levelCompared += tree[i]->compared;
+            levelResults += tree[i]->results;
+            seconds += tree[i]->joinTime/1e9;
+        }
+        out << (level == 0 ? "\n" : ",\n")
+            << "{\"level\":" << level << ",\"nodes\":" << nodes
+            << ",\"attached\":[" << objects[0] << "," << objects[1] << "]"
+            << ",\"maxAttached\":[" << maxObjects[0] << "," << maxObjects[1] << "]"
+            << ",\"compared\":" << levelCompared << ",\"results\":" << levelResults
+            << ",\"seconds\":" << seconds
+            << ",\"gridCells\":[" << cells[0] << "," << cells[1] << "]}";
+    }
+    out << "],\n\"histograms\":{\"attached A\":";
+    writeHistogram(out,attached[0]);
+    out << ",\n\"attached B\":";
+    writeHistogram(out,attached[1]);
+    out << ",\n\"compared\":";
+    writeHistogram(out,compared);
+    out << ",\n\"results\":";
+    writeHistogram(out,results);
+    out << ",\n\"microseconds\":";
+    writeHistogram(out,micros);
+    out << "}";
+}
+
+/*
+ * The nodes with their lists, and the grids of the nodes that are kept
+ * until the end (TD with the grids of all nodes, BU, TDD and TDF)
+ */
+void CommonTOUCH::countMemory()
+{
+    FLAT::uint64 grids = 0;
+    memNodes = tree.capacity()*sizeof(TreeNode*);
+    for (NodeList::iterator it = tree.begin(); it != tree.end(); it++)
+    {
+        TreeNode* node = *it;
+        memNodes += sizeof(TreeNode) + node->entries.capacity()*sizeof(TreeNode*);
+        for (int type = 0; type < TYPES; type++)
+        {
+            memNodes += (node->attachedObjs[type].capacity() + node->attachedObjsAns[type].capacity())*sizeof(TreeEntry*);
+            if (node->spatialGridHash[type] != NULL) grids += node->spatialGridHash[type]->gridBytes();
+            if (node->spatialGridHashAns[type] != NULL) grids += node->spatialGridHashAns[type]->gridBytes();
+        }
+        for (unsigned int c = 0; c < node->chunks.size(); c++)
+            memNodes += node->chunks[c].capacity()*sizeof(TreeEntry*) + sizeof(FLAT::Box);
+    }
+    memGrids = std::max(memGrids,grids);
+    JoinAlgorithm::countMemory();
+}
+
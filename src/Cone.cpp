@@ -171,9 +171,53 @@ namespace FLAT
 		return ((DIMENSION*2)+2)*sizeof(spaceUnit);
 	}
 
+	// distance of (x,y) to the segment from (x1,y1) to (x2,y2) in a plane
+	static bigSpaceUnit planeSegmentDistance(bigSpaceUnit x,bigSpaceUnit y,bigSpaceUnit x1,bigSpaceUnit y1,bigSpaceUnit x2,bigSpaceUnit y2)
+	{
+		bigSpaceUnit dx = x2-x1, dy = y2-y1;
+		bigSpaceUnit length = dx*dx+dy*dy;
+		bigSpaceUnit t = length>0 ? ((x-x1)*dx+(y-y1)*dy)/length : 0;
+		if (t<0) t = 0;
+		if (t>1) t = 1;
+		bigSpaceUnit ex = x1+t*dx-x, ey = y1+t*dy-y;
+		return sqrt(ex*ex+ey*ey);
+	}
+
+	/*
+	 * Distance to the solid frustum, 0 inside it. In the plane through the axis
+	 * and p the frustum is the trapezoid (0,0) (0,rb) (L,re) (L,0): p sits at x
+	 * along the axis and y away from it, and outside the trapezoid the nearest
+	 * point is on one of the caps or on the side.
+	 */
 	bigSpaceUnit Cone::pointDistance(Vertex& p)
 	{
-		std::cout << "ERROR: pointDistance method is not overloaded with this geometry: CONE" << std::endl;
-		return 0;
+		bigSpaceUnit axis2 = 0, along = 0, toP2 = 0;
+		for (int i=0;i<DIMENSION;i++)
+		{
+			bigSpaceUnit a = end[i]-begin[i];
+			bigSpaceUnit d = p[i]-begin[i];
+			axis2 += a*a;
+			along += a*d;
+			toP2  += d*d;
+		}
+		bigSpaceUnit rb = radiusBegin, re = radiusEnd;
+		if (axis2==0)
+		{
+			bigSpaceUnit d = sqrt(toP2) - (rb>re ? rb : re);
+			return d>0 ? d : 0;
+		}
+
+		bigSpaceUnit length = sqrt(axis2);
+		bigSpaceUnit x = along/length;
+		bigSpaceUnit y2 = toP2-x*x;
+		bigSpaceUnit y = y2>0 ? sqrt(y2) : 0;
+		if (x>=0 && x<=length && y<=rb+(re-rb)*x/length) return 0;
+
+		bigSpaceUnit d = planeSegmentDistance(x,y,0,0,0,rb);
+		bigSpaceUnit side = planeSegmentDistance(x,y,0,rb,length,re);
+		bigSpaceUnit cap  = planeSegmentDistance(x,y,length,0,length,re);
+		if (side<d) d = side;
+		if (cap<d) d = cap;
+		return d;
 	}
 }
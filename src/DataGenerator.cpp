@@ -0,0 +1,309 @@
+#include "DataGenerator.hpp"
+#include "Segment.hpp"
+#include "Cone.hpp"
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+namespace FLAT
+{
+	// random numbers of one chunk
+	class DataGenerator::Chunk
+	{
+	public:
+		boost::mt11213b generator;
+
+		Chunk(uint32 seed) : generator(seed) {}
+
+		double uniform(double low, double high)
+		{
+			boost::uniform_real<> uni_dist (low,high);
+			boost::variate_generator<boost::mt11213b &,boost::uniform_real<> > uni(generator, uni_dist);
+			return uni();
+		}
+
+		double normal(double mean, double deviation)
+		{
+			boost::normal_distribution<> norm_dist (mean,deviation);
+			boost::variate_generator<boost::mt11213b &,boost::normal_distribution<> > norm(generator, norm_dist);
+			return norm();
+		}
+
+		double exponential(double mean)
+		{
+			boost::exponential_distribution<> exp_dist (1.0/mean);
+			boost::variate_generator<boost::mt11213b &,boost::exponential_distribution<> > exp(generator, exp_dist);
+			return exp();
+		}
+	};
+
+	// one generating thread, mbr of the objects it generated
+	class DataGenerator::Task
+	{
+	public:
+		DataGenerator* generator;
+		pthread_t thread;
+		Box mbr;
+	};
+
+	DataGenerator::DataGenerator(uint32 seed)
+	{
+		this->seed = seed;
+		universe.low  = Vertex(0,0,0);
+		universe.high = Vertex(1000,1000,1000);
+		universe.isEmpty = false;
+		objectType       = BOX;
+		sizeDistribution = SIZE_UNIFORM;
+		minSize     = 1;
+		maxSize     = 10;
+		minRadius   = 0.1;
+		maxRadius   = 1;
+		clusters    = 10;
+		sigma       = 0.02;
+		normalSigma = 0.25;
+		clusterSeed = 1;
+		skew        = 4;
+		threads     = 1;
+		chunkSize   = 65536;
+	}
+
+	double DataGenerator::objectSize(Chunk& random)
+	{
+		double size;
+		switch (sizeDistribution)
+		{
+		case SIZE_CONSTANT:
+			return maxSize;
+		case SIZE_NORMAL:
+			size = random.normal((minSize+maxSize)/2,(maxSize-minSize)/6);
+			break;
+		case SIZE_EXPONENTIAL:
+			size = minSize + ((maxSize > minSize) ? random.exponential((maxSize-minSize)/10) : 0);
+			break;
+		default:
+			return random.uniform(minSize,maxSize);
+		}
+		if (size<minSize) size = minSize;
+		if (size>maxSize) size = maxSize;
+		return size;
+	}
+
+	/*
+	 * Serialize the object with the given id into buffer and add its MBR to mbr
+	 */
+	void DataGenerator::makeObject(Chunk& random, uint64 id, int8* buffer, Box& mbr)
+	{
+		Vertex center;
+		uint32 cluster = (distribution==CLUSTERED) ? (uint32)random.uniform(0,clusters) % clusters : 0;
+		for (int i=0;i<DIMENSION;i++)
+		{
+			double width = universe.high[i]-universe.low[i];
+			switch (distribution)
+			{
+			case CLUSTERED:
+				center[i] = random.normal(centers[cluster][i],sigma*width);
+				break;
+			case NORMAL:
+				center[i] = random.normal(universe.low[i]+width/2,normalSigma*width);
+				break;
+			case SKEWED:
+				center[i] = universe.low[i] + width*pow(random.uniform(0,1),skew);
+				break;
+			default:
+				center[i] = random.uniform(universe.low[i],universe.high[i]);
+				break;
+			}
+			// keep the object inside of the universe
+			if (center[i]<universe.low[i])  center[i] = universe.low[i];
+			if (center[i]>universe.high[i]) center[i] = universe.high[i];
+		}
+
+		switch (objectType)
+		{
+		case VERTEX:
+			center.serialize(buffer);
+			mbr = Box::combineSafe(mbr,center.getMBR());
+			break;
+		case SEGMENT:
+		case CONE:
+		{
+			// elongated: random direction, length from the size distribution
+			Vertex direction;
+			double norm = 0;
+			while (norm == 0)
+			{
+				for (int i=0;i<DIMENSION;i++)
+				{
+					direction[i] = random.normal(0,1);
+					norm += direction[i]*direction[i];
+				}
+				norm = sqrt(norm);
+			}
+			double half = objectSize(random)/2;
+			Vertex begin,end;
+			for (int i=0;i<DIMENSION;i++)
+			{
+				begin[i] = center[i] - direction[i]/norm*half;
+				end[i]   = center[i] + direction[i]/norm*half;
+			}
+			spaceUnit r1 = random.uniform(minRadius,maxRadius);
+			spaceUnit r2 = random.uniform(minRadius,maxRadius);
+			Box objectMBR;
+			if (objectType == SEGMENT)
+			{
+				Segment segment(begin,end,r1,r2,(uint32)(id>>32),0,(uint32)id);
+				segment.serialize(buffer);
+				objectMBR = segment.getMBR();
+			}
+			else
+			{
+				Cone cone(begin,end,r1,r2);
+				cone.serialize(buffer);
+				objectMBR = cone.getMBR();
+			}
+			// Box::combine leaves isEmpty as it is
+			objectMBR.isEmpty = false;
+			mbr = Box::combineSafe(mbr,objectMBR);
+			break;
+		}
+		default:
+		{
+			Box box;
+			box.isEmpty = false;
+			for (int i=0;i<DIMENSION;i++)
+			{
+				double half = objectSize(random)/2;
+				box.low[i]  = center[i]-half;
+				box.high[i] = center[i]+half;
+			}
+			box.serialize(buffer);
+			mbr = Box::combineSafe(mbr,box);
+			break;
+		}
+		}
+	}
+
+	void DataGenerator::generateChunk(uint64 chunk, int8* buffer, Box& mbr)
+	{
+		Chunk random(seed + (uint32)(chunk+1)*2654435761u);
+		uint64 first = chunk*chunkSize;
+		uint64 last = std::min(first+chunkSize,count);
+		for (uint64 id=first;id<last;id++)
+			makeObject(random,id,buffer+(id-first)*objectByteSize,mbr);
+
+		uint64 bytes = (last-first)*objectByteSize;
+		uint64 written = 0;
+		while (written < bytes)
+		{
+			ssize_t done = pwrite(file,buffer+written,bytes-written,first*objectByteSize+written);
+			if (done <= 0)
+			{
+				failed = true;
+				return;
+			}
+			written += done;
+		}
+	}
+
+	void* DataGenerator::worker(void* arg)
+	{
+		Task* task = (Task*)arg;
+		DataGenerator* gen = task->generator;
+		uint64 chunks = (gen->count+gen->chunkSize-1)/gen->chunkSize;
+		int8* buffer = new int8[gen->chunkSize*gen->objectByteSize];
+		uint64 chunk;
+		while (!gen->failed && (chunk = __sync_fetch_and_add(&gen->nextChunk,1)) < chunks)
+			gen->generateChunk(chunk,buffer,task->mbr);
+		delete[] buffer;
+		return NULL;
+	}
+
+	bool DataGenerator::generate(DataDistribution distribution, uint64 count, string fileName)
+	{
+		this->distribution = distribution;
+		this->count = count;
+		objectByteSize = SpatialObjectFactory::getSize(objectType);
+		if (chunkSize == 0) chunkSize = 1;
+		nextChunk = 0;
+		failed = false;
+
+		// the cluster centers do not depend on the dataset seed
+		centers.clear();
+		if (distribution==CLUSTERED)
+		{
+			Chunk random(clusterSeed);
+			for (uint32 c=0;c<clusters;c++)
+			{
+				Vertex center;
+				for (int i=0;i<DIMENSION;i++)
+					center[i] = random.uniform(universe.low[i],universe.high[i]);
+				centers.push_back(center);
+			}
+		}
+
+		file = open(fileName.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if (file == -1)
+		{
+			std::cout << "Cannot create OutputFile " << fileName << std::endl;
+			return false;
+		}
+
+		int nthreads = (threads < 1) ? 1 : threads;
+		std::vector<Task> tasks(nthreads);
+		for (int t=0;t<nthreads;t++)
+		{
+			tasks[t].generator = this;
+			tasks[t].mbr.isEmpty = true;
+			pthread_create(&tasks[t].thread,NULL,worker,&tasks[t]);
+		}
+		Box mbr;
+		mbr.isEmpty = true;
+		for (int t=0;t<nthreads;t++)
+		{
+			pthread_join(tasks[t].thread,NULL);
+			mbr = Box::combineSafe(mbr,tasks[t].mbr);
+		}
+
+		// header at the end (type, count, byte size, universe), where DataFileReader looks for it
+		int8 header[RAW_DATA_HEADER_SIZE];
+		uint32 type = objectType;
+		memcpy(header,&type,sizeof(uint32));
+		memcpy(header+4,&count,sizeof(uint64));
+		memcpy(header+12,&objectByteSize,sizeof(uint32));
+		mbr.serialize(header+16);
+		if (pwrite(file,header,RAW_DATA_HEADER_SIZE,count*objectByteSize) != RAW_DATA_HEADER_SIZE)
+			failed = true;
+		close(file);
+
+		if (failed)
+			std::cout << "Problem writing to OutputFile " << fileName << std::endl;
+		return !failed;
+	}
+
+	string DataGenerator::getTitle(DataDistribution distribution)
+	{
+		switch (distribution)
+		{
+		case UNIFORM:   return "Uniform";
+		case CLUSTERED: return "Clustered";
+		case SKEWED:    return "Skewed";
+		case NORMAL:    return "Normal";
+		default:        return "Undefined";
+		}
+	}
+
+	string DataGenerator::getTitle(SizeDistribution distribution)
+	{
+		switch (distribution)
+		{
+		case SIZE_CONSTANT:    return "Constant";
+		case SIZE_UNIFORM:     return "Uniform";
+		case SIZE_NORMAL:      return "Normal";
+		case SIZE_EXPONENTIAL: return "Exponential";
+		default:               return "Undefined";
+		}
+	}
+}
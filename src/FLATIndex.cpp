@@ -0,0 +1,1146 @@
+#include "FLATIndex.hpp"
+#include "DataFileReader.hpp"
+#include "Segment.hpp"
+#include "Soma.hpp"
+#include "Mesh.hpp"
+#include "Hilbert.hpp"
+#include <algorithm>
+#include <queue>
+#include <set>
+#include <cmath>
+
+namespace FLAT
+{
+	/*
+	 * Sort-Tile-Recursive partitioning: the objects are sorted on x and cut
+	 * in slabs, every slab is sorted on y and cut in columns, every column
+	 * sorted on z and cut in pages. Every tile also gets the part of the
+	 * space up to its neighbour, so that the tiles cover the whole cell.
+	 */
+	static void tile(vector<SpatialObject*>& objects, uint64 begin, uint64 end, int dimension,
+			uint64 objectsPerPage, uint64 slabs, Box cell,
+			vector<uint64>& pageBegin, vector<Box>& pageCells)
+	{
+		if (dimension==0)
+			std::sort(objects.begin()+begin, objects.begin()+end, SpatialObjectXAsc());
+		else if (dimension==1)
+			std::sort(objects.begin()+begin, objects.begin()+end, SpatialObjectYAsc());
+		else
+			std::sort(objects.begin()+begin, objects.begin()+end, SpatialObjectZAsc());
+
+		uint64 capacity = objectsPerPage;
+		for (int d=dimension+1;d<DIMENSION;d++) capacity *= slabs;
+
+		for (uint64 b=begin;b<end;b+=capacity)
+		{
+			uint64 e = std::min(b+capacity,end);
+			Box sub = cell;
+			if (b!=begin) sub.low.Vector[dimension]  = objects[b]->getSortDimension(dimension);
+			if (e!=end)   sub.high.Vector[dimension] = objects[e]->getSortDimension(dimension);
+
+			if (dimension==DIMENSION-1)
+			{
+				pageBegin.push_back(b);
+				pageCells.push_back(sub);
+			}
+			else
+				tile(objects,b,e,dimension+1,objectsPerPage,slabs,sub,pageBegin,pageCells);
+		}
+	}
+
+	/*
+	 * Objects a packed page should hold: raw sized tiles are sampled for the
+	 * bits their records take, with a bit more per column since a page of
+	 * more objects spans more space. Pages that still do not fit are split.
+	 */
+	static uint64 packedCapacity(vector<SpatialObject*>& objects,Box universe,uint64 rawCapacity,uint32 objectSize)
+	{
+		uint64 pages = (objects.size()+rawCapacity-1) / rawCapacity;
+		uint64 slabs = (uint64)ceil(pow(pages+0.0,1.0/DIMENSION));
+		vector<uint64> pageBegin;
+		vector<Box> pageCells;
+		tile(objects,0,objects.size(),0,rawCapacity,slabs,universe,pageBegin,pageCells);
+		pageBegin.push_back(objects.size());
+
+		uint32 columns = objectSize/sizeof(uint32);
+		uint64 step = std::max((uint64)1,(uint64)pageCells.size()/64);
+		uint64 sampled = 0, bits = 0;
+		vector<int8> records(rawCapacity*objectSize+1);
+		for (uint64 p=0;p<pageCells.size();p+=step)
+		{
+			uint64 n = pageBegin[p+1]-pageBegin[p];
+			for (uint64 i=0;i<n;i++) objects[pageBegin[p]+i]->serialize(&records[i*objectSize]);
+			bits += PageCodec::recordBits(&records[0],n,objectSize);
+			sampled++;
+		}
+
+		double recordBits = (double)bits/sampled + columns;
+		uint64 header = sizeof(uint32) + columns*(2*sizeof(uint32)+2) + 3*sizeof(uint32);
+		uint64 capacity = (uint64)((PAGE_SIZE-header)*8/recordBits);
+		return std::max(capacity,rawCapacity);
+	}
+
+	// halves a page along the longest side of its cell until it fits
+	static void fitPage(PayLoad* payload,vector<SpatialObject*>& objects,uint64 begin,uint64 end,Box cell,
+			vector<uint64>& pageBegin,vector<Box>& pageCells)
+	{
+		if (end-begin<=1 || payload->fits(objects,begin,end))
+		{
+			pageBegin.push_back(begin);
+			pageCells.push_back(cell);
+			return;
+		}
+
+		int dimension = 0;
+		for (int d=1;d<DIMENSION;d++)
+			if (cell.high[d]-cell.low[d] > cell.high[dimension]-cell.low[dimension]) dimension = d;
+		if (dimension==0)
+			std::sort(objects.begin()+begin, objects.begin()+end, SpatialObjectXAsc());
+		else if (dimension==1)
+			std::sort(objects.begin()+begin, objects.begin()+end, SpatialObjectYAsc());
+		else
+			std::sort(objects.begin()+begin, objects.begin()+end, SpatialObjectZAsc());
+
+		uint64 middle = begin+(end-begin)/2;
+		Box lower = cell, upper = cell;
+		lower.high.Vector[dimension] = objects[middle]->getSortDimension(dimension);
+		upper.low.Vector[dimension]  = objects[middle]->getSortDimension(dimension);
+		fitPage(payload,objects,begin,middle,lower,pageBegin,pageCells);
+		fitPage(payload,objects,middle,end,upper,pageBegin,pageCells);
+	}
+
+	void FLATIndex::buildIndexWithCount(std::string sourceConfig,string type,std::string indexStem,int count,int threads,PageFormat format)
+	{
+		if (type!="binary")
+		{
+#ifdef FATAL
+			cout << "Unsupported input type: " << type << " (only binary data files)" << endl;
+#endif
+			return;
+		}
+
+		/********************** READ INPUT ***********************/
+		DataFileReader* input = new DataFileReader(sourceConfig);
+		SpatialObjectType objectType = input->objectType;
+		uint64 limit = (count>0 && (uint64)count<input->objectCount) ? (uint64)count : input->objectCount;
+
+		vector<SpatialObject*> objects;
+		objects.reserve(limit);
+		while (objects.size()<limit && input->hasNext())
+			objects.push_back(input->getNext());
+		delete input;
+
+		if (objects.empty())
+		{
+#ifdef FATAL
+			cout << "No objects to index in: " << sourceConfig << endl;
+#endif
+			return;
+		}
+
+		Box universe;
+		Box::boundingBox(universe,objects);
+		universe.isEmpty = false;
+
+		/********************** TILE ***********************/
+		uint32 objectSize = SpatialObjectFactory::getSize(objectType);
+		uint64 objectsPerPage = (PAGE_SIZE-sizeof(uint32)) / objectSize;
+		if (format==PACKED_PAGES && objectSize%sizeof(uint32)!=0)
+		{
+#ifdef FATAL
+			cout << "Objects of " << objectSize << " bytes cannot be packed, the pages stay raw" << endl;
+#endif
+			format = RAW_PAGES;
+		}
+		if (format==PACKED_PAGES)
+			objectsPerPage = packedCapacity(objects,universe,objectsPerPage,objectSize);
+		uint64 pages = (objects.size()+objectsPerPage-1) / objectsPerPage;
+		uint64 slabs = (uint64)ceil(pow(pages+0.0,1.0/DIMENSION));
+
+		vector<uint64> pageBegin;
+		vector<Box> pageCells;
+		tile(objects,0,objects.size(),0,objectsPerPage,slabs,universe,pageBegin,pageCells);
+		pageBegin.push_back(objects.size());
+
+		/********************** PAYLOAD AND METADATA ***********************/
+		PayLoad* payload = new PayLoad();
+		payload->create(indexStem,PAGE_SIZE,objectsPerPage,objectSize,objectType,format);
+
+		if (format==PACKED_PAGES)
+		{
+			vector<uint64> fittedBegin;
+			vector<Box> fittedCells;
+			for (uint64 p=0;p<pageCells.size();p++)
+				fitPage(payload,objects,pageBegin[p],pageBegin[p+1],pageCells[p],fittedBegin,fittedCells);
+			fittedBegin.push_back(objects.size());
+			pageBegin.swap(fittedBegin);
+			pageCells.swap(fittedCells);
+		}
+
+		vector<MetadataEntry*> metadataStructure;
+		for (uint32 pageId=0;pageId<pageCells.size();pageId++)
+		{
+			vector<SpatialObject*> page(objects.begin()+pageBegin[pageId],objects.begin()+pageBegin[pageId+1]);
+
+			MetadataEntry* me = new MetadataEntry();
+			me->pageId = pageId;
+			Box::boundingBox(me->pageMbr,page);
+			me->pageMbr.isEmpty = false;
+			// the partition holds the whole page, so a query finding the page finds its partition
+			Box::combine(pageCells[pageId],me->pageMbr,me->partitionMbr);
+			me->partitionMbr.isEmpty = false;
+			metadataStructure.push_back(me);
+
+			if (!payload->putPage(page))   // deletes the objects
+			{
+#ifdef FATAL
+				cout << "Cannot write page " << pageId << " of " << indexStem << "_payload.dat" << endl;
+#endif
+				for (uint64 i=pageBegin[pageId+1];i<objects.size();i++)
+					delete objects[i];
+				for (uint32 i=0;i<metadataStructure.size();i++)
+					delete metadataStructure[i];
+				delete payload;
+				return;
+			}
+		}
+		delete payload;
+		objects.clear();
+
+		/********************** LINKS AND SEED TREE ***********************/
+		// neighbouring partitions are linked on threads through a read-only tree over all partitions,
+		// the stream then hands the entries to the seed tree in pageId order
+		MetaDataStream* linked = new MetaDataStream(&metadataStructure,threads);
+		SeedBuilder::buildSeedTree(indexStem,linked);   // the stream deletes the entries
+		delete linked;
+#ifdef INFORMATION
+		cout << "FLAT index " << indexStem << ": " << pageCells.size() << " pages of " << objectsPerPage << " objects" << endl;
+#endif
+	}
+
+	void FLATIndex::buildIndex(std::string sourceConfig,string type,std::string indexStem)
+	{
+		buildIndexWithCount(sourceConfig,type,indexStem,0);
+	}
+
+	FLATIndex* FLATIndex::loadIndex(std::string indexStem)
+	{
+		FLATIndex* index = new FLATIndex();
+		index->indexName = indexStem;
+		index->prefetcher = NULL;
+		index->metadata = NULL;
+
+		index->payload = new PayLoad();
+		index->payload->load(indexStem);
+
+		string seedFile = indexStem+"_index";
+		try
+		{
+			index->rtreeStorageManager = SpatialIndex::StorageManager::loadDiskStorageManager(seedFile);
+			index->seedtree = SpatialIndex::RTree::loadRTree(*index->rtreeStorageManager,1);
+		}
+		catch(...)
+		{
+#ifdef FATAL
+			cout << "Cannot load Seed Index: " << seedFile << endl;
+#endif
+			exit(0);
+		}
+		return index;
+	}
+
+	FLATIndex* FLATIndex::loadIndexMemory(std::string indexStem,bool hugePages)
+	{
+		FLATIndex* index = loadIndex(indexStem);
+
+		// crawls are seeded on the read-only partition tree of the metadata, the seed tree stays on disk
+		index->metadata = new ResidentMetadata(index->rtreeStorageManager);
+
+		if (!index->payload->loadMemory(hugePages))
+		{
+#ifdef FATAL
+			cout << "Cannot load the Payload into memory, its pages are read from disk" << endl;
+#endif
+		}
+#ifdef INFORMATION
+		cout << "FLAT index " << indexStem << " in memory: metadata " << index->metadata->bytes()/1024 << " KB"
+			 << ", payload " << index->payload->residentPages*index->payload->pageSize/1024 << " KB"
+			 << ((index->payload->resident!=NULL && index->payload->resident->huge) ? " on huge pages" : "") << endl;
+#endif
+		return index;
+	}
+
+	// metadata page of the crawl: resident, through the prefetcher if there is one, or from storage
+	static bool readMetadata(FLATIndex* index,SpatialIndex::id_type metaPage,QueryStatistics& stats,MetadataPage& page)
+	{
+		if (index->metadata!=NULL)
+		{
+			if (!index->metadata->page(metaPage,page)) return false;
+			stats.FLAT_metaDataIOs++;
+			return true;
+		}
+
+		nodeSkeleton* node;
+		if (index->prefetcher!=NULL)
+		{
+			bool prefetched;
+			node = index->prefetcher->readMetadata(metaPage,&prefetched);
+			if (prefetched) stats.FLAT_prefetchMetaHits++;
+		}
+		else
+			node = SeedBuilder::readNode(metaPage,index->rtreeStorageManager);
+		if (node==NULL) return false;
+		page.assign(node);
+		delete node;
+		stats.FLAT_metaDataIOs++;
+		return true;
+	}
+
+	/*
+	 * First metadata page of the crawl of query.Region, in query.stats.FLAT_seedId. With the
+	 * metadata in memory any partition in the region will do and its read-only tree is searched,
+	 * otherwise the seed tree is descended to a page with an object in the region. False if
+	 * there is nothing to crawl.
+	 */
+	static bool seedRegion(FLATIndex* index,SpatialQuery& query)
+	{
+		if (index->metadata!=NULL)
+		{
+			SpatialIndex::id_type leaf;
+			if (!index->metadata->seed(query.Region,leaf)) return false;
+			query.stats.FLAT_seedId = leaf;
+			return true;
+		}
+
+		double lo[DIMENSION], hi[DIMENSION];
+		for (int d=0;d<DIMENSION;d++)
+		{
+			lo[d] = query.Region.low[d];
+			hi[d] = query.Region.high[d];
+		}
+		SpatialIndex::Region region = SpatialIndex::Region(lo,hi,DIMENSION);
+		seedVisitor visitor(&query,index->payload);
+		if (index->prefetcher!=NULL) pthread_mutex_lock(&index->prefetcher->storageLock);
+		index->seedtree->seedQuery(region,visitor);
+		if (index->prefetcher!=NULL) pthread_mutex_unlock(&index->prefetcher->storageLock);
+		return visitor.done;
+	}
+
+	// a payload page into view, counted in stats
+	static bool readPayLoad(FLATIndex* index,int pageId,QueryStatistics& stats,PageView& view)
+	{
+		bool hit;
+		if (!index->payload->getPage(view,pageId,&hit)) return false;
+		stats.FLAT_payLoadIOs++;
+		if (hit) stats.FLAT_payLoadCacheHits++; else stats.FLAT_payLoadCacheMisses++;
+		if (view.prefetched) stats.FLAT_prefetchPayLoadHit++;
+		return true;
+	}
+
+	/*
+	 * The breadth first crawl of the range queries: from the seed over the
+	 * metadata pages (seed tree leaves) linked to partitions in region. The
+	 * crawls differ in which payload pages they read and in what becomes of
+	 * the objects, wants() and scan() say so. With prefetching, the linked
+	 * metadata pages and the pages after the first of a metadata page are
+	 * requested while the first is scanned.
+	 */
+	class RegionCrawl
+	{
+	public:
+		FLATIndex* index;
+		Box region;
+		QueryStatistics& stats;
+		bool prefetching;
+		SpatialObject* scratch;         // to decode objects in place
+
+		RegionCrawl(FLATIndex* index,const Box& region,QueryStatistics& stats) : stats(stats)
+		{
+			this->index = index;
+			this->region = region;
+			prefetching = index->prefetcher!=NULL;
+			scratch = SpatialObjectFactory::create(index->payload->objType);
+		}
+
+		virtual ~RegionCrawl()
+		{
+			delete scratch;
+		}
+
+		// metadata page metaPage, false if it cannot be read
+		virtual bool metadataPage(SpatialIndex::id_type metaPage,MetadataPage& page)
+		{
+			return readMetadata(index,metaPage,stats,page);
+		}
+
+		// an entry whose partition and page overlap region: is its payload page read?
+		virtual bool wants(const MetadataPage::Entry& entry)=0;
+
+		// a payload page wanted by the crawl
+		virtual void scan(PageView& view,int pageId)=0;
+
+		void crawl(SpatialIndex::id_type seed)
+		{
+			std::queue<SpatialIndex::id_type> frontier;
+			std::set<SpatialIndex::id_type> visited;
+			PageView view;
+			MetadataPage metadata;
+			frontier.push(seed);
+			visited.insert(seed);
+
+			while (!frontier.empty())
+			{
+				SpatialIndex::id_type metaPage = frontier.front();
+				frontier.pop();
+
+				if (!metadataPage(metaPage,metadata)) continue;
+
+				vector<int> pages;
+
+				for (uint32 i=0;i<metadata.count;i++)
+				{
+					stats.FLAT_metaDataEntryLookup++;
+
+					const MetadataPage::Entry& entry = metadata.entries[i];
+					if (!Box::overlap(entry.partition,region)) continue;
+
+					for (uint32 l=entry.firstLink;l<entry.firstLink+entry.links;l++)
+						if (visited.insert(metadata.links[l]).second)
+						{
+							frontier.push(metadata.links[l]);
+							if (prefetching) index->prefetcher->prefetchMetadata(metadata.links[l],region);
+						}
+
+					if (Box::overlap(entry.pageMbr,region) && wants(entry)) pages.push_back(entry.pageId);
+				}
+
+				if (prefetching)
+					for (uint32 p=1;p<pages.size();p++)
+						index->prefetcher->prefetchPayLoad(pages[p]);
+
+				for (uint32 p=0;p<pages.size();p++)
+				{
+					if (!readPayLoad(index,pages[p],stats,view)) continue;
+					scan(view,pages[p]);
+					view.release();
+				}
+			}
+			if (prefetching) index->prefetcher->drain();
+		}
+	};
+
+	// the objects of one range query
+	class RangeCrawl : public RegionCrawl
+	{
+	public:
+		vector<SpatialObject*>& results;
+
+		RangeCrawl(FLATIndex* index,SpatialQuery& query,vector<SpatialObject*>& results)
+			: RegionCrawl(index,query.Region,query.stats), results(results) {}
+
+		bool wants(const MetadataPage::Entry& entry)
+		{
+			return true;
+		}
+
+		// decode in place, only the results become objects
+		void scan(PageView& view,int pageId)
+		{
+			for (uint32 o=0;o<view.objects;o++)
+			{
+				view.read(o,scratch);
+				if (overlapsRegion(scratch,region))
+				{
+					results.push_back(view.create(o));
+					stats.ResultPoints++;
+				}
+				else
+					stats.UselessPoints++;
+			}
+		}
+	};
+
+	void FLATIndex::rangeQuery(FLATIndex* index,SpatialQuery& query,vector<SpatialObject*>& results)
+	{
+		query.stats.executionTime.start();
+		query.stats.ObjectsPerPage = index->payload->objectsPerPage;
+		query.stats.ObjectSize = index->payload->storedObjectSize();
+		query.Region.isEmpty = false;
+
+		/********************** SEEDING ***********************/
+		query.stats.FLAT_seeding.start();
+		bool seeded = seedRegion(index,query);
+		query.stats.FLAT_seeding.stop();
+
+		/********************** CRAWLING ***********************/
+		query.stats.FLAT_crawling.start();
+		if (seeded)
+		{
+			RangeCrawl crawl(index,query,results);
+			crawl.crawl(query.stats.FLAT_seedId);
+		}
+		query.stats.FLAT_crawling.stop();
+		query.stats.executionTime.stop();
+	}
+
+	// queries in the order of the Hilbert values of the centers of their regions
+	class QueryHilbertAsc
+	{
+	public:
+		vector<SpatialQuery>* queries;
+
+		QueryHilbertAsc(vector<SpatialQuery>* queries)
+		{
+			this->queries = queries;
+		}
+
+		bool operator()(uint32 q1,uint32 q2) const
+		{
+			Vertex c1 = (*queries)[q1].Region.getCenter();
+			Vertex c2 = (*queries)[q2].Region.getCenter();
+			double d1[DIMENSION],d2[DIMENSION];
+			for (int d=0;d<DIMENSION;d++)
+			{
+				d1[d] = c1[d];
+				d2[d] = c2[d];
+			}
+			return hilbert_ieee_cmp(DIMENSION,d1,d2)<0;
+		}
+	};
+
+	/*
+	 * One crawl for a group of queries. The crawl follows the links of the
+	 * partitions in the MBR of the group, so that it stays connected, but
+	 * only reads the payload pages some query of the group needs and hands
+	 * every object of a page to the queries it is in.
+	 */
+	class GroupCrawl : public RegionCrawl
+	{
+	public:
+		vector<SpatialQuery>& queries;
+		vector<uint32>& group;
+		vector< vector<SpatialObject*> >& results;
+		map<int,vector<uint32> > readers;      // queries of the group that need a wanted page
+
+		GroupCrawl(FLATIndex* index,SpatialQuery& shared,vector<SpatialQuery>& queries,vector<uint32>& group,
+				vector< vector<SpatialObject*> >& results)
+			: RegionCrawl(index,shared.Region,shared.stats), queries(queries), group(group), results(results) {}
+
+		bool wants(const MetadataPage::Entry& entry)
+		{
+			vector<uint32> needed;
+			for (uint32 g=0;g<group.size();g++)
+				if (Box::overlap(entry.pageMbr,queries[group[g]].Region)) needed.push_back(group[g]);
+			if (needed.empty()) return false;
+			readers[entry.pageId].swap(needed);
+			return true;
+		}
+
+		void scan(PageView& view,int pageId)
+		{
+			vector<uint32>& needed = readers[pageId];
+			for (uint32 r=0;r<needed.size();r++)
+				queries[needed[r]].stats.FLAT_payLoadIOs++;
+
+			for (uint32 o=0;o<view.objects;o++)
+			{
+				view.read(o,scratch);
+				bool result = false;
+				for (uint32 r=0;r<needed.size();r++)
+				{
+					SpatialQuery& query = queries[needed[r]];
+					if (overlapsRegion(scratch,query.Region))
+					{
+						results[needed[r]].push_back(view.create(o));
+						query.stats.ResultPoints++;
+						result = true;
+					}
+					else
+						query.stats.UselessPoints++;
+				}
+				if (result) stats.ResultPoints++; else stats.UselessPoints++;
+			}
+			readers.erase(pageId);
+		}
+	};
+
+	// one seed descent and one crawl for a group, the work actually done goes to the statistics of the batch
+	static void crawlGroup(FLATIndex* index,vector<SpatialQuery>& queries,vector<uint32>& group,
+			vector< vector<SpatialObject*> >& results,QueryStatistics& batch)
+	{
+		SpatialQuery shared;
+		shared.type = RANGE_QUERY;
+		shared.Region = queries[group[0]].Region;
+		for (uint32 g=1;g<group.size();g++)
+			Box::combine(shared.Region,queries[group[g]].Region,shared.Region);
+		shared.Region.isEmpty = false;
+		shared.stats.executionTime.start();
+
+		/********************** SEEDING ***********************/
+		shared.stats.FLAT_seeding.start();
+		bool seeded = seedRegion(index,shared);
+		shared.stats.FLAT_seeding.stop();
+
+		/********************** CRAWLING ***********************/
+		shared.stats.FLAT_crawling.start();
+		if (seeded)
+		{
+			GroupCrawl crawl(index,shared,queries,group,results);
+			crawl.crawl(shared.stats.FLAT_seedId);
+		}
+		shared.stats.FLAT_crawling.stop();
+		shared.stats.executionTime.stop();
+
+		// every query of the group is answered when the group is
+		for (uint32 g=0;g<group.size();g++)
+		{
+			QueryStatistics& stats = queries[group[g]].stats;
+			stats.executionTime.add(shared.stats.executionTime);
+			stats.FLAT_seeding.add(shared.stats.FLAT_seeding);
+			stats.FLAT_crawling.add(shared.stats.FLAT_crawling);
+		}
+		batch.add(shared.stats);
+	}
+
+	void FLATIndex::batchRangeQuery(FLATIndex* index,vector<SpatialQuery>& queries,
+			vector< vector<SpatialObject*> >& results,QueryStatistics& batch,uint32 maxGroup)
+	{
+		results.assign(queries.size(),vector<SpatialObject*>());
+		batch.ObjectsPerPage = index->payload->objectsPerPage;
+		batch.ObjectSize = index->payload->storedObjectSize();
+		if (maxGroup==0) maxGroup = 1;
+
+		vector<uint32> order(queries.size());
+		for (uint32 q=0;q<queries.size();q++)
+		{
+			order[q] = q;
+			queries[q].Region.isEmpty = false;
+			queries[q].stats.ObjectsPerPage = index->payload->objectsPerPage;
+			queries[q].stats.ObjectSize = index->payload->storedObjectSize();
+		}
+		std::sort(order.begin(),order.end(),QueryHilbertAsc(&queries));
+
+		// a group grows along the curve while the next query overlaps one already in it
+		uint32 first = 0;
+		while (first<order.size())
+		{
+			vector<uint32> group;
+			group.push_back(order[first]);
+			uint32 next = first+1;
+			while (next<order.size() && group.size()<maxGroup)
+			{
+				bool overlaps = false;
+				for (uint32 g=0;g<group.size() && !overlaps;g++)
+					overlaps = Box::overlap(queries[order[next]].Region,queries[group[g]].Region);
+				if (!overlaps) break;
+				group.push_back(order[next]);
+				next++;
+			}
+			crawlGroup(index,queries,group,results,batch);
+			first = next;
+		}
+	}
+
+	// one row per object: segments as begin, end and the radii, everything else as its MBR
+	static void objectRow(SpatialObject* object,vector<float>& row)
+	{
+		if (object->getType()==SEGMENT)
+		{
+			Segment* s = (Segment*)object;
+			for (int d=0;d<DIMENSION;d++) row.push_back(s->begin[d]);
+			for (int d=0;d<DIMENSION;d++) row.push_back(s->end[d]);
+			row.push_back(s->radiusBegin);
+			row.push_back(s->radiusEnd);
+		}
+		else
+		{
+			Box mbr = object->getMBR();
+			for (int d=0;d<DIMENSION;d++) row.push_back(mbr.low[d]);
+			for (int d=0;d<DIMENSION;d++) row.push_back(mbr.high[d]);
+		}
+	}
+
+	std::vector< vector<float> > FLATIndex::windowQuery(FLATIndex* index,float xlo,float ylo,float zlo,float xhi,float yhi,float zhi)
+	{
+		SpatialQuery query;
+		query.type = RANGE_QUERY;
+		query.Region.low[0]  = xlo; query.Region.low[1]  = ylo; query.Region.low[2]  = zlo;
+		query.Region.high[0] = xhi; query.Region.high[1] = yhi; query.Region.high[2] = zhi;
+
+		vector<SpatialObject*> results;
+		rangeQuery(index,query,results);
+
+		std::vector< vector<float> > rows(results.size());
+		for (uint64 i=0;i<results.size();i++)
+		{
+			objectRow(results[i],rows[i]);
+			delete results[i];
+		}
+		return rows;
+	}
+
+	std::vector< vector<float> > FLATIndex::vicinityQuery(FLATIndex* index,float centerX,float centerY,float centerZ,float vicinityRadius)
+	{
+		// the vicinity is the cube around the center
+		return windowQuery(index,centerX-vicinityRadius,centerY-vicinityRadius,centerZ-vicinityRadius,
+				centerX+vicinityRadius,centerY+vicinityRadius,centerZ+vicinityRadius);
+	}
+
+	std::vector<int> FLATIndex::getNeuronIds(FLATIndex* index,float xlo,float ylo,float zlo,float xhi,float yhi,float zhi)
+	{
+		SpatialQuery query;
+		query.type = RANGE_QUERY;
+		query.Region.low[0]  = xlo; query.Region.low[1]  = ylo; query.Region.low[2]  = zlo;
+		query.Region.high[0] = xhi; query.Region.high[1] = yhi; query.Region.high[2] = zhi;
+
+		vector<SpatialObject*> results;
+		rangeQuery(index,query,results);
+
+		set<int> neurons;
+		for (vector<SpatialObject*>::iterator it = results.begin(); it != results.end(); ++it)
+		{
+			switch ((*it)->getType())
+			{
+				case SEGMENT: neurons.insert(((Segment*)(*it))->neuronId); break;
+				case SOMA:    neurons.insert(((Soma*)(*it))->neuronId); break;
+				case MESH:    neurons.insert(((Mesh*)(*it))->neuronId); break;
+				default: break;
+			}
+			delete (*it);
+		}
+		return std::vector<int>(neurons.begin(),neurons.end());
+	}
+
+	std::vector< vector<float> > FLATIndex::kNNQuery(FLATIndex* index,float centerX,float centerY,float centerZ,uint32 k)
+	{
+		SpatialQuery query;
+		query.type = KNN_QUERY;
+		query.Point[0] = centerX; query.Point[1] = centerY; query.Point[2] = centerZ;
+
+		vector<SpatialObject*> results;
+		kNearestNeighbour(index,query,results,k);
+
+		std::vector< vector<float> > rows(results.size());
+		for (uint64 i=0;i<results.size();i++)
+		{
+			objectRow(results[i],rows[i]);
+			delete results[i];
+		}
+		return rows;
+	}
+
+	MovingCrawl::MovingCrawl(FLATIndex* index)
+	{
+		this->index = index;
+		steps = 0;
+		pagesRead = 0;
+		pagesReused = 0;
+	}
+
+	MovingCrawl::~MovingCrawl()
+	{
+		if (index->prefetcher!=NULL) index->prefetcher->drain();
+		for (map<SpatialIndex::id_type,CrawlPage*>::iterator it=metadata.begin(); it!=metadata.end(); ++it)
+			delete it->second;
+		for (map<int,HeldPage*>::iterator it=pages.begin(); it!=pages.end(); ++it)
+		{
+			for (uint32 o=0;o<it->second->objects.size();o++) delete it->second->objects[o];
+			delete it->second;
+		}
+	}
+
+	// is the part of page inside region also inside covered?
+	static bool coveredPart(const Box& page,const Box& region,const Box& covered)
+	{
+		for (int d=0;d<DIMENSION;d++)
+			if (std::max(page.low[d],region.low[d])<covered.low[d] || std::min(page.high[d],region.high[d])>covered.high[d])
+				return false;
+		return true;
+	}
+
+	/*
+	 * The crawl of one step: metadata pages kept from the last step are not
+	 * read again, payload pages held for a part of them covering the region
+	 * are not read again. Nothing is prefetched, the step requests the pages
+	 * of the next region itself.
+	 */
+	class StepCrawl : public RegionCrawl
+	{
+	public:
+		MovingCrawl& moving;
+		map<SpatialIndex::id_type,MovingCrawl::CrawlPage*> crawled;
+		map<int,MovingCrawl::HeldPage*> held;
+		MetadataPage read;
+
+		StepCrawl(MovingCrawl& moving,const Box& region,QueryStatistics& stats)
+			: RegionCrawl(moving.index,region,stats), moving(moving)
+		{
+			prefetching = false;
+		}
+
+		bool metadataPage(SpatialIndex::id_type metaPage,MetadataPage& page)
+		{
+			MovingCrawl::CrawlPage* kept;
+			map<SpatialIndex::id_type,MovingCrawl::CrawlPage*>::iterator it = moving.metadata.find(metaPage);
+			if (it!=moving.metadata.end())
+			{
+				kept = it->second;
+				moving.metadata.erase(it);
+			}
+			else
+			{
+				if (!readMetadata(index,metaPage,stats,read)) return false;
+				kept = new MovingCrawl::CrawlPage();
+				kept->entries.assign(read.entries,read.entries+read.count);
+				for (uint32 i=0;i<read.count;i++)
+				{
+					kept->entries[i].firstLink = kept->links.size();
+					kept->links.insert(kept->links.end(),read.links+read.entries[i].firstLink,
+							read.links+read.entries[i].firstLink+read.entries[i].links);
+				}
+			}
+			crawled[metaPage] = kept;
+
+			page.count = kept->entries.size();
+			page.entries = kept->entries.empty() ? NULL : &kept->entries[0];
+			page.links = kept->links.empty() ? NULL : &kept->links[0];
+			return true;
+		}
+
+		bool wants(const MetadataPage::Entry& entry)
+		{
+			map<int,MovingCrawl::HeldPage*>::iterator kept = moving.pages.find(entry.pageId);
+			if (kept==moving.pages.end() || !coveredPart(entry.pageMbr,region,kept->second->covered))
+				return true;
+			held[entry.pageId] = kept->second;
+			moving.pages.erase(kept);
+			moving.pagesReused++;
+			return false;
+		}
+
+		// the page is new or reaches out of what was read of it
+		void scan(PageView& view,int pageId)
+		{
+			moving.pagesRead++;
+			MovingCrawl::HeldPage* page = new MovingCrawl::HeldPage();
+			page->covered = region;
+			for (uint32 o=0;o<view.objects;o++)
+			{
+				view.read(o,scratch);
+				if (overlapsRegion(scratch,region))
+					page->objects.push_back(view.create(o));
+				else
+					stats.UselessPoints++;
+			}
+			held[pageId] = page;
+		}
+	};
+
+	void MovingCrawl::step(Box& region,vector<SpatialObject*>& results,QueryStatistics& stats)
+	{
+		stats.executionTime.start();
+		stats.ObjectsPerPage = index->payload->objectsPerPage;
+		stats.ObjectSize = index->payload->storedObjectSize();
+		region.isEmpty = false;
+
+		/********************** SEEDING ***********************/
+		// any kept metadata page with a partition in the region, else the leaf of the partition
+		// nearest to the region: the crawl needs no object to start from, so no payload is read
+		stats.FLAT_seeding.start();
+		bool seeded = false;
+		for (map<SpatialIndex::id_type,CrawlPage*>::iterator it=metadata.begin(); it!=metadata.end() && !seeded; ++it)
+			for (uint32 i=0;i<it->second->entries.size() && !seeded;i++)
+				if (Box::overlap(it->second->entries[i].partition,region))
+				{
+					stats.FLAT_seedId = it->first;
+					seeded = true;
+				}
+		SpatialIndex::id_type leaf;
+		if (!seeded && index->metadata!=NULL)
+		{
+			seeded = index->metadata->seed(region,leaf) || index->metadata->nearest(region.getCenter(),leaf);
+			if (seeded) stats.FLAT_seedId = leaf;
+		}
+		else if (!seeded)
+		{
+			SpatialQuery seed;
+			double lo[DIMENSION], hi[DIMENSION];
+			for (int d=0;d<DIMENSION;d++)
+			{
+				lo[d] = region.low[d];
+				hi[d] = region.high[d];
+			}
+			kNNVisitor visitor(&seed);
+			if (index->prefetcher!=NULL) pthread_mutex_lock(&index->prefetcher->storageLock);
+			index->seedtree->nearestNeighborQuery(1,SpatialIndex::Region(lo,hi,DIMENSION),visitor);
+			if (index->prefetcher!=NULL) pthread_mutex_unlock(&index->prefetcher->storageLock);
+			stats.add(seed.stats);
+			seeded = visitor.done;
+			if (seeded) stats.FLAT_seedId = seed.stats.FLAT_seedId;
+		}
+		stats.FLAT_seeding.stop();
+
+		/********************** CRAWLING ***********************/
+		stats.FLAT_crawling.start();
+		StepCrawl crawl(*this,region,stats);
+		if (seeded) crawl.crawl(stats.FLAT_seedId);
+		map<int,HeldPage*>& held = crawl.held;
+
+		for (map<int,HeldPage*>::iterator it=held.begin(); it!=held.end(); ++it)
+			for (uint32 o=0;o<it->second->objects.size();o++)
+			{
+				if (overlapsRegion(it->second->objects[o],region))
+				{
+					results.push_back(it->second->objects[o]);
+					stats.ResultPoints++;
+				}
+			}
+
+		// what the region has left
+		for (map<SpatialIndex::id_type,CrawlPage*>::iterator it=metadata.begin(); it!=metadata.end(); ++it)
+			delete it->second;
+		metadata.swap(crawl.crawled);
+		for (map<int,HeldPage*>::iterator it=pages.begin(); it!=pages.end(); ++it)
+		{
+			for (uint32 o=0;o<it->second->objects.size();o++) delete it->second->objects[o];
+			delete it->second;
+		}
+		pages.swap(held);
+		stats.FLAT_crawling.stop();
+
+		if (index->prefetcher!=NULL && steps>0)
+		{
+			// the region moves on as it did from the last step
+			Box next = region;
+			for (int d=0;d<DIMENSION;d++)
+			{
+				spaceUnit shift = (region.low[d]+region.high[d]-last.low[d]-last.high[d])/2;
+				next.low[d]  += shift;
+				next.high[d] += shift;
+			}
+			stats.prefetchingTime.start();
+			prefetch(next);
+			stats.prefetchingTime.stop();
+		}
+		last = region;
+		steps++;
+		stats.executionTime.stop();
+	}
+
+	// the metadata pages linked to kept partitions in next and the payload pages of next that are not held
+	void MovingCrawl::prefetch(Box& next)
+	{
+		for (map<SpatialIndex::id_type,CrawlPage*>::iterator it=metadata.begin(); it!=metadata.end(); ++it)
+			for (uint32 i=0;i<it->second->entries.size();i++)
+			{
+				const MetadataPage::Entry& entry = it->second->entries[i];
+				if (!Box::overlap(entry.partition,next)) continue;
+
+				for (uint32 l=entry.firstLink;l<entry.firstLink+entry.links;l++)
+					if (metadata.find(it->second->links[l])==metadata.end())
+						index->prefetcher->prefetchMetadata(it->second->links[l],next);
+
+				if (!Box::overlap(entry.pageMbr,next)) continue;
+				map<int,HeldPage*>::iterator kept = pages.find(entry.pageId);
+				if (kept==pages.end() || !coveredPart(entry.pageMbr,next,kept->second->covered))
+					index->prefetcher->prefetchPayLoad(entry.pageId);
+			}
+	}
+
+	// an entry of a metadata page with its links, for the kNN queue
+	static MetadataEntry* copyEntry(const MetadataPage& metadata,uint32 i)
+	{
+		const MetadataPage::Entry& entry = metadata.entries[i];
+		MetadataEntry* me = new MetadataEntry();
+		me->partitionMbr = entry.partition;
+		me->pageMbr = entry.pageMbr;
+		me->pageId = entry.pageId;
+		for (uint32 l=entry.firstLink;l<entry.firstLink+entry.links;l++)
+			me->pageLinks.insert(metadata.links[l]);
+		return me;
+	}
+
+	/*
+	 * Best first crawl: one queue holds metadata entries, payload pages and
+	 * objects by their distance to the query point. A metadata entry brings
+	 * in the metadata pages it links to and its payload page, a payload page
+	 * its objects. The partitions cover the data space and linked partitions
+	 * touch, so the partitions nearer than the k-th object are all reached
+	 * before it is popped. Pages and objects farther than the k nearest
+	 * objects seen so far are dropped.
+	 */
+	void FLATIndex::kNearestNeighbour(FLATIndex* index,SpatialQuery& query,vector<SpatialObject*>& results, uint32 k)
+	{
+		query.stats.executionTime.start();
+		query.stats.ObjectsPerPage = index->payload->objectsPerPage;
+		query.stats.ObjectSize = index->payload->storedObjectSize();
+		if (k==0)
+		{
+			query.stats.executionTime.stop();
+			return;
+		}
+
+		/********************** SEEDING ***********************/
+		query.stats.FLAT_seeding.start();
+		bool seeded;
+		SpatialIndex::id_type leaf;
+		if (index->metadata!=NULL)
+		{
+			seeded = index->metadata->nearest(query.Point,leaf);
+			if (seeded) query.stats.FLAT_seedId = leaf;
+		}
+		else
+		{
+			double point[DIMENSION];
+			for (int d=0;d<DIMENSION;d++) point[d] = query.Point[d];
+			kNNVisitor visitor(&query);
+			if (index->prefetcher!=NULL) pthread_mutex_lock(&index->prefetcher->storageLock);
+			index->seedtree->nearestNeighborQuery(1,SpatialIndex::Point(point,DIMENSION),visitor);
+			if (index->prefetcher!=NULL) pthread_mutex_unlock(&index->prefetcher->storageLock);
+			seeded = visitor.done;
+		}
+		query.stats.FLAT_seeding.stop();
+
+		/********************** CRAWLING ***********************/
+		query.stats.FLAT_crawling.start();
+		if (seeded)
+		{
+			std::priority_queue<kNNEntry*,vector<kNNEntry*>,kNNEntry::ascending> queue;
+			std::priority_queue<bigSpaceUnit> nearest;   // the k smallest object distances seen
+			std::set<SpatialIndex::id_type> visited;
+			PageView view;
+			MetadataPage metadata;
+			SpatialObject* scratch = SpatialObjectFactory::create(index->payload->objType);
+			vector<SpatialIndex::id_type> frontier;
+			frontier.push_back(query.stats.FLAT_seedId);
+			visited.insert(query.stats.FLAT_seedId);
+
+			while (true)
+			{
+				// metadata pages brought in by the last entry
+				for (uint32 f=0;f<frontier.size();f++)
+				{
+					if (!readMetadata(index,frontier[f],query.stats,metadata)) continue;
+					for (uint32 i=0;i<metadata.count;i++)
+					{
+						query.stats.FLAT_metaDataEntryLookup++;
+						queue.push(new kNNEntry(copyEntry(metadata,i),query.Point,frontier[f]));
+					}
+				}
+				frontier.clear();
+
+				if (queue.empty()) break;
+				kNNEntry* entry = queue.top();
+				queue.pop();
+				bool bounded = nearest.size()==k;
+
+				if (entry->isMetaPage)
+				{
+					for (set<id>::iterator link=entry->me->pageLinks.begin(); link!=entry->me->pageLinks.end(); ++link)
+						if (visited.insert(*link).second) frontier.push_back(*link);
+
+					kNNEntry* page = new kNNEntry(entry,query.Point);
+					if (bounded && page->minDist>nearest.top()) delete page;
+					else queue.push(page);
+				}
+				else if (entry->isPayLoadPage)
+				{
+					if ((!bounded || entry->minDist<=nearest.top()) && readPayLoad(index,entry->metaentryId,query.stats,view))
+					{
+						// decode in place, only the candidates become objects
+						for (uint32 o=0;o<view.objects;o++)
+						{
+							view.read(o,scratch);
+							bigSpaceUnit distance = scratch->pointDistance(query.Point);
+							if (nearest.size()==k && distance>nearest.top())
+							{
+								query.stats.UselessPoints++;
+								continue;
+							}
+							nearest.push(distance);
+							if (nearest.size()>k) nearest.pop();
+							queue.push(new kNNEntry(view.create(o),query.Point,entry->metapageId,entry->metaentryId));
+						}
+						view.release();
+					}
+				}
+				else
+				{
+					results.push_back(entry->sobj);
+					query.stats.ResultPoints++;
+					entry->sobj = NULL;
+				}
+				delete entry;
+				if (results.size()==k) break;
+			}
+
+			while (!queue.empty())
+			{
+				kNNEntry* entry = queue.top();
+				queue.pop();
+				if (entry->sobj!=NULL)
+				{
+					query.stats.UselessPoints++;
+					delete entry->sobj;
+				}
+				delete entry;
+			}
+			delete scratch;
+		}
+		query.stats.FLAT_crawling.stop();
+		query.stats.executionTime.stop();
+	}
+
+	void FLATIndex::setPageCache(FLATIndex* index,uint64 budgetBytes,uint32 shards)
+	{
+		index->payload->setCache(budgetBytes,shards);
+	}
+
+	void FLATIndex::setPrefetching(FLATIndex* index,int threads,uint32 maxInFlight)
+	{
+		delete index->prefetcher;
+		index->prefetcher = NULL;
+		if (threads<=0) return;
+		if (index->metadata!=NULL)
+		{
+#ifdef FATAL
+			cout << "The metadata is in memory (memory resident index or concurrent readers), there is nothing to prefetch" << endl;
+#endif
+			return;
+		}
+		if (index->payload->cache==NULL)
+		{
+#ifdef FATAL
+			cout << "Prefetching reads into the page cache, using a cache of 32 MB" << endl;
+#endif
+			index->payload->setCache(32*1024*1024,16);
+		}
+		index->prefetcher = new Prefetcher(index->payload,index->rtreeStorageManager,threads,maxInFlight);
+	}
+
+	void FLATIndex::setConcurrentReaders(FLATIndex* index)
+	{
+		if (index->prefetcher!=NULL)
+		{
+#ifdef FATAL
+			cout << "Prefetching reads through the seed tree storage, it is turned off for concurrent readers" << endl;
+#endif
+			delete index->prefetcher;
+			index->prefetcher = NULL;
+		}
+		if (index->metadata==NULL) index->metadata = new ResidentMetadata(index->rtreeStorageManager);
+#ifdef INFORMATION
+		cout << "FLAT index ready for concurrent readers: metadata " << index->metadata->bytes()/1024 << " KB in memory" << endl;
+#endif
+	}
+
+	void FLATIndex::unLoadIndex(FLATIndex* index)
+	{
+		delete index->prefetcher;
+		delete index->metadata;
+		delete index->seedtree;
+		delete index->rtreeStorageManager;
+		delete index->payload;
+		delete index;
+	}
+}
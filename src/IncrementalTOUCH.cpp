@@ -0,0 +1,286 @@
+/*
+ * File:   IncrementalTOUCH.cpp
+ *
+ */
+
+#include "IncrementalTOUCH.h"
+
+#include <algorithm>
+#include <iterator>
+#include <boost/unordered_set.hpp>
+
+IncrementalTOUCH::IncrementalTOUCH() {
+    updatedObjects = 0;
+    dirtyNodes = 0;
+}
+
+IncrementalTOUCH::~IncrementalTOUCH() {
+    for (SpatialObjectList::iterator it = retired.begin(); it != retired.end(); it++)
+    {
+        delete (*it)->obj;
+        delete (*it);
+    }
+    for (boost::unordered_set<TreeEntry*>::iterator it = ownedB.begin(); it != ownedB.end(); it++)
+    {
+        delete (*it)->obj;
+        delete (*it);
+    }
+}
+
+/*
+ * Initial step: the complete TOUCH join. Every B object is probed on its own
+ * (independent of localJoin) so that its partners can be recorded for the
+ * following updates.
+ */
+void IncrementalTOUCH::run()
+{
+    totalTimeStart();
+    loadOrBuildA();
+    readBinaryInputB(file_dsB);
+    if (verbose) std::cout << "Assigning the objects of B" << std::endl; 
+    TRACE_SPAN(assignSpan,"assignment",NULL,0);
+    building.start();
+    for (FLAT::uint64 i = 0; i < dsB.size(); i++)
+    {
+        entriesB[dsB[i]->id] = dsB[i];
+        slots[dsB[i]].inB = i;
+        attach(dsB[i]);
+    }
+    building.stop();
+    TRACE_STOP(assignSpan);
+    analyze();
+    if (verbose) std::cout << "Probing, doing the join" << std::endl; 
+    TRACE_SCOPE("probe");
+    probing.start();
+    for (SpatialObjectList::iterator it = dsB.begin(); it != dsB.end(); it++)
+    {
+        SpatialObjectList& found = partners[(*it)];
+        if (assignedTo[(*it)] != NULL)
+            probeObject((*it),assignedTo[(*it)],found);
+        std::sort(found.begin(),found.end());
+        for (SpatialObjectList::iterator a = found.begin(); a != found.end(); a++)
+            addResult((*a),(*it));
+    }
+    probing.stop();
+    if (verbose) std::cout << "Done." << std::endl; 
+    totalTimeStop();
+}
+
+/*
+ * Apply one time step. Every changed object is detached from its old node,
+ * assigned again from the root and joined only with the leaves below its
+ * new node. The partners found are compared with the previous ones and the
+ * difference is applied to resultPairs in its mode.
+ */
+void IncrementalTOUCH::update(UpdateList& updates)
+{
+    TRACE_SCOPE_ARG("update","objects",updates.size());
+    updating.start();
+
+    added.clear();
+    removed.clear();
+    for (SpatialObjectList::iterator it = retired.begin(); it != retired.end(); it++)
+    {
+        delete (*it)->obj;
+        delete (*it);
+    }
+    retired.clear();
+
+    boost::unordered_set<TreeEntry*> changed;
+    boost::unordered_set<TreeNode*> dirty;
+    TreeEntry* obj;
+
+    building.start();
+    for (UpdateList::iterator up = updates.begin(); up != updates.end(); up++)
+    {
+        EntryMap::iterator found = entriesB.find(up->id);
+        switch (up->type)
+        {
+            case update_Insert:
+                if (found != entriesB.end())
+                {
+                    if (verbose) std::cout << "Insert of existing B object " << up->id << " ignored" << std::endl;
+                    delete up->obj;
+                    continue;
+                }
+                obj = new TreeEntry(up->obj,1,up->id,epsilon);
+                ownedB.insert(obj);
+                slots[obj].inB = dsB.size();
+                dsB.push_back(obj);
+                entriesB[up->id] = obj;
+                partners[obj];
+                attach(obj);
+                size_dsB++;
+                break;
+            case update_Move:
+                if (found == entriesB.end())
+                {
+                    if (verbose) std::cout << "Move of unknown B object " << up->id << " ignored" << std::endl;
+                    delete up->obj;
+                    continue;
+                }
+                obj = found->second;
+                dirty.insert(assignedTo[obj]);
+                detach(obj);
+                delete obj->obj;
+                obj->setObject(up->obj,epsilon);
+                attach(obj);
+                break;
+            case update_Delete:
+                if (found == entriesB.end())
+                {
+                    if (verbose) std::cout << "Delete of unknown B object " << up->id << " ignored" << std::endl;
+                    continue;
+                }
+                obj = found->second;
+                dirty.insert(assignedTo[obj]);
+                detach(obj);
+                for (SpatialObjectList::iterator it = partners[obj].begin(); it != partners[obj].end(); it++)
+                    removed.addPair((*it),obj);
+                partners.erase(obj);
+                assignedTo.erase(obj);
+                entriesB.erase(found);
+                changed.erase(obj);
+                removeFromB(obj);
+                // the entries of the datasets stay in vdsAll and are freed with them
+                if (ownedB.erase(obj) > 0)
+                    retired.push_back(obj);
+                size_dsB--;
+                continue;
+            default:
+                if (verbose) std::cout << "Unknown update type " << up->type << std::endl;
+                continue;
+        }
+        dirty.insert(assignedTo[obj]);
+        changed.insert(obj);
+    }
+    dirty.erase((TreeNode*)NULL);
+    building.stop();
+
+    probing.start();
+    SpatialObjectList found;
+    SpatialObjectList diff;
+    for (boost::unordered_set<TreeEntry*>::iterator it = changed.begin(); it != changed.end(); it++)
+    {
+        obj = (*it);
+        found.clear();
+        if (assignedTo[obj] != NULL)
+            probeObject(obj,assignedTo[obj],found);
+        std::sort(found.begin(),found.end());
+
+        SpatialObjectList& old = partners[obj];
+        diff.clear();
+        std::set_difference(found.begin(),found.end(),old.begin(),old.end(),std::back_inserter(diff));
+        for (SpatialObjectList::iterator d = diff.begin(); d != diff.end(); d++)
+            added.addPair((*d),obj);
+        diff.clear();
+        std::set_difference(old.begin(),old.end(),found.begin(),found.end(),std::back_inserter(diff));
+        for (SpatialObjectList::iterator d = diff.begin(); d != diff.end(); d++)
+            removed.addPair((*d),obj);
+        swap(old,found);
+    }
+    probing.stop();
+
+    updatedObjects = updates.size();
+    dirtyNodes = dirty.size();
+    for (FLAT::uint64 i = 0; i < removed.objA.size(); i++)
+        removeResult(removed.objA[i],removed.objB[i]);
+    for (FLAT::uint64 i = 0; i < added.objA.size(); i++)
+        addResult(added.objA[i],added.objB[i]);
+
+    updating.stop();
+
+    if (verbose)
+        std::cout << "Update of " << updatedObjects << " objects: " << changed.size() << " re-probed, "
+                  << dirtyNodes << " dirty nodes, +" << added.results << " -" << removed.results
+                  << " pairs in " << updating << std::endl;
+}
+
+void IncrementalTOUCH::attach(TreeEntry* obj)
+{
+    TreeNode* node = assignObject(obj);
+    assignedTo[obj] = node;
+    if (node != NULL)
+        slots[obj].inNode = node->attachedObjs[1].size()-1;
+}
+
+void IncrementalTOUCH::detach(TreeEntry* obj)
+{
+    TreeNode* node = assignedTo[obj];
+    if (node == NULL)
+    {
+        filtered[1]--;
+        return;
+    }
+    SpatialObjectList& list = node->attachedObjs[1];
+    FLAT::uint64 slot = slots[obj].inNode;
+    list[slot] = list.back();
+    slots[list[slot]].inNode = slot;
+    list.pop_back();
+    assignedTo[obj] = NULL;
+}
+
+// takes obj out of dsB, the last entry moves into its place
+void IncrementalTOUCH::removeFromB(TreeEntry* obj)
+{
+    SlotMap::iterator it = slots.find(obj);
+    FLAT::uint64 slot = it->second.inB;
+    slots.erase(it);
+    dsB[slot] = dsB.back();
+    if (dsB[slot] != obj)
+        slots[dsB[slot]].inB = slot;
+    dsB.pop_back();
+}
+
+void IncrementalTOUCH::addResult(TreeEntry* objA, TreeEntry* objB)
+{
+    if (resultPairs.storesPairs())
+        pairSlots[ResultPair(objA,objB)] = resultPairs.objA.size();
+    resultPairs.addPair(objA,objB);
+}
+
+void IncrementalTOUCH::removeResult(TreeEntry* objA, TreeEntry* objB)
+{
+    resultPairs.results--;
+    switch (resultPairs.mode)
+    {
+        case result_Pairs:
+        {
+            PairSlotMap::iterator it = pairSlots.find(ResultPair(objA,objB));
+            FLAT::uint64 slot = it->second;
+            pairSlots.erase(it);
+            FLAT::uint64 last = resultPairs.objA.size()-1;
+            if (slot != last)
+            {
+                resultPairs.objA[slot] = resultPairs.objA[last];
+                resultPairs.objB[slot] = resultPairs.objB[last];
+                pairSlots[ResultPair(resultPairs.objA[slot],resultPairs.objB[slot])] = slot;
+            }
+            resultPairs.objA.pop_back();
+            resultPairs.objB.pop_back();
+            break;
+        }
+        case result_Degree:
+            resultPairs.degree[objA->id]--;
+            break;
+    }
+}
+
+/*
+ * Join obj with the A objects in the leaves below node, descending only
+ * into children that overlap obj.
+ */
+void IncrementalTOUCH::probeObject(TreeEntry* obj, TreeNode* node, SpatialObjectList& found)
+{
+    std::queue<TreeNode*> nodes;
+    NodeList leaves;
+    leavesBelow(node,obj->mbr,nodes,leaves,&addFilter);
+    for (NodeList::iterator leaf = leaves.begin(); leaf != leaves.end(); leaf++)
+    {
+        ItemsMaxCompared += (*leaf)->attachedObjs[0].size();
+        for (SpatialObjectList::iterator it = (*leaf)->attachedObjs[0].begin();
+                                        it != (*leaf)->attachedObjs[0].end(); it++)
+            if (istouching(obj,(*it)))
+                found.push_back((*it));
+    }
+}
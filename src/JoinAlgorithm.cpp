@@ -7,6 +7,8 @@
 
 #include "JoinAlgorithm.h"
 
+#include <sstream>
+
 JoinAlgorithm::JoinAlgorithm() {
     hashprobe               = 0;
     footprint               = 0;
@@ -28,6 +30,16 @@ JoinAlgorithm::JoinAlgorithm() {
     treeTraversal           = 1;
     swapMem                 = 0;
     ramMem                  = 0;
+    perfCounters            = false;
+    memoryUsage             = false;
+    memEntries              = 0;
+    memNodes                = 0;
+    memGrids                = 0;
+    memResults              = 0;
+    Levels                  = 0;
+    LevelsD                 = 0;
+    loadedA                 = false;
+    loadedB                 = false;
     
     verbose                 =  true;
     
@@ -45,31 +57,72 @@ JoinAlgorithm::JoinAlgorithm() {
 
 
 
-void JoinAlgorithm::saveLog() {
-    
-    bool headers;
-    headers = ( access( logfilename.c_str(), F_OK ) == -1 );
-    
-    ofstream fout(logfilename.c_str(),ios_base::app);
-    
-    /*
-     * If there is file - append
-     * If not - create and (probably?) create headers
-     */
-    if (headers)
-    {
-        fout << "Algorithm, Epsilon, #A, #B, infile A, infile B, LocalJoin Alg, Fanout, Leaf size, gridSize, " // common parameters
+// the columns of the log, in the order saveLog writes them
+static std::string logHeader()
+{
+    std::stringstream header;
+    header << "Algorithm, Epsilon, #A, #B, infile A, infile B, LocalJoin Alg, Fanout, Leaf size, gridSize, " // common parameters
         << "Compared #, Compared %, ComparedMax, Duplicates, Results, Selectivity, filtered A, filtered B," // TOUCH
         << "t loading, t init, t build, t probe, t comparing, t partition, t total, t deDuplicating, t analyzing, t sorting, t gridCalculate, t sizeCalculate,"
-        << "EmptyCells(%), MaxObj, AveObj, StdObj, repA, repB, max level, gridP robe, tree height A, tree height B, Memory SwapFile, Memory RAM, Memory Clear, addFilter"
+        << "EmptyCells(%), MaxObj, AveObj, StdObj, repA, repB, max level, gridP robe, tree height A, tree height B, Memory SwapFile, Memory RAM, Memory Clear, addFilter,"
         << "l0 assigned, l1 assigned, l2 assigned, l3 assigned, l4 assigned, l5 assigned, l6 assigned, l7 assigned, l8 assigned, l9 assigned,"
         << "l0 assigned B, l1 assigned B, l2 assigned B, l3 assigned B, l4 assigned B, l5 assigned B, l6 assigned B, l7 assigned B, l8 assigned B, l9 assigned B,"
         << "l0 avg, l1 avg, l2 avg, l3 avg, l4 avg, l5 avg, l6 avg, l7 avg, l8 avg, l9 avg,"
         << "l0 avg B, l1 avg B, l2 avg B, l3 avg B, l4 avg B, l5 avg B, l6 avg B, l7 avg B, l8 avg B, l9 avg B,"
         << "l0 std, l1 std, l2 std, l3 std, l4 std, l5 std, l6 std, l7 std, l8 std, l9 std, "
-        << "l0 std B, l1 std B, l2 std B, l3 std B, l4 std B, l5 std B, l6 std B, l7 std B, l8 std B, l9 std B"
-        << "\n";
+        << "l0 std B, l1 std B, l2 std B, l3 std B, l4 std B, l5 std B, l6 std B, l7 std B, l8 std B, l9 std B, "
+        << FLAT::PerfCounters::header("building") << ", " << FLAT::PerfCounters::header("probing") << ", "
+        << FLAT::PerfCounters::header("sorting") << ", "
+        << FLAT::PerfCounters::header("partition") << ", "
+        << FLAT::MemoryUsage::header("loading") << ", " << FLAT::MemoryUsage::header("partition") << ", "
+        << FLAT::MemoryUsage::header("building") << ", " << FLAT::MemoryUsage::header("probing") << ", "
+        << "mem entries(B), mem nodes(B), mem grids(B), mem results(B)";
+    return header.str();
+}
+
+void JoinAlgorithm::saveLog() {
+    
+    std::string header = logHeader();
+    std::string columns;
+    bool headers;
+    {
+        ifstream fin(logfilename.c_str());
+        headers = !fin.good();
+        if (!headers) getline(fin,columns);
     }
+    
+    /*
+     * If there is file with the same columns - append
+     * If not - create with headers. A log with other columns (of an older
+     * build) is kept aside as <log>.1, <log>.2, ... so that no row is
+     * appended under the wrong header
+     */
+    if (!headers && columns != header)
+    {
+        std::string old;
+        int version = 1;
+        do
+        {
+            std::stringstream name;
+            name << logfilename << "." << version++;
+            old = name.str();
+        } while (access( old.c_str(), F_OK ) != -1);
+        if (rename(logfilename.c_str(),old.c_str()) == 0)
+        {
+            if (verbose) std::cout << "The columns of " << logfilename << " changed, the old log is now " << old << std::endl;
+            headers = true;
+        }
+        else
+        {
+            std::cout << "Cannot move " << logfilename << " aside, its columns differ: the log is not saved" << std::endl;
+            return;
+        }
+    }
+    
+    ofstream fout(logfilename.c_str(),ios_base::app);
+    
+    if (headers)
+        fout << header << "\n";
     //check if file exists
     
     FLAT::Timer t;
@@ -127,6 +180,13 @@ void JoinAlgorithm::saveLog() {
     for (int t = 0; t < TYPES; t++)
         for (int i = 0; i < 10; i++)
             fout << levelStd[t][i] << ",";
+
+    // empty if the counters are not enabled or available
+    fout << buildingCounters << "," << probingCounters << ","
+         << sortingCounters << "," << partitionCounters << ",";
+    
+    fout << loadingMemory << "," << partitionMemory << "," << buildingMemory << "," << probingMemory << ","
+         << memEntries << "," << memNodes << "," << memGrids << "," << memResults;
     
             fout << "\n";
 
@@ -134,44 +194,200 @@ void JoinAlgorithm::saveLog() {
 
 JoinAlgorithm::~JoinAlgorithm() {}
 
+// a JSON string, file names may hold quotes and backslashes
+static std::string jsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (std::string::const_iterator c = text.begin(); c != text.end(); c++)
+    {
+        if (*c == '"' || *c == '\\') quoted += '\\';
+        quoted += *c;
+    }
+    return quoted + "\"";
+}
+
+bool JoinAlgorithm::saveMetrics(std::string filename)
+{
+    ofstream fout(filename.c_str());
+    if (!fout.good())
+    {
+        std::cout << "Cannot create metrics file " << filename << std::endl;
+        return false;
+    }
+    
+    fout << "{\"algorithm\":" << jsonString(algoname()) << ",\"localJoin\":" << jsonString(basealgo())
+         << ",\"epsilon\":" << epsilon << ",\"A\":" << size_dsA << ",\"B\":" << size_dsB
+         << ",\"fileA\":" << jsonString(file_dsA) << ",\"fileB\":" << jsonString(file_dsB) << ",\n"
+         << "\"results\":" << resultPairs.results << ",\"duplicates\":" << resultPairs.duplicates
+         << ",\"compared\":" << ItemsCompared << ",\"comparedMax\":" << ItemsMaxCompared
+         << ",\"filtered\":[" << filtered[0] << "," << filtered[1] << "],\n"
+         << "\"seconds\":{\"total\":" << total << ",\"loading\":" << dataLoad << ",\"init\":" << initialize
+         << ",\"build\":" << building << ",\"probe\":" << probing << ",\"comparing\":" << comparing
+         << ",\"partition\":" << partition << ",\"sorting\":" << sorting << ",\"gridCalculate\":" << gridCalculate
+         << ",\"deDuplicating\":" << resultPairs.deDuplicateTime << "},\n"
+         << "\"bytes\":{\"entries\":" << memEntries << ",\"nodes\":" << memNodes
+         << ",\"grids\":" << memGrids << ",\"results\":" << memResults << "}";
+    if (memoryUsage)
+    {
+        FLAT::MemoryUsage* phases[4] = {&loadingMemory, &partitionMemory, &buildingMemory, &probingMemory};
+        const char* names[4] = {"loading", "partition", "build", "probe"};
+        fout << ",\n\"residentKB\":{";
+        for (int i = 0; i < 4; i++)
+            fout << (i > 0 ? "," : "") << "\"" << names[i] << "\":{\"peak\":" << phases[i]->peak
+                 << ",\"growth\":" << phases[i]->growth << "}";
+        fout << "}";
+    }
+    writeMetrics(fout);
+    fout << "}\n";
+    fout.close();
+    
+    if (fout.fail())
+    {
+        std::cout << "Cannot write metrics to " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void JoinAlgorithm::writeHistogram(std::ostream& out, const std::vector<FLAT::uint64>& values)
+{
+    FLAT::uint64 sum = 0, max = 0;
+    std::vector<FLAT::uint64> buckets;
+    for (std::vector<FLAT::uint64>::const_iterator it = values.begin(); it != values.end(); it++)
+    {
+        unsigned int bucket = 0;
+        for (FLAT::uint64 v = *it; v > 0; v >>= 1)
+            bucket++;
+        if (bucket >= buckets.size())
+            buckets.resize(bucket+1,0);
+        buckets[bucket]++;
+        sum += *it;
+        if (*it > max) max = *it;
+    }
+    
+    out << "{\"count\":" << values.size() << ",\"sum\":" << sum << ",\"max\":" << max
+        << ",\"mean\":" << (values.empty() ? 0 : (double)sum/values.size()) << ",\"log2\":[";
+    for (unsigned int i = 0; i < buckets.size(); i++)
+        out << (i > 0 ? "," : "") << buckets[i];
+    out << "]}";
+}
+
+void JoinAlgorithm::writeCells(std::ostream& out, HashTable& table, FLAT::uint64 first, FLAT::uint64 last)
+{
+    std::vector<FLAT::uint64> objects;
+    for (HashTable::iterator it = table.begin(); it != table.end(); ++it)
+        if (it->first >= first && it->first < last)
+            objects.push_back(it->second->size());
+    
+    out << "{\"cells\":" << last-first << ",\"used\":" << objects.size() << ",\"objects\":";
+    writeHistogram(out,objects);
+    out << "}";
+}
+
+/*
+ * Sample the hardware counters with the building, probing, sorting and
+ * partition timers, once per phase. The comparing timer runs per object
+ * and node inside probing and stays a plain timer. Returns false (and the
+ * phases are only timed) if no counter is available.
+ */
+bool JoinAlgorithm::enablePerfCounters()
+{
+    perfCounters = FLAT::PerfCounters::open();
+    if (!perfCounters)
+        return false;
+    building._counters = &buildingCounters;
+    probing._counters = &probingCounters;
+    sorting._counters = &sortingCounters;
+    partition._counters = &partitionCounters;
+    return true;
+}
+
+/*
+ * Sample the resident memory with the loading, partition, building and
+ * probing timers.
+ */
+void JoinAlgorithm::enableMemoryUsage()
+{
+    memoryUsage = true;
+    dataLoad._memory = &loadingMemory;
+    partition._memory = &partitionMemory;
+    building._memory = &buildingMemory;
+    probing._memory = &probingMemory;
+}
+
+/*
+ * Bytes of a hash table of cells: the buckets, a node per cell and the
+ * lists of objects.
+ */
+FLAT::uint64 JoinAlgorithm::tableBytes(HashTable& table)
+{
+    FLAT::uint64 bytes = table.bucket_count()*sizeof(void*)
+                       + table.size()*(sizeof(ValuePair) + sizeof(void*) + sizeof(HashValue));
+    for (HashTable::iterator it = table.begin(); it != table.end(); ++it)
+        bytes += it->second->capacity()*sizeof(TreeEntry*);
+    return bytes;
+}
+
+/*
+ * Count the bytes of the entries and results after the run. The
+ * algorithms count their nodes and grids before calling this. The
+ * geometry of an object is taken as its serialized size plus the virtual
+ * table pointer.
+ */
+void JoinAlgorithm::countMemory()
+{
+    memEntries = (dsA.capacity() + dsB.capacity() + vdsA.capacity() + vdsB.capacity() + vdsAll.capacity())
+                 * sizeof(TreeEntry*);
+    SpatialObjectList* lists[2] = {&dsA, &dsB};
+    for (int l = 0; l < 2; l++)
+        for (SpatialObjectList::iterator it = lists[l]->begin(); it != lists[l]->end(); ++it)
+            memEntries += sizeof(TreeEntry) + (*it)->obj->getSize() + sizeof(void*);
+    
+    memResults = (resultPairs.objA.capacity() + resultPairs.objB.capacity())*sizeof(TreeEntry*)
+                 + degrees.capacity()*sizeof(FLAT::uint64);
+    
+    footprint = memEntries + memNodes + memGrids + memResults;
+}
+
 void JoinAlgorithm::readBinaryInput(string in_dsA, string in_dsB) {
     
     if (verbose) std::cout << "Start reading the datasets" << std::endl;
 
+    readBinaryInputA(in_dsA);
+    readBinaryInputB(in_dsB);
+
+    if (verbose) std::cout << "Reading Completed." << std::endl;
+
+}
+
+void JoinAlgorithm::readBinaryInputA(string in_dsA) {
+
+    if (loadedA)
+    {
+        initDegrees();
+        return;
+    }
     file_dsA = in_dsA;
-    file_dsB = in_dsB;
 
     FLAT::DataFileReader *inputA = new FLAT::DataFileReader(file_dsA);
-    FLAT::DataFileReader *inputB = new FLAT::DataFileReader(file_dsB);
     
-    if (verbose)
-    {
-        inputA->information();
-        inputB->information();
-    }
+    if (verbose) inputA->information();
 
     TreeEntry* newEntry;
 
+    TRACE_SCOPE("load A");
     dataLoad.start();
 
     size_dsA = (numA < inputA->objectCount && (numA != 0))?numA:inputA->objectCount;
-    size_dsB = (numB < inputB->objectCount && (numB != 0))?numB:inputB->objectCount;
     
     if (verbose)
-    {
         std::cout << "size of A:" << size_dsA << "# from " << inputA->objectCount << "# " 
                         << size_dsA*sizeof(SpatialObjectList) / 1000.0 << "KB" << std::endl;
-        std::cout << "size of B:" << size_dsB << "# from " << inputB->objectCount << "# " 
-                        << size_dsB*sizeof(SpatialObjectList) / 1000.0 << "KB" << std::endl;
-    }
     
-    FLAT::Box mbr;
     for (int i=0;i<DIMENSION;i++)
     {
         universeA.low.Vector[i] = std::numeric_limits<FLAT::spaceUnit>::max();
         universeA.high.Vector[i] = std::numeric_limits<FLAT::spaceUnit>::min();
-        universeB.low.Vector[i] = std::numeric_limits<FLAT::spaceUnit>::max();
-        universeB.high.Vector[i] = std::numeric_limits<FLAT::spaceUnit>::min();
     }
     FLAT::SpatialObject* sobj;
 
@@ -192,6 +408,41 @@ void JoinAlgorithm::readBinaryInput(string in_dsA, string in_dsB) {
         dsA.push_back(newEntry);
         vdsAll.push_back(newEntry);
     }
+    
+    universeA.isEmpty = false;
+    FLAT::Box::expand(universeA,epsilon);
+
+    dataLoad.stop();
+    delete inputA;
+    initDegrees();
+}
+
+void JoinAlgorithm::readBinaryInputB(string in_dsB) {
+
+    if (loadedB) return;
+    file_dsB = in_dsB;
+
+    FLAT::DataFileReader *inputB = new FLAT::DataFileReader(file_dsB);
+    
+    if (verbose) inputB->information();
+
+    TreeEntry* newEntry;
+
+    TRACE_SCOPE("load B");
+    dataLoad.start();
+
+    size_dsB = (numB < inputB->objectCount && (numB != 0))?numB:inputB->objectCount;
+    
+    if (verbose)
+        std::cout << "size of B:" << size_dsB << "# from " << inputB->objectCount << "# " 
+                        << size_dsB*sizeof(SpatialObjectList) / 1000.0 << "KB" << std::endl;
+    
+    for (int i=0;i<DIMENSION;i++)
+    {
+        universeB.low.Vector[i] = std::numeric_limits<FLAT::spaceUnit>::max();
+        universeB.high.Vector[i] = std::numeric_limits<FLAT::spaceUnit>::min();
+    }
+    FLAT::SpatialObject* sobj;
 
     dsB.reserve(size_dsB);
     numB = size_dsB;
@@ -209,19 +460,57 @@ void JoinAlgorithm::readBinaryInput(string in_dsA, string in_dsB) {
         vdsAll.push_back(newEntry);
     }
     
-    universeA.isEmpty = false;
     universeB.isEmpty = false;
-    FLAT::Box::expand(universeA,epsilon);
     FLAT::Box::expand(universeB,epsilon);
 
     dataLoad.stop();
+    delete inputB;
+}
 
-    if (verbose) std::cout << "Reading Completed." << std::endl;
-
+/*
+ * The entries are only read by the joins, so several runs can share them.
+ * The owner of the loaded instance deletes them after the last run.
+ */
+void JoinAlgorithm::useDatasets(JoinAlgorithm* loaded)
+{
+    file_dsA    = loaded->file_dsA;
+    file_dsB    = loaded->file_dsB;
+    dsA         = loaded->dsA;
+    dsB         = loaded->dsB;
+    vdsA        = loaded->vdsA;
+    vdsB        = loaded->vdsB;
+    vdsAll      = loaded->vdsAll;
+    universeA   = loaded->universeA;
+    universeB   = loaded->universeB;
+    size_dsA    = loaded->size_dsA;
+    size_dsB    = loaded->size_dsB;
+    loadedA     = true;
+    loadedB     = true;
 }
 
 
 
+/*
+ * Dense partner counters for result_Degree, one per A object (ids 0..size_dsA-1)
+ */
+void JoinAlgorithm::initDegrees()
+{
+    if (resultPairs.mode != result_Degree) return;
+    degrees.assign(size_dsA,0);
+    resultPairs.degree = (size_dsA > 0) ? &degrees[0] : NULL;
+}
+
+// one line "id,partners" per A object
+void JoinAlgorithm::saveDegrees(std::string filename)
+{
+    ofstream fout(filename.c_str());
+    for (FLAT::uint64 i = 0; i < degrees.size(); i++)
+        fout << i << "," << degrees[i] << "\n";
+    fout.close();
+    if (fout.fail())
+        std::cout << "Cannot write degrees to " << filename << std::endl;
+}
+
 void JoinAlgorithm::print()
 {
     double avgs[TYPES];
@@ -262,7 +551,26 @@ void JoinAlgorithm::print()
             << "Times: total " << total << '\n'
             << " loading " << dataLoad << " init " << initialize	<< " build " << building << " probe " << probing << '\n'
             << " comparing " << comparing << " partition " << partition	<< '\n'
-            << " deDuplicating " << resultPairs.deDuplicateTime	<< " analyzing " << analyzing << " sorting " << sorting << '\n'
+            << " deDuplicating " << resultPairs.deDuplicateTime	<< " analyzing " << analyzing << " sorting " << sorting << '\n';
+            if (perfCounters)
+            {
+                std::cout << "Counters (cycles, instructions, LLC misses, branch misses, dTLB misses)\n"
+                << " build " << buildingCounters << '\n'
+                << " probe " << probingCounters << '\n'
+                << " sorting " << sortingCounters << '\n'
+                << " partition " << partitionCounters << '\n';
+            }
+            if (memoryUsage)
+            {
+                std::cout << "Memory (peak RSS KB, RSS growth KB)\n"
+                << " loading " << loadingMemory << '\n'
+                << " partition " << partitionMemory << '\n'
+                << " build " << buildingMemory << '\n'
+                << " probe " << probingMemory << '\n';
+            }
+            std::cout
+            << "Structures(KB): entries " << memEntries/1024 << " nodes " << memNodes/1024
+            << " grids " << memGrids/1024 << " results " << memResults/1024 << '\n'
             << "Partitions " << partitions << " epsilon " << epsilon << " Fanout " << nodesize << '\n'
             << "Avg size: " << avgs[0] << " and " << avgs[1] << " ; "
             << "Std size: " << stds[0] << " and " << stds[1]
@@ -0,0 +1,361 @@
+/*
+ * File:   JoinEstimator.cpp
+ *
+ */
+
+#include "JoinEstimator.h"
+
+#include <cmath>
+#include <map>
+
+#define PBSM_RESOLUTION                 100     // as in PBSMHash::run
+
+JoinEstimator::JoinEstimator(JoinAlgorithm* loaded) {
+    join = loaded;
+    maxSample = 100000;
+    maxResolution = 64;
+    gridResolution = 100;
+    leafsize = 100;
+    localJoin = algo_SGrid;
+    pairs = 0;
+    selectivity = 0;
+    for (int a = 0; a < ESTIMATED_ALGORITHMS; a++)
+    {
+        compared[a] = 0;
+        cost[a] = 0;
+    }
+}
+
+FLAT::uint64 JoinEstimator::cellIndex(const FLAT::Vertex& v)
+{
+    FLAT::uint64 index = 0;
+    for (int d = DIMENSION-1; d >= 0; d--)
+    {
+        int c = (int)floor((v[d] - universe.low[d]) / cellWidth[d]);
+        if (c < 0) c = 0;
+        if (c >= resolution[d]) c = resolution[d]-1;
+        index = index*resolution[d] + c;
+    }
+    return index;
+}
+
+void JoinEstimator::averageExtents(SpatialObjectList& ds, Histogram& hist)
+{
+    FLAT::uint64 stride = (maxSample == 0 || ds.size() <= maxSample) ? 1 : ds.size()/maxSample;
+    FLAT::uint64 sampled = 0;
+    for (int d = 0; d < DIMENSION; d++)
+        hist.average[d] = 0;
+    for (FLAT::uint64 i = 0; i < ds.size(); i += stride)
+    {
+        for (int d = 0; d < DIMENSION; d++)
+            hist.average[d] += ds[i]->mbr.high[d] - ds[i]->mbr.low[d];
+        sampled++;
+    }
+    if (sampled > 0)
+        for (int d = 0; d < DIMENSION; d++)
+            hist.average[d] /= sampled;
+}
+
+// every sampled object weighs for the objects left out
+void JoinEstimator::fill(SpatialObjectList& ds, Histogram& hist)
+{
+    FLAT::uint64 cells = (FLAT::uint64)resolution[0]*resolution[1]*resolution[2];
+    hist.count.assign(cells,0);
+    for (int d = 0; d < DIMENSION; d++)
+        hist.extent[d].assign(cells,0);
+
+    FLAT::uint64 stride = (maxSample == 0 || ds.size() <= maxSample) ? 1 : ds.size()/maxSample;
+    double weight = (double)stride;
+    for (FLAT::uint64 i = 0; i < ds.size(); i += stride)
+    {
+        FLAT::uint64 cell = cellIndex(ds[i]->mbr.getCenter());
+        hist.count[cell] += weight;
+        for (int d = 0; d < DIMENSION; d++)
+            hist.extent[d][cell] += weight*(ds[i]->mbr.high[d] - ds[i]->mbr.low[d]);
+    }
+}
+
+/*
+ * Pairs of A and B within width[d] of each other in every dimension:
+ * B objects around every A object with the density of B in the cell.
+ */
+double JoinEstimator::candidates(const double width[DIMENSION])
+{
+    double sum = 0;
+    for (FLAT::uint64 c = 0; c < histA.count.size(); c++)
+    {
+        if (histA.count[c] == 0 || histB.count[c] == 0) continue;
+        double p = 1;
+        for (int d = 0; d < DIMENSION; d++)
+            p *= std::min((double)resolution[d],
+                          (histA.extent[d][c]/histA.count[c] + histB.extent[d][c]/histB.count[c] + width[d]) / cellWidth[d]);
+        sum += histA.count[c]*histB.count[c]*p;
+    }
+    return std::min(sum,sizeA*sizeB);
+}
+
+/*
+ * Pairs within epsilon: B objects around every A object in the volume of
+ * their raw boxes (side s = a+b) grown by a ball of radius epsilon, as the
+ * test measures the distance of the corners (Steiner formula).
+ */
+double JoinEstimator::results()
+{
+    double r = join->epsilon;
+    double cellVolume = cellWidth[0]*cellWidth[1]*cellWidth[2];
+    double sum = 0;
+    for (FLAT::uint64 c = 0; c < histA.count.size(); c++)
+    {
+        if (histA.count[c] == 0 || histB.count[c] == 0) continue;
+        double s[DIMENSION];
+        for (int d = 0; d < DIMENSION; d++)
+            s[d] = std::max(0.0, histA.extent[d][c]/histA.count[c] + histB.extent[d][c]/histB.count[c] - 2*r);
+        double volume = s[0]*s[1]*s[2]
+                      + 2*r*(s[0]*s[1] + s[1]*s[2] + s[0]*s[2])
+                      + M_PI*r*r*(s[0] + s[1] + s[2])
+                      + 4./3.*M_PI*r*r*r;
+        sum += histA.count[c]*histB.count[c]*std::min(1.0,volume/cellVolume);
+    }
+    return std::min(sum,sizeA*sizeB);
+}
+
+/*
+ * Grids that store an object in every cell it overlaps compare a pair once
+ * per cell the two share: (a+w)(b+w)/w along a dimension for cells of w,
+ * where the grid grows the objects by another grow on every side.
+ */
+double JoinEstimator::candidatesShared(const double width[DIMENSION], double grow)
+{
+    double sum = 0;
+    for (FLAT::uint64 c = 0; c < histA.count.size(); c++)
+    {
+        if (histA.count[c] == 0 || histB.count[c] == 0) continue;
+        double p = 1;
+        for (int d = 0; d < DIMENSION; d++)
+            p *= std::min((double)resolution[d]*cellWidth[d]/width[d],
+                          (histA.extent[d][c]/histA.count[c] + 2*grow + width[d])
+                        * (histB.extent[d][c]/histB.count[c] + 2*grow + width[d]) / (width[d]*cellWidth[d]));
+        sum += histA.count[c]*histB.count[c]*p;
+    }
+    return sum;
+}
+
+/*
+ * S3: an object lives in the deepest level whose 2^l-1 inner borders per
+ * dimension miss it and is
+ * compared to the objects of the cells above and below its own: a pair
+ * meets when the coarser of the two cells encloses the finer one.
+ */
+void JoinEstimator::levelShares(const double extent[DIMENSION], double share[S3_LEVELS])
+{
+    double deeper = 0;      // fits into a cell of the next level
+    for (int l = S3_LEVELS-1; l >= 0; l--)
+    {
+        double fits = 1;
+        for (int d = 0; d < DIMENSION; d++)
+            fits *= std::max(0.0, 1 - extent[d]*(pow(2.0,l)-1)/(universe.high[d]-universe.low[d]));
+        share[l] = std::max(0.0, fits - deeper);
+        deeper = std::max(fits,deeper);
+    }
+}
+
+// pairs of A and B in the same cell of a level, 2^level cells per dimension
+double JoinEstimator::pairsInCells(int level)
+{
+    double cells = pow(2.0,level);
+    bool finer = false;
+    for (int d = 0; d < DIMENSION; d++)
+        finer |= cells > resolution[d];
+
+    if (finer)
+    {
+        double share = 1;       // of a histogram cell taken by a cell of the level
+        for (int d = 0; d < DIMENSION; d++)
+            share *= std::min(1.0, (universe.high[d]-universe.low[d])/cells/cellWidth[d]);
+        double sum = 0;
+        for (FLAT::uint64 c = 0; c < histA.count.size(); c++)
+            sum += histA.count[c]*histB.count[c]*share;
+        return sum;
+    }
+
+    std::map<FLAT::uint64,double> countA, countB;
+    for (FLAT::uint64 c = 0; c < histA.count.size(); c++)
+    {
+        if (histA.count[c] == 0 && histB.count[c] == 0) continue;
+        FLAT::uint64 rest = c, index = 0, scale = 1;
+        for (int d = 0; d < DIMENSION; d++)
+        {
+            index += scale*(FLAT::uint64)((rest % resolution[d] + 0.5)*cells/resolution[d]);
+            rest /= resolution[d];
+            scale *= (FLAT::uint64)cells;
+        }
+        countA[index] += histA.count[c];
+        countB[index] += histB.count[c];
+    }
+    double sum = 0;
+    for (std::map<FLAT::uint64,double>::iterator it = countA.begin(); it != countA.end(); ++it)
+        sum += it->second*countB[it->first];
+    return sum;
+}
+
+double JoinEstimator::candidatesLevels()
+{
+    double shareA[S3_LEVELS], shareB[S3_LEVELS], pairs[S3_LEVELS];
+    levelShares(histA.average,shareA);
+    levelShares(histB.average,shareB);
+    for (int l = 0; l < S3_LEVELS; l++)
+        pairs[l] = pairsInCells(l);
+
+    double sum = 0;
+    for (int la = 0; la < S3_LEVELS; la++)
+        for (int lb = 0; lb < S3_LEVELS; lb++)
+            sum += shareA[la]*shareB[lb]*pairs[std::min(la,lb)];
+    return std::min(sum,sizeA*sizeB);
+}
+
+// PS: the pairs overlapping along the sweep axis x
+double JoinEstimator::candidatesX()
+{
+    std::vector<double> countA(resolution[0],0), countB(resolution[0],0);
+    std::vector<double> extentA(resolution[0],0), extentB(resolution[0],0);
+    for (FLAT::uint64 c = 0; c < histA.count.size(); c++)
+    {
+        int x = c % resolution[0];
+        countA[x] += histA.count[c];
+        countB[x] += histB.count[c];
+        extentA[x] += histA.extent[0][c];
+        extentB[x] += histB.extent[0][c];
+    }
+    double sum = 0;
+    for (int x = 0; x < resolution[0]; x++)
+        if (countA[x] > 0 && countB[x] > 0)
+            sum += countA[x]*countB[x]*(extentA[x]/countA[x] + extentB[x]/countB[x])/cellWidth[0];
+    return std::min(sum,sizeA*sizeB);
+}
+
+/*
+ * TOUCH with NL: a B object descends while it fits into one child and is
+ * compared to all A objects below its node. Nodes at level l hold
+ * leafsize*2^l objects of A in a cube of the local density of A. Children
+ * that overlap (e.g. upper levels sorted by center) keep more objects high
+ * up than this.
+ */
+double JoinEstimator::candidatesLeaves()
+{
+    double cellVolume = cellWidth[0]*cellWidth[1]*cellWidth[2];
+    int levels = 1;
+    while (leafsize*pow(2.0,levels-1) < sizeA) levels++;
+
+    double sum = 0;
+    for (FLAT::uint64 c = 0; c < histA.count.size(); c++)
+    {
+        if (histA.count[c] == 0 || histB.count[c] == 0) continue;
+        double density = histA.count[c]/cellVolume;
+
+        double below = 0;       // A objects below the node of a B object
+        double reach = 1;       // probability that it gets to the level
+        for (int l = levels-1; l >= 0; l--)
+        {
+            double objects = std::min(sizeA,leafsize*pow(2.0,l));
+            double fits = 0;
+            if (l > 0)
+            {
+                double child = pow(objects/2/density,1./3.);
+                fits = 1;
+                for (int d = 0; d < DIMENSION; d++)
+                    fits *= std::max(0.0, 1 - (histB.extent[d][c]/histB.count[c] + histA.extent[d][c]/histA.count[c]) / child);
+            }
+            below += reach*(1-fits)*objects;
+            reach *= fits;
+        }
+        sum += histB.count[c]*below;
+    }
+    return std::min(sum,sizeA*sizeB);
+}
+
+// objects stored in every grid cell they overlap
+double JoinEstimator::replicas(double objects, const double extent[DIMENSION], double cells)
+{
+    double copies = objects;
+    for (int d = 0; d < DIMENSION; d++)
+        copies *= 1 + extent[d]*cells/(universe.high[d]-universe.low[d]);
+    return copies;
+}
+
+void JoinEstimator::estimate()
+{
+    TRACE_SCOPE("estimate");
+    sizeA = join->dsA.size();
+    sizeB = join->dsB.size();
+    universe = FLAT::Box::combineSafe(join->universeA,join->universeB);
+
+    // cells about as wide as a pair of objects, at most maxResolution
+    averageExtents(join->dsA,histA);
+    averageExtents(join->dsB,histB);
+    for (int d = 0; d < DIMENSION; d++)
+    {
+        double length = universe.high[d]-universe.low[d];
+        double objects = histA.average[d]+histB.average[d];
+        resolution[d] = (objects > 0) ? (int)std::min((double)maxResolution,length/objects) : maxResolution;
+        if (resolution[d] < 1) resolution[d] = 1;
+        cellWidth[d] = length/resolution[d];
+    }
+    fill(join->dsA,histA);
+    fill(join->dsB,histB);
+
+    double grid[DIMENSION], pbsm[DIMENSION], local[DIMENSION];
+    for (int d = 0; d < DIMENSION; d++)
+    {
+        double length = universe.high[d]-universe.low[d];
+        grid[d] = length/gridResolution;
+        pbsm[d] = length/PBSM_RESOLUTION;
+        local[d] = histA.average[d];        // flexible local grids: mean object length
+    }
+
+    pairs = results();
+    selectivity = 100.0*pairs/(sizeA*sizeB);
+
+    double n = sizeA+sizeB;
+    compared[algo_NL] = sizeA*sizeB;
+    cost[algo_NL] = compared[algo_NL];
+
+    compared[algo_PS] = candidatesX();
+    cost[algo_PS] = compared[algo_PS] + n*log2(std::max(2.0,n));
+
+    compared[algo_SGrid] = candidatesShared(grid,0);
+    cost[algo_SGrid] = compared[algo_SGrid] + replicas(sizeA,histA.average,gridResolution)
+                     + replicas(sizeB,histB.average,gridResolution);
+
+    compared[algo_PBSM] = candidatesShared(pbsm,join->epsilon/2);  // expands the entries again
+    cost[algo_PBSM] = compared[algo_PBSM] + replicas(sizeA,histA.average,PBSM_RESOLUTION)
+                    + replicas(sizeB,histB.average,PBSM_RESOLUTION);
+
+    compared[algo_S3] = candidatesLevels();
+    cost[algo_S3] = compared[algo_S3] + n*S3_LEVELS;
+
+    compared[algo_TOUCH] = candidatesLeaves();
+    if (localJoin == algo_SGrid)
+        compared[algo_TOUCH] = std::min(compared[algo_TOUCH],candidates(local));
+    cost[algo_TOUCH] = compared[algo_TOUCH] + n*log2(std::max(2.0,sizeA/leafsize));
+}
+
+int JoinEstimator::best()
+{
+    int best = algo_NL;
+    for (int a = 0; a < ESTIMATED_ALGORITHMS; a++)
+        if (cost[a] < cost[best])
+            best = a;
+    return best;
+}
+
+void JoinEstimator::print()
+{
+    std::cout << "Estimate for #A " << (FLAT::uint64)sizeA << " #B " << (FLAT::uint64)sizeB
+              << " epsilon " << join->epsilon << " on a " << resolution[0] << "x" << resolution[1] << "x"
+              << resolution[2] << " histogram\n"
+              << "Results " << (FLAT::uint64)pairs << " Selectivity " << selectivity << '\n';
+    for (int a = 0; a < ESTIMATED_ALGORITHMS; a++)
+        std::cout << " " << join->getAlgName(a) << ": compared " << (FLAT::uint64)compared[a]
+                  << " cost " << (FLAT::uint64)cost[a] << '\n';
+    std::cout << "Best " << join->getAlgName(best()) << std::endl;
+}
@@ -110,7 +110,7 @@ void LocalSpatialGridHash::probe(TreeEntry*& obj)
                 if (it==gridHashTable.end()) continue;
                 HashValue* soList = it->second;
                 for (HashValue::const_iterator k=soList->begin(); k!=soList->end(); ++k)
-                        if ( istouching( obj , *k) )
+                        if ( (resultPairs.storesPairs() || isReferenceCell( obj , *k , *j )) && istouching( obj , *k) )
                         {
                             resultPairs.addPair(obj , *k);
                         }
@@ -142,7 +142,7 @@ void LocalSpatialGridHash::probe(const SpatialObjectList& dsB)
             HashValue* soList = it->second;
             for (HashValue::const_iterator k=soList->begin(); k!=soList->end(); ++k)
             {
-                if ( istouching( *i , *k) )
+                if ( (resultPairs.storesPairs() || isReferenceCell( *i , *k , *j )) && istouching( *i , *k) )
                 {
                     resultPairs.addPair(*i , *k);
                 }
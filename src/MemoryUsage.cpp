@@ -0,0 +1,79 @@
+#include "MemoryUsage.hpp"
+#include <fstream>
+#include <sstream>
+
+namespace FLAT
+{
+	// a field in KB of /proc/self/status
+	static uint64 statusField(const std::string& name)
+	{
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		uint64 kb = 0;
+		while (std::getline(status,line))
+			if (line.compare(0,name.size(),name) == 0)
+			{
+				std::istringstream(line.substr(name.size())) >> kb;
+				break;
+			}
+		return kb;
+	}
+
+	uint64 MemoryUsage::resident()
+	{
+		return statusField("VmRSS:");
+	}
+
+	uint64 MemoryUsage::peakResident()
+	{
+		return statusField("VmHWM:");
+	}
+
+	bool MemoryUsage::resetPeak()
+	{
+		std::ofstream clear("/proc/self/clear_refs");
+		clear << "5";
+		clear.close();
+		return !clear.fail();
+	}
+
+	MemoryUsage::MemoryUsage()
+	{
+		reset();
+	}
+
+	void MemoryUsage::reset()
+	{
+		peak = 0;
+		growth = 0;
+		begin = 0;
+		running = false;
+	}
+
+	void MemoryUsage::start()
+	{
+		resetPeak();
+		begin = resident();
+		running = true;
+	}
+
+	void MemoryUsage::stop()
+	{
+		if (!running) return;
+		uint64 high = peakResident();
+		if (high > peak) peak = high;
+		growth += (int64)resident() - (int64)begin;
+		running = false;
+	}
+
+	std::string MemoryUsage::header(const std::string& phase)
+	{
+		return phase + " peak RSS(KB), " + phase + " RSS growth(KB)";
+	}
+
+	std::ostream & operator << (std::ostream & lhs, MemoryUsage& rhs)
+	{
+		lhs << rhs.peak << "," << rhs.growth;
+		return lhs;
+	}
+}
@@ -328,6 +328,6 @@ namespace FLAT
 			}
 		}
 
-		return sqrDistance;
+		return sqrDistance>0 ? sqrt(sqrDistance) : 0;
 	}
 }
@@ -1,5 +1,9 @@
 #include "Metadata.hpp"
+#include "SeedBuilder.hpp"
 #include "Box.hpp"
+#include "Hilbert.hpp"
+#include <algorithm>
+#include <queue>
 #include <set>
 
 using namespace std;
@@ -17,6 +21,7 @@ namespace FLAT {
 		pageMbr.high[0] = read(3*sizeof(spaceUnit), buffer);
 		pageMbr.high[1] = read(4*sizeof(spaceUnit), buffer);
 		pageMbr.high[2] = read(5*sizeof(spaceUnit), buffer);
+		pageMbr.isEmpty = false;
 
 		pageId = readId(6*sizeof(spaceUnit), buffer);
 		int count = readId(6*sizeof(spaceUnit) + sizeof(id), buffer);
@@ -190,6 +195,22 @@ namespace FLAT {
 		dolinking=false;
 	}
 
+	MetaDataStream::MetaDataStream (vector<MetadataEntry*>* metadataStructure,int threads)
+	{
+		i=0;
+		linkerTree = NULL;
+		this->metadataStructure = metadataStructure;
+		pages = metadataStructure->size();
+#ifdef DEBUG
+		links=0;
+		sumVolume=0;
+		for (int i=0;i<100;i++)
+			frequency[i]=0;
+#endif
+		induceLinks(metadataStructure,threads);
+		dolinking=true;
+	}
+
 	MetaDataStream::~MetaDataStream()
 	{
 	}
@@ -216,16 +237,20 @@ namespace FLAT {
 			MetadataEntry* me = metadataStructure->at(i);
 
 			/********** INDUCE LINKS BY RTREE ***************/
-			double lo[DIMENSION], hi[DIMENSION];
-			for (int k = 0; k < DIMENSION; k++)
+			// without a linker tree the links were induced up front
+			if (linkerTree!=NULL)
 			{
-				lo[k] = (double) me->partitionMbr.low[k];
-				hi[k] = (double) me->partitionMbr.high[k];
+				double lo[DIMENSION], hi[DIMENSION];
+				for (int k = 0; k < DIMENSION; k++)
+				{
+					lo[k] = (double) me->partitionMbr.low[k];
+					hi[k] = (double) me->partitionMbr.high[k];
+				}
+
+				SpatialIndex::Region query_region = SpatialIndex::Region(lo, hi, DIMENSION);
+				MetaVisitor visitor(metadataStructure,i);
+				linkerTree->intersectsWithQuery(query_region, visitor);
 			}
-
-			SpatialIndex::Region query_region = SpatialIndex::Region(lo, hi, DIMENSION);
-			MetaVisitor visitor(metadataStructure,i);
-			linkerTree->intersectsWithQuery(query_region, visitor);
 			
 			//cout << "For MetaData Entry ID: " << i<< " Links= " << me->pageLinks.size() << endl;
 	#ifdef DEBUG
@@ -269,7 +294,7 @@ namespace FLAT {
 			SpatialIndex::RTree::Data* ret = new SpatialIndex::RTree::Data(length, buffer, r, i);
 			i++;
 	#ifdef PROGRESS
-				if (i%100000==0) cout << "INDUCING LINKS: "<< i << " PAGES DONE" << endl;
+				if (linkerTree!=NULL && i%100000==0) cout << "INDUCING LINKS: "<< i << " PAGES DONE" << endl;
 	#endif
 			delete[] buffer;
 			delete me;
@@ -294,7 +319,329 @@ namespace FLAT {
 		}
 	}
 
+	// entries taken by a thread at a time
+	#define LINK_CHUNK 1024
+
+	void* MetaDataStream::linkWorker(void* arg)
+	{
+		Task* task = (Task*)arg;
+		vector<MetadataEntry*>& entries = *task->metadataStructure;
+		uint32 chunks = (entries.size()+LINK_CHUNK-1)/LINK_CHUNK;
+		vector<id> found;
+		uint32 chunk;
+		while ((chunk = __sync_fetch_and_add(task->nextChunk,1)) < chunks)
+		{
+			uint32 last = std::min((uint32)entries.size(),(chunk+1)*LINK_CHUNK);
+			for (uint32 e=chunk*LINK_CHUNK;e<last;e++)
+			{
+				found.clear();
+				task->tree->intersects(entries[e]->partitionMbr,found);
+				for (vector<id>::iterator it = found.begin(); it != found.end(); ++it)
+					if (*it!=e) entries[e]->pageLinks.insert(*it);
+			}
+#ifdef PROGRESS
+			if (last/100000 != (chunk*LINK_CHUNK)/100000) cout << "INDUCING LINKS: "<< (last/100000)*100000 << " PAGES DONE" << endl;
+#endif
+		}
+		return NULL;
+	}
+
+	void MetaDataStream::induceLinks(vector<MetadataEntry*>* metadataStructure,int threads)
+	{
+		LinkerTree tree(metadataStructure,64);
+		uint32 nextChunk = 0;
 
+		int nthreads = (threads < 1) ? 1 : threads;
+		vector<Task> tasks(nthreads);
+		for (int t=0;t<nthreads;t++)
+		{
+			tasks[t].metadataStructure = metadataStructure;
+			tasks[t].tree = &tree;
+			tasks[t].nextChunk = &nextChunk;
+			pthread_create(&tasks[t].thread,NULL,linkWorker,&tasks[t]);
+		}
+		for (int t=0;t<nthreads;t++)
+			pthread_join(tasks[t].thread,NULL);
+	}
 
-}
+	// partitions in the order of the Hilbert values of their centers
+	class PartitionHilbertAsc
+	{
+	public:
+		vector<Box>* partitions;
 
+		PartitionHilbertAsc(vector<Box>* partitions)
+		{
+			this->partitions = partitions;
+		}
+
+		bool operator()(id p1,id p2) const
+		{
+			Vertex c1 = (*partitions)[p1].getCenter();
+			Vertex c2 = (*partitions)[p2].getCenter();
+			double d1[DIMENSION],d2[DIMENSION];
+			for (int d=0;d<DIMENSION;d++)
+			{
+				d1[d] = c1[d];
+				d2[d] = c2[d];
+			}
+			return hilbert_ieee_cmp(DIMENSION,d1,d2)<0;
+		}
+	};
+
+	LinkerTree::LinkerTree(vector<MetadataEntry*>* metadataStructure,uint32 fanout)
+	{
+		for (uint32 p=0;p<metadataStructure->size();p++)
+		{
+			partitions.push_back(metadataStructure->at(p)->partitionMbr);
+			partitions.back().isEmpty = false;
+		}
+		pack(fanout);
+	}
+
+	LinkerTree::LinkerTree(const vector<Box>& partitions,uint32 fanout)
+	{
+		this->partitions = partitions;
+		for (uint32 p=0;p<this->partitions.size();p++)
+			this->partitions[p].isEmpty = false;
+		pack(fanout);
+	}
+
+	void LinkerTree::pack(uint32 fanout)
+	{
+		if (fanout<2) fanout = 2;
+		for (uint32 p=0;p<partitions.size();p++)
+			order.push_back(p);
+		std::sort(order.begin(),order.end(),PartitionHilbertAsc(&partitions));
+
+		// leaves over runs of the curve, then every level over runs of the one below
+		for (uint32 first=0;first<order.size();first+=fanout)
+		{
+			Node leaf;
+			leaf.first = first;
+			leaf.count = std::min(fanout,(uint32)order.size()-first);
+			leaf.leaf  = true;
+			leaf.mbr   = partitions[order[first]];
+			for (uint32 k=1;k<leaf.count;k++)
+				Box::combine(leaf.mbr,partitions[order[first+k]],leaf.mbr);
+			nodes.push_back(leaf);
+		}
+		uint32 levelBegin = 0;
+		while (nodes.size()-levelBegin>1)
+		{
+			uint32 levelEnd = nodes.size();
+			for (uint32 first=levelBegin;first<levelEnd;first+=fanout)
+			{
+				Node node;
+				node.first = first;
+				node.count = std::min(fanout,levelEnd-first);
+				node.leaf  = false;
+				node.mbr   = nodes[first].mbr;
+				for (uint32 k=1;k<node.count;k++)
+					Box::combine(node.mbr,nodes[first+k].mbr,node.mbr);
+				nodes.push_back(node);
+			}
+			levelBegin = levelEnd;
+		}
+	}
+
+	void LinkerTree::intersects(const Box& region,vector<id>& found) const
+	{
+		if (nodes.empty()) return;
+		vector<uint32> stack;
+		stack.push_back(nodes.size()-1);
+		while (!stack.empty())
+		{
+			const Node& node = nodes[stack.back()];
+			stack.pop_back();
+			if (!Box::overlap(node.mbr,region)) continue;
+			for (uint32 k=0;k<node.count;k++)
+			{
+				if (!node.leaf)
+					stack.push_back(node.first+k);
+				else if (Box::overlap(partitions[order[node.first+k]],region))
+					found.push_back(order[node.first+k]);
+			}
+		}
+	}
+
+	bool LinkerTree::intersectsAny(const Box& region,id& found) const
+	{
+		if (nodes.empty()) return false;
+		vector<uint32> stack;
+		stack.push_back(nodes.size()-1);
+		while (!stack.empty())
+		{
+			const Node& node = nodes[stack.back()];
+			stack.pop_back();
+			if (!Box::overlap(node.mbr,region)) continue;
+			for (uint32 k=0;k<node.count;k++)
+			{
+				if (!node.leaf)
+					stack.push_back(node.first+k);
+				else if (Box::overlap(partitions[order[node.first+k]],region))
+				{
+					found = order[node.first+k];
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// best first: nodes by the distance to their MBR, partitions (as -1-position in order) by their own
+	bool LinkerTree::nearest(const Vertex& point,id& found) const
+	{
+		if (nodes.empty()) return false;
+		typedef std::pair<bigSpaceUnit,int64> Candidate;
+		std::priority_queue<Candidate,vector<Candidate>,std::greater<Candidate> > queue;
+		Vertex p = point;
+		Box mbr = nodes.back().mbr;
+		queue.push(Candidate(mbr.pointDistance(p),nodes.size()-1));
+		while (!queue.empty())
+		{
+			Candidate next = queue.top();
+			queue.pop();
+			if (next.second<0)
+			{
+				found = order[-1-next.second];
+				return true;
+			}
+			const Node& node = nodes[next.second];
+			for (uint32 k=0;k<node.count;k++)
+			{
+				if (node.leaf)
+				{
+					mbr = partitions[order[node.first+k]];
+					queue.push(Candidate(mbr.pointDistance(p),-1-(int64)(node.first+k)));
+				}
+				else
+				{
+					mbr = nodes[node.first+k].mbr;
+					queue.push(Candidate(mbr.pointDistance(p),node.first+k));
+				}
+			}
+		}
+		return false;
+	}
+
+	MetadataPage::MetadataPage()
+	{
+		entries = NULL;
+		count   = 0;
+		links   = NULL;
+	}
+
+	// entry i of a leaf node, its links appended to links
+	static void parseEntry(nodeSkeleton* node,uint32 i,MetadataPage::Entry& entry,vector<id>& links)
+	{
+		for (int d=0;d<DIMENSION;d++)
+		{
+			entry.partition.low[d]  = node->m_ptrMBR[i]->m_pLow[d];
+			entry.partition.high[d] = node->m_ptrMBR[i]->m_pHigh[d];
+		}
+		entry.partition.isEmpty = false;
+
+		MetadataEntry me = MetadataEntry(node->m_pData[i],node->m_pDataLength[i]);
+		entry.pageMbr   = me.pageMbr;
+		entry.pageId    = me.pageId;
+		entry.firstLink = links.size();
+		entry.links     = me.pageLinks.size();
+		links.insert(links.end(),me.pageLinks.begin(),me.pageLinks.end());
+	}
+
+	void MetadataPage::assign(nodeSkeleton* node)
+	{
+		ownEntries.resize(node->children);
+		ownLinks.clear();
+		for (uint32 i=0;i<node->children;i++)
+			parseEntry(node,i,ownEntries[i],ownLinks);
+
+		entries = ownEntries.empty() ? NULL : &ownEntries[0];
+		count   = ownEntries.size();
+		links   = ownLinks.empty() ? NULL : &ownLinks[0];
+	}
+
+	ResidentMetadata::ResidentMetadata(SpatialIndex::IStorageManager* storage)
+	{
+		vector<SpatialIndex::id_type> keys;
+		storage->getKeys(&keys);
+		std::sort(keys.begin(),keys.end());
+
+		for (vector<SpatialIndex::id_type>::iterator it = keys.begin(); it != keys.end(); ++it)
+		{
+			nodeSkeleton* node = SeedBuilder::readNode(*it,storage);
+			if (node!=NULL && node->nodeType==SpatialIndex::RTree::PersistentLeaf)
+			{
+				if (slot.size()<=(uint64)*it) slot.resize(*it+1,-1);
+				slot[*it] = firstEntry.size();
+				firstEntry.push_back(entries.size());
+				for (uint32 i=0;i<node->children;i++)
+				{
+					entries.push_back(MetadataPage::Entry());
+					parseEntry(node,i,entries.back(),links);
+				}
+			}
+			delete node;
+		}
+		firstEntry.push_back(entries.size());
+
+		// partitions by pageId, for seeding
+		vector<Box> boxes;
+		for (uint32 p=0;p<firstEntry.size()-1;p++)
+			for (uint32 e=firstEntry[p];e<firstEntry[p+1];e++)
+			{
+				id pageId = entries[e].pageId;
+				if (boxes.size()<=pageId)
+				{
+					boxes.resize(pageId+1);
+					leafOf.resize(pageId+1,-1);
+				}
+				boxes[pageId] = entries[e].partition;
+			}
+		for (uint64 leaf=0;leaf<slot.size();leaf++)
+			if (slot[leaf]>=0)
+				for (uint32 e=firstEntry[slot[leaf]];e<firstEntry[slot[leaf]+1];e++)
+					leafOf[entries[e].pageId] = leaf;
+		partitions = new LinkerTree(boxes,64);
+	}
+
+	ResidentMetadata::~ResidentMetadata()
+	{
+		delete partitions;
+	}
+
+	bool ResidentMetadata::page(SpatialIndex::id_type leaf,MetadataPage& page) const
+	{
+		if (leaf<0 || (uint64)leaf>=slot.size() || slot[leaf]<0) return false;
+		uint32 first = firstEntry[slot[leaf]];
+		page.entries = entries.empty() ? NULL : &entries[first];
+		page.count   = firstEntry[slot[leaf]+1]-first;
+		page.links   = links.empty() ? NULL : &links[0];
+		return true;
+	}
+
+	bool ResidentMetadata::seed(const Box& region,SpatialIndex::id_type& leaf) const
+	{
+		id pageId;
+		if (!partitions->intersectsAny(region,pageId) || leafOf[pageId]<0) return false;
+		leaf = leafOf[pageId];
+		return true;
+	}
+
+	bool ResidentMetadata::nearest(const Vertex& point,SpatialIndex::id_type& leaf) const
+	{
+		id pageId;
+		if (!partitions->nearest(point,pageId) || leafOf[pageId]<0) return false;
+		leaf = leafOf[pageId];
+		return true;
+	}
+
+	uint64 ResidentMetadata::bytes() const
+	{
+		return entries.size()*sizeof(MetadataPage::Entry) + links.size()*sizeof(id)
+				+ firstEntry.size()*sizeof(uint32) + slot.size()*sizeof(int32)
+				+ leafOf.size()*sizeof(SpatialIndex::id_type)
+				+ partitions->partitions.size()*(sizeof(Box)+sizeof(id)) + partitions->nodes.size()*sizeof(LinkerTree::Node);
+	}
+}
@@ -67,16 +67,11 @@ void PBSMHash::analyze(const SpatialObjectList& dsA,const SpatialObjectList& dsB
 
 void PBSMHash::probe()
 {
-    //For every cell of A join it with its corresponding cell of B
+    //For every cell of A holding objects join it with its corresponding cell of B
+    TRACE_SCOPE("probe");
     probing.start();
-    for(int i = 0 ; i < resolution ; i++)
-            for(int j = 0 ; j < resolution ; j++)
-                    for(int k = 0 ; k < resolution ; k++)
-                    {
-                            FLAT::uint64 index = gridLocation2Index(i,j,k);
-                            // Join indexA of the two hash tables A and B
-                            joincells(index, index);
-                    }
+    for (HashTable::iterator hA = hashTableA.begin(); hA != hashTableA.end(); ++hA)
+            joincells(hA->first, hA->first);
 
     probing.stop();
 }
@@ -85,20 +80,29 @@ void PBSMHash::probe()
 void PBSMHash::joincells(const FLAT::uint64 indexA, const FLAT::uint64 indexB)
 {
         // join objects in the cells A and B
-        SpatialObjectList A,B;
-
         HashTable::iterator hA = hashTableA.find(indexA);
         if (hA==hashTableA.end()) return;
-        A = *( hA->second );
+        SpatialObjectList& A = *( hA->second );
 
         HashTable::iterator hB = hashTableB.find(indexB);
         if (hB==hashTableB.end()) return;
-        B = *( hB->second );
-        NL(A,B);
+        SpatialObjectList& B = *( hB->second );
+        if (resultPairs.storesPairs())
+        {
+            NL(A,B);
+            return;
+        }
+        
+        // no deDuplicate later: test every pair only in its reference cell
+        for (SpatialObjectList::iterator itA = A.begin(); itA != A.end(); ++itA)
+            for (SpatialObjectList::iterator itB = B.begin(); itB != B.end(); ++itB)
+                if ( isReferenceCell(*itA, *itB, indexA) && istouching(*itA, *itB) )
+                    resultPairs.addPair(*itA, *itB);
 }
 
 void PBSMHash::build(SpatialObjectList& a, SpatialObjectList& b)
 {
+        TRACE_SCOPE("build");
         building.start();
         double exp = epsilon * 0.5;
         for(SpatialObjectList::iterator A=a.begin(); A!=a.end(); ++A)
@@ -138,18 +142,18 @@ void PBSMHash::build(SpatialObjectList& a, SpatialObjectList& b)
                 FLAT::Box::expand(mbr,exp);
                 if (!FLAT::Box::overlap(mbr,universe))
                 {
-                        filtered[0]++;
+                        filtered[1]++;
                         continue;
                 }
 
                 int xMin,yMin,zMin;
                 int xMax,yMax,zMax;
-                bool filtered = false;
-                filtered |= vertex2GridLocation(mbr.low,xMin,yMin,zMin,true);
-                filtered |= vertex2GridLocation(mbr.high,xMax,yMax,zMax,false);
+                bool outside = false;
+                outside |= vertex2GridLocation(mbr.low,xMin,yMin,zMin,true);
+                outside |= vertex2GridLocation(mbr.high,xMax,yMax,zMax,false);
 
-                if(filtered)
-                        filtered ++;
+                if(outside)
+                        filtered[1]++;
                 else
                 {
                 for(int x=xMin; x<=xMax; x++)
@@ -173,3 +177,13 @@ void PBSMHash::build(SpatialObjectList& a, SpatialObjectList& b)
         }
         building.stop();
 }
+
+// occupancy of the cells of both datasets
+void PBSMHash::writeMetrics(std::ostream& out)
+{
+    out << ",\n\"cells\":{\"A\":";
+    writeCells(out,hashTableA,0,totalGridCells);
+    out << ",\n\"B\":";
+    writeCells(out,hashTableB,0,totalGridCells);
+    out << "}";
+}
@@ -0,0 +1,220 @@
+#include "PageCache.hpp"
+#include "PayLoad.hpp"
+
+namespace FLAT
+{
+	PageCache::PageCache(uint64 budgetBytes,uint32 shardCount,uint32 pageSize)
+	{
+		if (shardCount==0) shardCount=1;
+		this->pageSize = pageSize;
+		for (uint32 s=0;s<shardCount;s++)
+		{
+			Shard* shard = new Shard();
+			pthread_mutex_init(&shard->lock,NULL);
+			shard->hand      = 0;
+			shard->bytes     = 0;
+			shard->budget    = budgetBytes/shardCount;
+			shard->hits      = 0;
+			shard->misses    = 0;
+			shard->evictions = 0;
+			shards.push_back(shard);
+		}
+	}
+
+	PageCache::~PageCache()
+	{
+		for (vector<Shard*>::iterator it = shards.begin(); it != shards.end(); ++it)
+		{
+			for (vector<CachedPage*>::iterator p = (*it)->clock.begin(); p != (*it)->clock.end(); ++p)
+			{
+				delete[] (*p)->data;
+				delete (*p);
+			}
+			pthread_mutex_destroy(&(*it)->lock);
+			delete (*it);
+		}
+	}
+
+	CachedPage* PageCache::pin(int pageId,PayLoad* payload,bool* hit,bool* prefetched)
+	{
+		if (prefetched!=NULL) *prefetched = false;
+		Shard* shard = shards[pageId%shards.size()];
+
+		pthread_mutex_lock(&shard->lock);
+		map<int,CachedPage*>::iterator found = shard->pages.find(pageId);
+		if (found!=shard->pages.end())
+		{
+			CachedPage* page = found->second;
+			page->pins++;
+			page->referenced = true;
+			if (page->prefetched && prefetched!=NULL) *prefetched = true;
+			page->prefetched = false;
+			shard->hits++;
+			pthread_mutex_unlock(&shard->lock);
+			if (hit!=NULL) *hit = true;
+			return page;
+		}
+		shard->misses++;
+		pthread_mutex_unlock(&shard->lock);
+		if (hit!=NULL) *hit = false;
+
+		// read without holding the shard
+		int8* data = new int8[pageSize];
+		if (!payload->readPage(pageId,data))
+		{
+			delete[] data;
+			return NULL;
+		}
+
+		pthread_mutex_lock(&shard->lock);
+		found = shard->pages.find(pageId);
+		CachedPage* page;
+		if (found!=shard->pages.end())
+		{
+			// read by another thread in the meantime
+			delete[] data;
+			page = found->second;
+		}
+		else
+		{
+			page = new CachedPage();
+			page->pageId = pageId;
+			page->data   = data;
+			page->pins   = 0;
+			page->prefetched = false;
+			shard->bytes += pageSize;
+			evict(shard);
+			shard->pages[pageId] = page;
+			shard->clock.push_back(page);
+		}
+		page->pins++;
+		page->referenced = true;
+		pthread_mutex_unlock(&shard->lock);
+		return page;
+	}
+
+	void PageCache::insert(int pageId,int8* data)
+	{
+		Shard* shard = shards[pageId%shards.size()];
+		pthread_mutex_lock(&shard->lock);
+		if (shard->pages.find(pageId)!=shard->pages.end())
+			delete[] data;
+		else
+		{
+			CachedPage* page = new CachedPage();
+			page->pageId = pageId;
+			page->data   = data;
+			page->pins   = 0;
+			page->referenced = false;
+			page->prefetched = true;
+			shard->bytes += pageSize;
+			evict(shard);
+			shard->pages[pageId] = page;
+			shard->clock.push_back(page);
+		}
+		pthread_mutex_unlock(&shard->lock);
+	}
+
+	bool PageCache::contains(int pageId)
+	{
+		Shard* shard = shards[pageId%shards.size()];
+		pthread_mutex_lock(&shard->lock);
+		bool found = shard->pages.find(pageId)!=shard->pages.end();
+		pthread_mutex_unlock(&shard->lock);
+		return found;
+	}
+
+	void PageCache::unpin(CachedPage* page)
+	{
+		Shard* shard = shards[page->pageId%shards.size()];
+		pthread_mutex_lock(&shard->lock);
+		page->pins--;
+		pthread_mutex_unlock(&shard->lock);
+	}
+
+	// CLOCK: sweep the hand, clearing reference bits, until the shard is in budget.
+	// Pinned pages are skipped, if all of them are pinned the shard stays over budget.
+	void PageCache::evict(Shard* shard)
+	{
+		uint64 steps = 2*shard->clock.size();
+		while (shard->bytes>shard->budget && !shard->clock.empty() && steps-->0)
+		{
+			if (shard->hand>=shard->clock.size()) shard->hand=0;
+			CachedPage* page = shard->clock[shard->hand];
+			if (page->pins>0) { shard->hand++; continue; }
+			if (page->referenced) { page->referenced=false; shard->hand++; continue; }
+
+			shard->pages.erase(page->pageId);
+			shard->clock[shard->hand] = shard->clock.back();
+			shard->clock.pop_back();
+			shard->bytes -= pageSize;
+			shard->evictions++;
+			delete[] page->data;
+			delete page;
+		}
+	}
+
+	uint64 PageCache::hits()
+	{
+		uint64 sum=0;
+		for (vector<Shard*>::iterator it = shards.begin(); it != shards.end(); ++it) sum += (*it)->hits;
+		return sum;
+	}
+
+	uint64 PageCache::misses()
+	{
+		uint64 sum=0;
+		for (vector<Shard*>::iterator it = shards.begin(); it != shards.end(); ++it) sum += (*it)->misses;
+		return sum;
+	}
+
+	uint64 PageCache::evictions()
+	{
+		uint64 sum=0;
+		for (vector<Shard*>::iterator it = shards.begin(); it != shards.end(); ++it) sum += (*it)->evictions;
+		return sum;
+	}
+
+	uint64 PageCache::bytes()
+	{
+		uint64 sum=0;
+		for (vector<Shard*>::iterator it = shards.begin(); it != shards.end(); ++it) sum += (*it)->bytes;
+		return sum;
+	}
+
+	PageView::PageView()
+	{
+		cache   = NULL;
+		page    = NULL;
+		buffer  = NULL;
+		unpacked = NULL;
+		data    = NULL;
+		objects = 0;
+		objectByteSize = 0;
+		objType = NONE;
+		prefetched = false;
+	}
+
+	PageView::~PageView()
+	{
+		release();
+		delete[] buffer;
+		delete[] unpacked;
+	}
+
+	void PageView::release()
+	{
+		if (page!=NULL) cache->unpin(page);
+		page    = NULL;
+		data    = NULL;
+		objects = 0;
+		prefetched = false;
+	}
+
+	SpatialObject* PageView::create(uint32 i) const
+	{
+		SpatialObject* sobj = SpatialObjectFactory::create(objType);
+		read(i,sobj);
+		return sobj;
+	}
+}
@@ -0,0 +1,162 @@
+#include "PageCodec.hpp"
+
+namespace FLAT
+{
+	// order preserving key of an IEEE float word, integers only move by half the range
+	static inline uint32 toKey(uint32 word)
+	{
+		return (word & 0x80000000u) ? ~word : (word ^ 0x80000000u);
+	}
+
+	static inline uint32 fromKey(uint32 key)
+	{
+		return (key & 0x80000000u) ? (key ^ 0x80000000u) : ~key;
+	}
+
+	static inline uint32 word(const int8* records,uint32 i,uint32 c,uint32 objectSize)
+	{
+		uint32 w;
+		memcpy(&w,records+i*objectSize+c*sizeof(uint32),sizeof(uint32));
+		return w;
+	}
+
+	static inline uint32 columnHeader(uint32 columns)
+	{
+		// counter and per column base, width and shift, rounded up to words
+		return (sizeof(uint32) + columns*(sizeof(uint32)+2) + 3) & ~3u;
+	}
+
+	// padding after the last stream: the decoder reads a value as two words, also at the end of an empty stream
+	static const uint32 readAheadPadding = 2*sizeof(uint32);
+
+	static inline uint32 streamWords(uint32 objects,uint32 width)
+	{
+		return (uint32)(((uint64)objects*width+31)/32);
+	}
+
+	// base, width and shift of column c
+	static void frame(const int8* records,uint32 objects,uint32 objectSize,uint32 c,uint32& base,uint8& width,uint8& shift)
+	{
+		base = 0xFFFFFFFFu;
+		for (uint32 i=0;i<objects;i++)
+		{
+			uint32 key = toKey(word(records,i,c,objectSize));
+			if (key<base) base = key;
+		}
+		uint32 bits = 0;
+		for (uint32 i=0;i<objects;i++)
+			bits |= toKey(word(records,i,c,objectSize)) - base;
+
+		shift = 0;
+		width = 0;
+		if (bits==0) return;
+		while (!(bits & 1)) { bits >>= 1; shift++; }
+		while (bits) { bits >>= 1; width++; }
+	}
+
+	uint32 PageCodec::recordBits(const int8* records,uint32 objects,uint32 objectSize)
+	{
+		uint32 columns = objectSize/sizeof(uint32);
+		uint32 sum = 0;
+		for (uint32 c=0;c<columns;c++)
+		{
+			uint32 base; uint8 width,shift;
+			frame(records,objects,objectSize,c,base,width,shift);
+			sum += width;
+		}
+		return sum;
+	}
+
+	uint32 PageCodec::packedSize(const int8* records,uint32 objects,uint32 objectSize)
+	{
+		uint32 columns = objectSize/sizeof(uint32);
+		uint32 bytes = columnHeader(columns);
+		for (uint32 c=0;c<columns;c++)
+		{
+			uint32 base; uint8 width,shift;
+			frame(records,objects,objectSize,c,base,width,shift);
+			bytes += streamWords(objects,width)*sizeof(uint32);
+		}
+		return bytes + readAheadPadding;
+	}
+
+	void PageCodec::pack(const int8* records,uint32 objects,uint32 objectSize,int8* page)
+	{
+		uint32 columns = objectSize/sizeof(uint32);
+		memcpy(page,&objects,sizeof(uint32));
+		int8* header = page+sizeof(uint32);
+		uint32* stream = (uint32*)(page+columnHeader(columns));
+
+		for (uint32 c=0;c<columns;c++)
+		{
+			uint32 base; uint8 width,shift;
+			frame(records,objects,objectSize,c,base,width,shift);
+			memcpy(header,&base,sizeof(uint32));
+			header[sizeof(uint32)]   = width;
+			header[sizeof(uint32)+1] = shift;
+			header += sizeof(uint32)+2;
+
+			uint32 words = streamWords(objects,width);
+			for (uint32 w=0;w<=words;w++) stream[w] = 0;
+			for (uint32 i=0;i<objects && width>0;i++)
+			{
+				uint64 value = (toKey(word(records,i,c,objectSize)) - base) >> shift;
+				uint64 bit = (uint64)i*width;
+				uint32 at = bit>>5, offset = bit&31;
+				stream[at] |= (uint32)(value << offset);
+				if (offset+width>32) stream[at+1] |= (uint32)(value >> (32-offset));
+			}
+			stream += words;
+		}
+		memset(stream,0,readAheadPadding);
+	}
+
+	bool PageCodec::unpack(const int8* page,uint32 pageSize,uint32 objectSize,int8* raw)
+	{
+		uint32 columns = objectSize/sizeof(uint32);
+		uint32 objects;
+		memcpy(&objects,page,sizeof(uint32));
+
+		// the headers before any decoding: a value must fit a word and the streams the page
+		uint64 bytes = columnHeader(columns) + readAheadPadding;
+		if (bytes>pageSize) return false;
+		const int8* header = page+sizeof(uint32);
+		for (uint32 c=0;c<columns;c++)
+		{
+			uint32 width = (uint8)header[sizeof(uint32)];
+			uint32 shift = (uint8)header[sizeof(uint32)+1];
+			header += sizeof(uint32)+2;
+			if (width>32 || shift>31 || width+shift>32) return false;
+			bytes += (uint64)streamWords(objects,width)*sizeof(uint32);
+			if (bytes>pageSize) return false;
+		}
+
+		memcpy(raw,&objects,sizeof(uint32));
+		header = page+sizeof(uint32);
+		const uint32* stream = (const uint32*)(page+columnHeader(columns));
+		int8* records = raw+sizeof(uint32);
+
+		// a column at a time: the same width, shift and base for every record, no branches
+		for (uint32 c=0;c<columns;c++)
+		{
+			uint32 base;
+			memcpy(&base,header,sizeof(uint32));
+			uint32 width = (uint8)header[sizeof(uint32)];
+			uint32 shift = (uint8)header[sizeof(uint32)+1];
+			header += sizeof(uint32)+2;
+
+			uint64 mask = (1ull<<width)-1;
+			uint32* out = (uint32*)(records+c*sizeof(uint32));
+			uint32 stride = objectSize/sizeof(uint32);
+			for (uint32 i=0;i<objects;i++)
+			{
+				uint64 bit = (uint64)i*width;
+				uint64 pair = (uint64)stream[bit>>5] | ((uint64)stream[(bit>>5)+1] << 32);
+				uint32 value = (uint32)((pair >> (bit&31)) & mask);
+				out[i*stride] = fromKey(base + (value << shift));
+			}
+			stream += streamWords(objects,width);
+		}
+		return true;
+	}
+}
@@ -1,19 +1,71 @@
 #include "PayLoad.hpp"
 #include "Box.hpp"
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
 namespace FLAT
 {
 	PayLoad::PayLoad()
 	{
-
+		file  = NULL;
+		cache = NULL;
+		format = RAW_PAGES;
+		resident = NULL;
+		residentPages = 0;
+		fd = -1;
+		pthread_mutex_init(&fileLock,NULL);
 	}
 
 	PayLoad::~PayLoad()
 	{
+		delete cache;
+		delete resident;
 		delete file;
+		if (fd>=0) close(fd);
+		pthread_mutex_destroy(&fileLock);
+	}
+
+	void PayLoad::setCache(uint64 budgetBytes,uint32 shards)
+	{
+		delete cache;
+		cache = (budgetBytes>0) ? new PageCache(budgetBytes,shards,pageSize) : NULL;
+	}
+
+	bool PayLoad::loadMemory(bool hugePages)
+	{
+		if (isCreated || file==NULL) return false;
+
+		file->file.clear();
+		file->file.seekg(0,ios_base::end);
+		uint64 bytes = file->file.tellg();
+		uint64 pages = (bytes>pageSize) ? bytes/pageSize-1 : 0;
+
+		ResidentArena* arena = new ResidentArena();
+		if (!arena->allocate(pages*pageSize,hugePages))
+		{
+			delete arena;
+			return false;
+		}
+		for (uint64 p=0;p<pages;p++)
+			if (!readPage(p,arena->data+p*pageSize))
+			{
+				delete arena;
+				return false;
+			}
+
+		delete resident;
+		resident = arena;
+		residentPages = pages;
+		return true;
+	}
+
+	uint32 PayLoad::storedObjectSize()
+	{
+		if (format==PACKED_PAGES) return pageSize/objectsPerPage;
+		return objectSize;
 	}
 
-	void PayLoad::create(string indexFileStem,uint32 pageSize,uint64 objectsPerPage,uint32 objectSize,SpatialObjectType objectType)
+	void PayLoad::create(string indexFileStem,uint32 pageSize,uint64 objectsPerPage,uint32 objectSize,SpatialObjectType objectType,PageFormat format)
 	{
 		try
 		{
@@ -22,6 +74,7 @@ namespace FLAT
 			this->objType  		 = objectType;
 			this->objectsPerPage = objectsPerPage;
 			this->objectSize     = objectSize;
+			this->format         = format;
 			this->isCreated      = true;
 
 			file  = new BufferedFile();
@@ -39,6 +92,9 @@ namespace FLAT
 			memcpy(ptr,&objectsPerPage,sizeof(uint64));
 			ptr+=sizeof(uint64);
 			memcpy(ptr,&objectSize,sizeof(uint32));
+			ptr+=sizeof(uint32);
+			uint32 stamp = format;
+			memcpy(ptr,&stamp,sizeof(uint32));
 
 			file->write(pageSize,page);
 		}
@@ -64,8 +120,13 @@ namespace FLAT
 			this->objType  =  (SpatialObjectType)file->readUInt32();
 			this->objectsPerPage = file->readUInt64();
 			this->objectSize = file->readUInt32();
+			// zero in the headers from before packed pages
+			uint32 stamp = file->readUInt32();
+			if (stamp!=RAW_PAGES && stamp!=PACKED_PAGES) throw 1;
+			this->format = (PageFormat)stamp;
 
 			this->isCreated= false;
+			fd = open(this->filename.c_str(),O_RDONLY);
 		}
 		catch(...)
 		{
@@ -90,6 +151,22 @@ namespace FLAT
 
 			uint32 items = itemArray.size();
 			uint32 objectByteSize = SpatialObjectFactory::getSize(objType);
+
+			if (format==PACKED_PAGES)
+			{
+				vector<int8> records(items*objectByteSize+1);
+				for (uint32 i=0;i<items;i++)
+				{
+					itemArray[i]->serialize(&records[i*objectByteSize]);
+					delete itemArray[i];
+				}
+				if (items>objectsPerPage || PageCodec::packedSize(&records[0],items,objectByteSize)>pageSize)
+					return false;
+				PageCodec::pack(&records[0],items,objectByteSize,page);
+				file->write(pageSize,page);
+				return true;
+			}
+
 			memcpy(ptr,&items,sizeof(uint32));
 			ptr+=sizeof(uint32);
 
@@ -110,40 +187,116 @@ namespace FLAT
 		return true;
 	}
 
+	bool PayLoad::fits(vector<SpatialObject*>& itemArray,uint64 begin,uint64 end)
+	{
+		uint32 objectByteSize = SpatialObjectFactory::getSize(objType);
+		if (format!=PACKED_PAGES) return sizeof(uint32)+(end-begin)*objectByteSize<=pageSize;
+		if (end-begin>objectsPerPage) return false;
+
+		vector<int8> records((end-begin)*objectByteSize+1);
+		for (uint64 i=begin;i<end;i++)
+			itemArray[i]->serialize(&records[(i-begin)*objectByteSize]);
+		return PageCodec::packedSize(&records[0],end-begin,objectByteSize)<=pageSize;
+	}
+
 	bool PayLoad::getPage(vector<SpatialObject*>& itemArray,int pageId)
 	{
-		try
-		{
-			if (isCreated) return false;
+		PageView view;
+		if (!getPage(view,pageId)) return false;
+		for (uint32 i=0;i<view.objects;i++)
+			itemArray.push_back(view.create(i));
+		return true;
+	}
 
-			int8 page[pageSize];
-			int8* ptr = page;
+	bool PayLoad::getPage(PageView& view,int pageId,bool* hit)
+	{
+		if (isCreated) return false;
 
-			uint64_t offset = (uint64_t)(pageId+1)*(uint64_t)pageSize; // +1 cause first page is Header
+		view.release();
+		view.objType = objType;
+		view.objectByteSize = SpatialObjectFactory::getSize(objType);
 
-			file->seek(offset);
-			file->read(pageSize,page);
+		if (resident!=NULL)
+		{
+			if (pageId<0 || (uint64)pageId>=residentPages) return false;
+			if (hit!=NULL) *hit = true;
+			view.data = resident->data+(uint64)pageId*pageSize;
+		}
+		else if (cache!=NULL)
+		{
+			view.page = cache->pin(pageId,this,hit,&view.prefetched);
+			if (view.page==NULL) return false;
+			view.cache = cache;
+			view.data  = view.page->data;
+		}
+		else
+		{
+			if (hit!=NULL) *hit = false;
+			if (view.buffer==NULL) view.buffer = new int8[pageSize];
+			if (!readPage(pageId,view.buffer)) return false;
+			view.data = view.buffer;
+		}
+		memcpy(&view.objects,view.data,sizeof(uint32));
 
-			uint32 counter=0;
-			uint32 objectByteSize = SpatialObjectFactory::getSize(objType);
+		// a raw or a packed page, a damaged counter would read past the records
+		if (view.objects>objectsPerPage)
+		{
+			cout << "problem with the object count of page: " << pageId << "\n";
+			view.release();
+			return false;
+		}
 
-			memcpy(&counter,ptr,sizeof(uint32));
-			ptr += sizeof(uint32);
+		if (format==PACKED_PAGES)
+		{
+			// the records are unpacked into the view, the cache keeps the packed page
+			if (view.unpacked==NULL) view.unpacked = new int8[sizeof(uint32)+objectsPerPage*view.objectByteSize];
+			if (!PageCodec::unpack(view.data,pageSize,view.objectByteSize,view.unpacked))
+			{
+				cout << "problem with the packed columns of page: " << pageId << "\n";
+				view.release();
+				return false;
+			}
+			bool prefetched = view.prefetched;
+			view.release();
+			view.data       = view.unpacked;
+			view.prefetched = prefetched;
+			memcpy(&view.objects,view.data,sizeof(uint32));
+		}
+		return true;
+	}
 
-			for (uint32 i=0;i<counter;i++)
+	bool PayLoad::readPage(int pageId,int8* page)
+	{
+		uint64_t offset = (uint64_t)(pageId+1)*(uint64_t)pageSize; // +1 cause first page is Header
+		if (fd>=0)
+		{
+			// positional reads share no file offset, any number of threads read at once
+			uint32 read = 0;
+			while (read<pageSize)
 			{
-				SpatialObject* sobj = SpatialObjectFactory::create(objType);
-				sobj->unserialize(ptr);
-				ptr+=objectByteSize;
-				itemArray.push_back(sobj);
+				ssize_t r = pread(fd,page+read,pageSize-read,offset+read);
+				if (r<=0) break;
+				read += r;
 			}
+			if (read==pageSize) return true;
+			cout << "problem reading page: " <<pageId << "\n";
+			return false;
+		}
+
+		bool done = true;
+		pthread_mutex_lock(&fileLock);
+		try
+		{
+			file->seek(offset);
+			file->read(pageSize,page);
 		}
 		catch(...)
 		{
 			cout << "problem reading page: " <<pageId << "\n";
-			return false;
+			done = false;
 		}
-		return true;
+		pthread_mutex_unlock(&fileLock);
+		return done;
 	}
 
 }
@@ -0,0 +1,133 @@
+#include "PerfCounters.hpp"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace FLAT
+{
+	bool PerfCounters::opened = false;
+	bool PerfCounters::available[PERF_EVENTS] = {false,false,false,false,false};
+	int PerfCounters::fds[PERF_EVENTS] = {-1,-1,-1,-1,-1};
+	const char* PerfCounters::names[PERF_EVENTS] = {"cycles","instructions","LLC misses","branch misses","dTLB misses"};
+
+	PerfCounters::PerfCounters()
+	{
+		reset();
+	}
+
+	void PerfCounters::reset()
+	{
+		running = false;
+		for (int i=0;i<PERF_EVENTS;i++)
+		{
+			values[i] = 0;
+			begin[i] = 0;
+		}
+	}
+
+	bool PerfCounters::open()
+	{
+		if (opened)
+		{
+			for (int i=0;i<PERF_EVENTS;i++)
+				if (available[i]) return true;
+			return false;
+		}
+		opened = true;
+		bool any = false;
+#ifdef __linux__
+		uint32 types[PERF_EVENTS] = {PERF_TYPE_HARDWARE,PERF_TYPE_HARDWARE,PERF_TYPE_HARDWARE,PERF_TYPE_HARDWARE,PERF_TYPE_HW_CACHE};
+		uint64 configs[PERF_EVENTS] = {
+				PERF_COUNT_HW_CPU_CYCLES,
+				PERF_COUNT_HW_INSTRUCTIONS,
+				PERF_COUNT_HW_CACHE_MISSES,
+				PERF_COUNT_HW_BRANCH_MISSES,
+				PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+
+		for (int i=0;i<PERF_EVENTS;i++)
+		{
+			struct perf_event_attr attr;
+			memset(&attr,0,sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[i];
+			attr.config = configs[i];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.inherit = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			fds[i] = syscall(__NR_perf_event_open,&attr,0,-1,-1,0);
+			available[i] = (fds[i] != -1);
+			any = any || available[i];
+		}
+#endif
+		if (!any)
+			std::cout << "Hardware performance counters are not available" << std::endl;
+		return any;
+	}
+
+	/*
+	 * Current counts, scaled up if the kernel multiplexed the event
+	 */
+	void PerfCounters::read(uint64* counts)
+	{
+		for (int i=0;i<PERF_EVENTS;i++)
+		{
+			counts[i] = 0;
+#ifdef __linux__
+			if (!available[i]) continue;
+			uint64 data[3];             // value, time enabled, time running
+			if (::read(fds[i],data,sizeof(data)) != sizeof(data)) continue;
+			if (data[2] == 0) continue;
+			counts[i] = (data[2] < data[1]) ? (uint64)((double)data[0]*data[1]/data[2]) : data[0];
+#endif
+		}
+	}
+
+	void PerfCounters::start()
+	{
+		if (!opened) return;
+		read(begin);
+		running = true;
+	}
+
+	void PerfCounters::stop()
+	{
+		if (!running) return;
+		uint64 counts[PERF_EVENTS];
+		read(counts);
+		for (int i=0;i<PERF_EVENTS;i++)
+			if (counts[i] > begin[i])
+				values[i] += counts[i]-begin[i];
+		running = false;
+	}
+
+	void PerfCounters::add(PerfCounters& counters)
+	{
+		for (int i=0;i<PERF_EVENTS;i++)
+			values[i] += counters.values[i];
+	}
+
+	std::string PerfCounters::header(const std::string& phase)
+	{
+		std::string columns;
+		for (int i=0;i<PERF_EVENTS;i++)
+		{
+			if (i > 0) columns += ", ";
+			columns += phase + " " + names[i];
+		}
+		return columns;
+	}
+
+	std::ostream & operator << (std::ostream & lhs, PerfCounters& rhs)
+	{
+		for (int i=0;i<PERF_EVENTS;i++)
+		{
+			if (i > 0) lhs << ",";
+			if (PerfCounters::available[i]) lhs << rhs.values[i];
+		}
+		return lhs;
+	}
+}
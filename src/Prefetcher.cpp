@@ -0,0 +1,233 @@
+#include "Prefetcher.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace FLAT
+{
+	Prefetcher::Prefetcher(PayLoad* payload,SpatialIndex::IStorageManager* storage,int threads,uint32 maxInFlight)
+	{
+		this->payload = payload;
+		this->storage = storage;
+		this->maxInFlight = maxInFlight;
+		issued  = 0;
+		dropped = 0;
+		reading = 0;
+		stopping = false;
+
+		fd = open(payload->filename.c_str(),O_RDONLY);
+#ifdef FATAL
+		if (fd<0) cout << "Cannot open Payload File for prefetching: " << payload->filename << endl;
+#endif
+
+		pthread_mutex_init(&storageLock,NULL);
+		pthread_mutex_init(&lock,NULL);
+		pthread_cond_init(&queued,NULL);
+		pthread_cond_init(&finished,NULL);
+
+		for (int t=0;t<threads;t++)
+		{
+			pthread_t thread;
+			if (pthread_create(&thread,NULL,workerMain,this)==0)
+				workers.push_back(thread);
+		}
+	}
+
+	Prefetcher::~Prefetcher()
+	{
+		drain();
+		pthread_mutex_lock(&lock);
+		stopping = true;
+		pthread_cond_broadcast(&queued);
+		pthread_mutex_unlock(&lock);
+		for (vector<pthread_t>::iterator it = workers.begin(); it != workers.end(); ++it)
+			pthread_join(*it,NULL);
+
+		if (fd>=0) close(fd);
+		pthread_cond_destroy(&finished);
+		pthread_cond_destroy(&queued);
+		pthread_mutex_destroy(&lock);
+		pthread_mutex_destroy(&storageLock);
+	}
+
+	// with lock held
+	bool Prefetcher::enqueue(const Request& request)
+	{
+		if (requests.size()+reading>=maxInFlight)
+		{
+			dropped++;
+			return false;
+		}
+		requests.push_back(request);
+		issued++;
+		pthread_cond_signal(&queued);
+		return true;
+	}
+
+	void Prefetcher::prefetchMetadata(SpatialIndex::id_type page,const Box& region)
+	{
+		pthread_mutex_lock(&lock);
+		if (metadata.find(page)==metadata.end() && pendingMetadata.find(page)==pendingMetadata.end())
+		{
+			Request request;
+			request.metadata = true;
+			request.page     = page;
+			request.region   = region;
+			if (enqueue(request)) pendingMetadata.insert(page);
+		}
+		pthread_mutex_unlock(&lock);
+	}
+
+	void Prefetcher::prefetchPayLoad(int pageId)
+	{
+		if (payload->cache==NULL || fd<0) return;
+		if (payload->cache->contains(pageId)) return;
+
+		pthread_mutex_lock(&lock);
+		if (pendingPayLoad.find(pageId)==pendingPayLoad.end())
+		{
+			Request request;
+			request.metadata = false;
+			request.page     = pageId;
+			if (enqueue(request)) pendingPayLoad.insert(pageId);
+		}
+		pthread_mutex_unlock(&lock);
+	}
+
+	nodeSkeleton* Prefetcher::readMetadata(SpatialIndex::id_type page,bool* prefetched)
+	{
+		pthread_mutex_lock(&lock);
+		while (true)
+		{
+			map<SpatialIndex::id_type,nodeSkeleton*>::iterator ready = metadata.find(page);
+			if (ready!=metadata.end())
+			{
+				nodeSkeleton* node = ready->second;
+				metadata.erase(ready);
+				pthread_mutex_unlock(&lock);
+				*prefetched = true;
+				return node;
+			}
+			if (pendingMetadata.find(page)==pendingMetadata.end()) break;
+
+			// still queued: take it back and read it here, otherwise wait for the reader
+			bool taken = false;
+			for (deque<Request>::iterator it = requests.begin(); it != requests.end(); ++it)
+				if (it->metadata && it->page==page)
+				{
+					requests.erase(it);
+					pendingMetadata.erase(page);
+					taken = true;
+					break;
+				}
+			if (taken) break;
+			pthread_cond_wait(&finished,&lock);
+		}
+		pthread_mutex_unlock(&lock);
+
+		*prefetched = false;
+		pthread_mutex_lock(&storageLock);
+		nodeSkeleton* node = SeedBuilder::readNode(page,storage);
+		pthread_mutex_unlock(&storageLock);
+		return node;
+	}
+
+	void Prefetcher::drain()
+	{
+		pthread_mutex_lock(&lock);
+		while (true)
+		{
+			for (deque<Request>::iterator it = requests.begin(); it != requests.end(); ++it)
+				if (it->metadata) pendingMetadata.erase(it->page);
+				else pendingPayLoad.erase((int)it->page);
+			requests.clear();
+			if (reading==0) break;
+			pthread_cond_wait(&finished,&lock);
+		}
+		for (map<SpatialIndex::id_type,nodeSkeleton*>::iterator it = metadata.begin(); it != metadata.end(); ++it)
+			delete it->second;
+		metadata.clear();
+		pthread_mutex_unlock(&lock);
+	}
+
+	void Prefetcher::read(Request& request)
+	{
+		if (request.metadata)
+		{
+			pthread_mutex_lock(&storageLock);
+			nodeSkeleton* node = SeedBuilder::readNode(request.page,storage);
+			pthread_mutex_unlock(&storageLock);
+
+			// the payload pages this metadata page will lead the crawl to
+			vector<int> pages;
+			if (node!=NULL)
+				for (uint32 i=0;i<node->children;i++)
+				{
+					Box partition(false);
+					for (int d=0;d<DIMENSION;d++)
+					{
+						partition.low[d]  = node->m_ptrMBR[i]->m_pLow[d];
+						partition.high[d] = node->m_ptrMBR[i]->m_pHigh[d];
+					}
+					if (!Box::overlap(partition,request.region)) continue;
+					MetadataEntry me = MetadataEntry(node->m_pData[i],node->m_pDataLength[i]);
+					if (Box::overlap(me.pageMbr,request.region)) pages.push_back(me.pageId);
+				}
+
+			pthread_mutex_lock(&lock);
+			pendingMetadata.erase(request.page);
+			if (node!=NULL) metadata[request.page] = node;
+			pthread_cond_broadcast(&finished);
+			pthread_mutex_unlock(&lock);
+
+			for (vector<int>::iterator it = pages.begin(); it != pages.end(); ++it)
+				prefetchPayLoad(*it);
+		}
+		else
+		{
+			uint32 pageSize = payload->pageSize;
+			int8* data = new int8[pageSize];
+			off_t offset = (off_t)(request.page+1)*(off_t)pageSize; // +1 cause first page is Header
+			uint32 done = 0;
+			while (done<pageSize)
+			{
+				ssize_t r = pread(fd,data+done,pageSize-done,offset+done);
+				if (r<=0) break;
+				done += r;
+			}
+			if (done==pageSize) payload->cache->insert((int)request.page,data);
+			else delete[] data;
+
+			pthread_mutex_lock(&lock);
+			pendingPayLoad.erase((int)request.page);
+			pthread_mutex_unlock(&lock);
+		}
+	}
+
+	void* Prefetcher::workerMain(void* arg)
+	{
+		Prefetcher* prefetcher = (Prefetcher*)arg;
+		while (true)
+		{
+			pthread_mutex_lock(&prefetcher->lock);
+			while (prefetcher->requests.empty() && !prefetcher->stopping)
+				pthread_cond_wait(&prefetcher->queued,&prefetcher->lock);
+			if (prefetcher->requests.empty())
+			{
+				pthread_mutex_unlock(&prefetcher->lock);
+				break;
+			}
+			Request request = prefetcher->requests.front();
+			prefetcher->requests.pop_front();
+			prefetcher->reading++;
+			pthread_mutex_unlock(&prefetcher->lock);
+
+			prefetcher->read(request);
+
+			pthread_mutex_lock(&prefetcher->lock);
+			prefetcher->reading--;
+			pthread_cond_broadcast(&prefetcher->finished);
+			pthread_mutex_unlock(&prefetcher->lock);
+		}
+		return NULL;
+	}
+}
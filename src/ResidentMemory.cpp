@@ -0,0 +1,56 @@
+#include "ResidentMemory.hpp"
+#include <iostream>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+
+namespace FLAT
+{
+	#define HUGE_PAGE_SIZE (2*1024*1024)
+
+	ResidentArena::ResidentArena()
+	{
+		data   = NULL;
+		bytes  = 0;
+		mapped = 0;
+		huge   = false;
+	}
+
+	ResidentArena::~ResidentArena()
+	{
+		if (data!=NULL) munmap(data,mapped);
+	}
+
+	bool ResidentArena::allocate(uint64 bytes,bool hugePages)
+	{
+		if (data!=NULL) munmap(data,mapped);
+		this->bytes = bytes;
+		huge = false;
+		mapped = (bytes+HUGE_PAGE_SIZE-1)/HUGE_PAGE_SIZE*HUGE_PAGE_SIZE;
+		if (mapped==0) mapped = HUGE_PAGE_SIZE;
+
+		void* block = MAP_FAILED;
+		if (hugePages)
+		{
+			block = mmap(NULL,mapped,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+			huge = (block!=MAP_FAILED);
+		}
+		if (block==MAP_FAILED)
+			block = mmap(NULL,mapped,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if (block==MAP_FAILED)
+		{
+			data = NULL;
+#ifdef FATAL
+			std::cout << "Cannot allocate " << bytes << " bytes of resident memory" << std::endl;
+#endif
+			return false;
+		}
+#ifdef MADV_HUGEPAGE
+		if (hugePages && !huge) madvise(block,mapped,MADV_HUGEPAGE);
+#endif
+		data = (int8*)block;
+		return true;
+	}
+}
@@ -0,0 +1,180 @@
+/*
+ * File:   ResidentTOUCH.cpp
+ *
+ */
+
+#include "ResidentTOUCH.h"
+
+#include <algorithm>
+
+ResidentTOUCH::ResidentTOUCH() {
+    algorithm = algo_TOUCH;
+    pthread_key_create(&scratchKey,freeScratch);
+    pthread_mutex_init(&scratchLock,NULL);
+}
+
+ResidentTOUCH::~ResidentTOUCH() {
+    pthread_key_delete(scratchKey);     // no exiting thread frees its buffers after this
+    pthread_mutex_destroy(&scratchLock);
+    for (std::vector<Scratch*>::iterator it = scratches.begin(); it != scratches.end(); it++)
+        delete (*it);
+}
+
+/*
+ * Read (or load) and partition A. Must be done before the first join().
+ */
+void ResidentTOUCH::build()
+{
+    loadOrBuildA();
+    countObjBelowStart();
+}
+
+void ResidentTOUCH::run()
+{
+    totalTimeStart();
+    build();
+    readBinaryInputB(file_dsB);
+    if (verbose) std::cout << "Joining the objects of B" << std::endl;
+
+    JoinStats stats;
+    PairSink sink(resultPairs);
+    join(dsB,sink,stats);
+
+    building.add(stats.assigning);
+    probing.add(stats.probing);
+    ItemsCompared += stats.compared;
+    filtered[1] += stats.filtered;
+    if (verbose) std::cout << "Done." << std::endl;
+    totalTimeStop();
+}
+
+/*
+ * Buffers of a thread that exits (e.g. when a thread pool shuts down) are
+ * freed right away, not with the index.
+ */
+void ResidentTOUCH::freeScratch(void* buffers)
+{
+    Scratch* scratch = (Scratch*)buffers;
+    ResidentTOUCH* owner = scratch->owner;
+    pthread_mutex_lock(&owner->scratchLock);
+    owner->scratches.erase(std::find(owner->scratches.begin(),owner->scratches.end(),scratch));
+    pthread_mutex_unlock(&owner->scratchLock);
+    delete scratch;
+}
+
+ResidentTOUCH::Scratch* ResidentTOUCH::getScratch()
+{
+    Scratch* scratch = (Scratch*)pthread_getspecific(scratchKey);
+    if (scratch == NULL)
+    {
+        scratch = new Scratch();
+        scratch->owner = this;
+        pthread_setspecific(scratchKey,scratch);
+        pthread_mutex_lock(&scratchLock);
+        scratches.push_back(scratch);
+        pthread_mutex_unlock(&scratchLock);
+    }
+    if (scratch->assigned.size() != tree.size())
+    {
+        scratch->assigned.resize(tree.size());
+        scratch->mbr.resize(tree.size());
+    }
+    return scratch;
+}
+
+/*
+ * The objects assigned to a node with the A objects of the leaves below it,
+ * through a grid of localPartitions cells per dimension over the MBR of the
+ * assigned objects. A pair found in several cells is reported once.
+ */
+void ResidentTOUCH::probeGrid(SpatialObjectList& assigned, const FLAT::Box& mbr, NodeList& leaves,
+                              ResultSink& sink, JoinStats& stats)
+{
+    SpatialGridHash grid;
+    grid.init(mbr,(int)localPartitions);
+    grid.epsilon = epsilon;
+    grid.build(assigned);
+    for (NodeList::iterator leaf = leaves.begin(); leaf != leaves.end(); leaf++)
+        for (SpatialObjectList::iterator a = (*leaf)->attachedObjs[0].begin(); a != (*leaf)->attachedObjs[0].end(); a++)
+            if (FLAT::Box::overlap((*a)->mbr,mbr))
+                grid.probe(*a);
+    grid.resultPairs.deDuplicate();
+
+    for (FLAT::uint64 i = 0; i < grid.resultPairs.objA.size(); i++)
+        sink.report(grid.resultPairs.objA[i],grid.resultPairs.objB[i]);
+    stats.compared += grid.ItemsCompared;
+    stats.results += grid.resultPairs.objA.size();
+}
+
+/*
+ * Assign every object of B to its node (as TOUCH::assignment, but into the
+ * scratch lists), then join the objects of every node with the leaves
+ * below it that overlap their combined MBR, in a nested loop or a grid
+ * (see localJoin).
+ */
+void ResidentTOUCH::join(const SpatialObjectList& B, ResultSink& sink, JoinStats& stats)
+{
+    stats.reset();
+    Scratch* scratch = getScratch();
+    TreeNode* node;
+
+    TRACE_SPAN(assignSpan,"assignment",NULL,0);
+    stats.assigning.start();
+    stats.objects = B.size();
+    for (SpatialObjectList::const_iterator it = B.begin(); it != B.end(); it++)
+    {
+        node = findAssignment(*it);
+        if (node == NULL)
+        {
+            stats.filtered++;
+            continue;
+        }
+        SpatialObjectList& assigned = scratch->assigned[node->id];
+        if (assigned.empty())
+        {
+            scratch->used.push_back(node->id);
+            scratch->mbr[node->id] = (*it)->mbr;
+        }
+        else
+            scratch->mbr[node->id] = FLAT::Box::combineSafe(scratch->mbr[node->id],(*it)->mbr);
+        assigned.push_back(*it);
+    }
+    stats.assigning.stop();
+    TRACE_STOP(assignSpan);
+
+    TRACE_SCOPE("probe");
+    stats.probing.start();
+    for (std::vector<unsigned int>::iterator id = scratch->used.begin(); id != scratch->used.end(); id++)
+    {
+        SpatialObjectList& assigned = scratch->assigned[*id];
+        FLAT::Box& mbr = scratch->mbr[*id];
+        scratch->leaves.clear();
+        leavesBelow(tree[*id],mbr,scratch->nodes,scratch->leaves,NULL);
+        if (localJoin == algo_SGrid)
+        {
+            probeGrid(assigned,mbr,scratch->leaves,sink,stats);
+            assigned.clear();
+            continue;
+        }
+        for (NodeList::iterator leaf = scratch->leaves.begin(); leaf != scratch->leaves.end(); leaf++)
+            for (SpatialObjectList::iterator a = (*leaf)->attachedObjs[0].begin(); a != (*leaf)->attachedObjs[0].end(); a++)
+            {
+                if (!FLAT::Box::overlap((*a)->mbr,mbr))
+                    continue;
+                for (SpatialObjectList::iterator b = assigned.begin(); b != assigned.end(); b++)
+                {
+                    if (!FLAT::Box::overlap((*a)->mbr,(*b)->mbr))
+                        continue;
+                    stats.compared++;
+                    if (touches((*a)->obj,(*b)->obj,epsilon))
+                    {
+                        sink.report((*a),(*b));
+                        stats.results++;
+                    }
+                }
+            }
+        assigned.clear();
+    }
+    scratch->used.clear();
+    stats.probing.stop();
+}
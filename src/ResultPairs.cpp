@@ -6,6 +6,8 @@
 
 void ResultPairs::deDuplicate()
 {
+        if (!storesPairs()) return;
+        TRACE_SCOPE("deduplicate");
         deDuplicateTime.start();
         results = 0;
         ResultList uniqueResults;
@@ -35,6 +37,14 @@ void ResultPairs::addPair(TreeEntry* sobjA, TreeEntry* sobjB)
                 sobjB = temp;
         }
 
-        objA.push_back(sobjA);
-        objB.push_back(sobjB);
+        switch (mode)
+        {
+            case result_Pairs:
+                objA.push_back(sobjA);
+                objB.push_back(sobjB);
+                break;
+            case result_Degree:
+                __sync_fetch_and_add(&degree[sobjA->id],1);
+                break;
+        }
 }
@@ -0,0 +1,85 @@
+/*
+ * File:   RunStatistics.cpp
+ *
+ */
+
+#include "RunStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+RunStatistics::RunStatistics() {
+}
+
+std::string RunStatistics::phaseName(int phase)
+{
+    switch (phase)
+    {
+        case 0: return "total";
+        case 1: return "init";
+        case 2: return "build";
+        case 3: return "probe";
+        case 4: return "comparing";
+        case 5: return "partition";
+        case 6: return "sorting";
+        case 7: return "analyzing";
+        case 8: return "deDuplicating";
+        case 9: return "gridCalculate";
+    }
+    return "Undefined";
+}
+
+void RunStatistics::add(JoinAlgorithm* run)
+{
+    FLAT::Timer* timers[RUN_PHASES] = { &run->total, &run->initialize, &run->building, &run->probing,
+            &run->comparing, &run->partition, &run->sorting, &run->analyzing,
+            &run->resultPairs.deDuplicateTime, &run->gridCalculate };
+    for (int phase = 0; phase < RUN_PHASES; phase++)
+        seconds[phase].push_back(timers[phase]->_elapsed_milliseconds/1000.0);
+    results.push_back(run->resultPairs.results);
+    compared.push_back(run->ItemsCompared);
+}
+
+// nearest-rank: the smallest value with at least p% of the values at or below it
+double RunStatistics::percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) return 0;
+    std::sort(values.begin(),values.end());
+    size_t rank = (size_t)std::ceil(p/100.0*values.size());
+    if (rank < 1) rank = 1;
+    return values[std::min(rank,values.size())-1];
+}
+
+double RunStatistics::median(std::vector<double> values)
+{
+    if (values.empty()) return 0;
+    std::sort(values.begin(),values.end());
+    size_t n = values.size();
+    return (n%2 == 1) ? values[n/2] : (values[n/2-1]+values[n/2])/2;
+}
+
+void RunStatistics::print()
+{
+    size_t runs = seconds[0].size();
+    if (runs == 0) return;
+
+    std::cout << "Runs " << runs << " (seconds: min median p95)" << std::endl;
+    for (int phase = 0; phase < RUN_PHASES; phase++)
+    {
+        // phases the algorithm does not have stay at zero
+        if (percentile(seconds[phase],100) == 0 && phase != 0) continue;
+        std::cout << " " << std::left << std::setw(14) << phaseName(phase) << std::right
+                  << " " << percentile(seconds[phase],0)
+                  << " " << median(seconds[phase])
+                  << " " << percentile(seconds[phase],95) << std::endl;
+    }
+
+    bool stable = true;
+    for (size_t i = 1; i < runs; i++)
+        if (results[i] != results[0] || compared[i] != compared[0]) stable = false;
+    std::cout << " results " << results[0] << " compared " << compared[0];
+    if (!stable) std::cout << " (differ between the runs)";
+    std::cout << std::endl;
+}
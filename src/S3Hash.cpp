@@ -32,10 +32,13 @@ void S3Hash::init(int level)
     if (verbose) cout << "Total cells: " << totalGridCells << endl;
     localPartitions = totalGridCells;
 
-    for(int l = 0 ; l < levels ; l++)
+    // cells of a level are exactly base^DIMENSION cells of the next one
+    for (int i=0;i<DIMENSION;++i)
+            universeWidth[levels-1][i] = ceil( (double)difference[i]/(double)resolution[levels-1] );
+    for(int l = levels-2 ; l >= 0 ; l--)
     {
             for (int i=0;i<DIMENSION;++i)
-                    universeWidth[l][i] = ceil( (double)difference[i]/(double)resolution[l] );
+                    universeWidth[l][i] = universeWidth[l+1][i]*base;
     }
 
     initialize.stop();
@@ -53,6 +56,7 @@ S3Hash::~S3Hash() {
 
 void S3Hash::build(SpatialObjectList& a, SpatialObjectList& b)
 {
+        TRACE_SCOPE("build");
         building.start();
         for(SpatialObjectList::iterator A=a.begin(); A!=a.end(); ++A)
         {
@@ -113,51 +117,23 @@ void S3Hash::build(SpatialObjectList& a, SpatialObjectList& b)
 
 void S3Hash::probe()
 {
-        //For every cell in level i of A join it with cells touching it from level 0 to L of B
+        //Join every cell of A with the cells of B enclosing it (same level up to level 0),
+        //and every cell of B with the cells of A strictly enclosing it. Only cells holding
+        //objects are visited.
+        TRACE_SCOPE("probe");
         probing.start();
-        for(int levelA = levels-1; levelA >= 0 ; levelA--)
+        int x,y,z,level;
+        for (HashTable::iterator hA = hashTableA.begin(); hA != hashTableA.end(); ++hA)
         {
-                for(int Ai = 0 ; Ai < resolution[levelA] ; Ai++)
-                        for(int Aj = 0 ; Aj < resolution[levelA] ; Aj++)
-                                for(int Ak = 0 ; Ak < resolution[levelA] ; Ak++)
-                                {
-                                        FLAT::uint64 indexA = gridLocation2Index(Ai,Aj,Ak,levelA);
-                                        int xMin,yMin,zMin;
-                                        //int xMax,yMax,zMax;
-                                        xMin = Ai*universeWidth[levelA][0];
-                                        yMin = Aj*universeWidth[levelA][1];
-                                        zMin = Ak*universeWidth[levelA][2];
-
-                                        //xMax = (Ai+1)*universeWidth[levelA][0];
-                                        //yMax = (Aj+1)*universeWidth[levelA][1];
-                                        //zMax = (Ak+1)*universeWidth[levelA][2];
-
-
-                                        for(int levelB = 0; levelB < levelA ; levelB++)
-                                        {
-                                                int Bi = floor((double)xMin/universeWidth[levelB][0]);
-                                                int Bj = floor((double)yMin/universeWidth[levelB][1]);
-                                                int Bk = floor((double)zMin/universeWidth[levelB][2]);
-                                                FLAT::uint64 indexB = gridLocation2Index(Bi,Bj,Bk,levelB);
-                                                // Join indexA of the hash tables A with indexB of Hash Table B
-                                                joincells(indexA, indexB);
-                                        }
-                                        // Join indexA of the two hash tables A and B
-                                        joincells(indexA, indexA);
-
-                                        for(int levelB = levelA+1; levelB < levels ; levelB++)
-                                        {
-                                                int bucketPerDim = pow(base,levelB-levelA);//res[levelB]/res[levelA]
-                                                for(int Bi=0 ; Bi<bucketPerDim ; Bi++)
-                                                        for(int Bj=0 ; Bj<bucketPerDim ; Bj++)
-                                                                for(int Bk=0 ; Bk<bucketPerDim ; Bk++)
-                                                                {
-                                                                        FLAT::uint64 indexB = gridLocation2Index(Ai*bucketPerDim+Bi,Aj*bucketPerDim+Bj,Ak*bucketPerDim+Bk,levelB);
-                                                                        // Join indexA of the A hash tables A with indexB of Hash Table B
-                                                                        joincells(indexA, indexB);
-                                                                }
-                                        }
-                                }
+                index2GridLocation(hA->first,x,y,z,level);
+                for (int levelB = level; levelB >= 0; levelB--)
+                        joincells(hA->first, enclosingCell(x,y,z,level,levelB));
+        }
+        for (HashTable::iterator hB = hashTableB.begin(); hB != hashTableB.end(); ++hB)
+        {
+                index2GridLocation(hB->first,x,y,z,level);
+                for (int levelA = level-1; levelA >= 0; levelA--)
+                        joincells(enclosingCell(x,y,z,level,levelA), hB->first);
         }
         probing.stop();
 }
@@ -191,3 +167,23 @@ void S3Hash::analyze(const SpatialObjectList& dsA,const SpatialObjectList& dsB)
         process_mem_usage(swapMem, ramMem);
         analyzing.stop();
 }
+
+// occupancy of the cells of both datasets, in total and per level
+void S3Hash::writeMetrics(std::ostream& out)
+{
+    out << ",\n\"cells\":{\"A\":";
+    writeCells(out,hashTableA,0,totalGridCells);
+    out << ",\n\"B\":";
+    writeCells(out,hashTableB,0,totalGridCells);
+    out << "},\n\"levels\":[";
+    for (int l = 0; l < levels; l++)
+    {
+        FLAT::uint64 last = (l+1 < levels) ? indexOffset[l+1] : totalGridCells;
+        out << (l == 0 ? "\n" : ",\n") << "{\"level\":" << l << ",\"resolution\":" << resolution[l] << ",\"A\":";
+        writeCells(out,hashTableA,indexOffset[l],last);
+        out << ",\"B\":";
+        writeCells(out,hashTableB,indexOffset[l],last);
+        out << "}";
+    }
+    out << "]";
+}
@@ -1,4 +1,5 @@
 #include "Segment.hpp"
+#include "Cone.hpp"
 
 namespace FLAT
 {
@@ -167,9 +168,10 @@ namespace FLAT
 		return (((DIMENSION*2)+2)*sizeof(spaceUnit))+(sizeof(uint32)*3);
 	}
 
+	// a segment is a cone between its two radii
 	bigSpaceUnit Segment::pointDistance(Vertex& p)
 	{
-		std::cout << "ERROR: pointDistance method is not overloaded with this geometry: SEGMENT" << std::endl;
-		return 0;
+		Cone cone(begin,end,radiusBegin,radiusEnd);
+		return cone.pointDistance(p);
 	}
 }
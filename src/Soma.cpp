@@ -72,9 +72,10 @@ namespace FLAT
 		return ((DIMENSION+1)*sizeof(spaceUnit))+sizeof(uint32);
 	}
 
+	// distance to the ball, 0 inside it
 	bigSpaceUnit Soma::pointDistance(Vertex& p)
 	{
-		std::cout << "ERROR: pointDistance method is not overloaded with this geometry: SOMA" << std::endl;
-		return 0;
+		bigSpaceUnit d = sqrt(Vertex::squaredDistance(center,p)) - radius;
+		return d>0 ? d : 0;
 	}
 }
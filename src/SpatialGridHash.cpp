@@ -49,6 +49,7 @@ void SpatialGridHash::analyze(const SpatialObjectList& dsA,const SpatialObjectLi
 
 void SpatialGridHash::build(SpatialObjectList& dsA)
 {
+        TRACE_SCOPE_ARG("grid build","objects",dsA.size());
         building.start();
         gridHashTable.clear();
         for(SpatialObjectList::iterator i=dsA.begin(); i!=dsA.end(); ++i)
@@ -88,6 +89,7 @@ void SpatialGridHash::probe(TreeEntry*& obj)
         if (!getProjectedCells( obj , cells ))
         {
                 filtered[obj->type]++;
+                probing.stop();
                 return;
         }
         ///// Get Unique Objects from Grid Hash in Vicinity
@@ -98,7 +100,7 @@ void SpatialGridHash::probe(TreeEntry*& obj)
                 if (it==gridHashTable.end()) continue;
                 HashValue* soList = it->second;
                 for (HashValue::const_iterator k=soList->begin(); k!=soList->end(); ++k)
-                        if ( istouching( obj , *k) )
+                        if ( (resultPairs.storesPairs() || isReferenceCell( obj , *k , *j )) && istouching( obj , *k) )
                         {
                             resultPairs.addPair(obj , *k);
                         }
@@ -110,6 +112,7 @@ void SpatialGridHash::probe(TreeEntry*& obj)
 
 void SpatialGridHash::probe(const SpatialObjectList& dsB)
 {
+    TRACE_SCOPE_ARG("grid probe","objects",dsB.size());
     probing.start();
 
     for(SpatialObjectList::const_iterator i=dsB.begin(); i!=dsB.end(); ++i)
@@ -130,7 +133,7 @@ void SpatialGridHash::probe(const SpatialObjectList& dsB)
             HashValue* soList = it->second;
             for (HashValue::const_iterator k=soList->begin(); k!=soList->end(); ++k)
             {
-                if ( istouching( *i , *k) )
+                if ( (resultPairs.storesPairs() || isReferenceCell( *i , *k , *j )) && istouching( *i , *k) )
                 {
                     resultPairs.addPair(*i , *k);
                 }
@@ -141,10 +144,22 @@ void SpatialGridHash::probe(const SpatialObjectList& dsB)
     probing.stop();
 }
 
+// occupancy of the grid over A
+void SpatialGridHash::writeMetrics(std::ostream& out)
+{
+    out << ",\n\"cells\":{\"A\":";
+    writeCells(out,cells(),0,localPartitions);
+    out << "}";
+}
+
 void SpatialGridHash::transferInfo(SpatialGridHash* sgh, JoinAlgorithm* alg)
 {
     alg->ItemsCompared += sgh->ItemsCompared;
     alg->resultPairs.results += sgh->resultPairs.results;
+    alg->resultPairs.objA.insert(alg->resultPairs.objA.end(),sgh->resultPairs.objA.begin(),sgh->resultPairs.objA.end());
+    alg->resultPairs.objB.insert(alg->resultPairs.objB.end(),sgh->resultPairs.objB.begin(),sgh->resultPairs.objB.end());
+    sgh->resultPairs.objA.clear();
+    sgh->resultPairs.objB.clear();
     alg->resultPairs.duplicates += sgh->resultPairs.duplicates;
     alg->repA += sgh->repA;
     alg->repB += sgh->repB;
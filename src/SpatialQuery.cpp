@@ -55,6 +55,7 @@ namespace FLAT
 							temp.Region.high[0]  = atof(tokens.at(3).c_str());
 							temp.Region.high[1]  = atof(tokens.at(4).c_str());
 							temp.Region.high[2]  = atof(tokens.at(5).c_str());
+							temp.Region.isEmpty  = false;
 						queries.push_back(temp);
 					}
 					readFile.close();
@@ -91,6 +92,7 @@ namespace FLAT
 							temp.high[0]  = atof(tokens.at(3).c_str());
 							temp.high[1]  = atof(tokens.at(4).c_str());
 							temp.high[2]  = atof(tokens.at(5).c_str());
+							temp.isEmpty  = false;
 							tempQuery.Moving.push_back(temp);
 						}
 						queries.push_back(tempQuery);
@@ -181,6 +183,8 @@ namespace FLAT
 		FLAT_metaDataIOs=0;
 		FLAT_payLoadIOs=0;
 		FLAT_metaDataEntryLookup=0;
+		FLAT_payLoadCacheHits=0;
+		FLAT_payLoadCacheMisses=0;
 		FLAT_seedId=-1;
 
 		FLAT_prefetchMetaHits=0;
@@ -205,7 +209,9 @@ namespace FLAT
 		 FLAT_seedIOs     += qs.FLAT_seedIOs;
 		 FLAT_metaDataIOs += qs.FLAT_metaDataIOs;
 		 FLAT_payLoadIOs  +=qs.FLAT_payLoadIOs;
-		 FLAT_metaDataEntryLookup +=FLAT_metaDataEntryLookup;
+		 FLAT_metaDataEntryLookup +=qs.FLAT_metaDataEntryLookup;
+		 FLAT_payLoadCacheHits += qs.FLAT_payLoadCacheHits;
+		 FLAT_payLoadCacheMisses += qs.FLAT_payLoadCacheMisses;
 
 		 UselessPoints +=qs.UselessPoints;
 		 ResultPoints +=qs.ResultPoints;
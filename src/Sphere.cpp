@@ -68,9 +68,10 @@ namespace FLAT
 		return (DIMENSION+1) * sizeof(spaceUnit);
 	}
 
+	// distance to the ball, 0 inside it
 	bigSpaceUnit Sphere::pointDistance(Vertex& p)
 	{
-		std::cout << "ERROR: pointDistance method is not overloaded with this geometry: SPHERE" << std::endl;
-		return 0;
+		bigSpaceUnit d = sqrt(Vertex::squaredDistance(center,p)) - radius;
+		return d>0 ? d : 0;
 	}
 }
@@ -14,13 +14,13 @@ TOUCH::~TOUCH() {
 
 void TOUCH::run() {
     totalTimeStart();
-    readBinaryInput(file_dsA, file_dsB);
-    if (verbose) std::cout << "Forming the partitions" << std::endl; 
-    createPartitions(vdsA);
+    loadOrBuildA();
+    readBinaryInputB(file_dsB);
     if (verbose) std::cout << "Assigning the objects of B" << std::endl; 
     assignment();
     if (verbose) std::cout << "Assigning Done." << std::endl; 
     analyze();
+    splitOverloaded();
     if (verbose) std::cout << "Analysis Done" << std::endl; 
     if (verbose) std::cout << "Probing, doing the join" << std::endl; 
     probe();
@@ -30,67 +30,55 @@ void TOUCH::run() {
 
 void TOUCH::assignment()
 {
+    TRACE_SCOPE("assignment");
     building.start();
-    bool overlaps;
-    bool assigned;
     for (unsigned int i=0;i<dsB.size();++i)
     {
-        TreeEntry* obj = dsB[i];
+        assignObject(dsB[i]);
+    }
 
-        TreeNode* nextNode;
-        TreeNode* ptr = root;
+    building.stop();
+}
+
+/*
+ * Attach obj to the node found by findAssignment.
+ * Returns the node obj was attached to, or NULL if it was filtered.
+ */
+TreeNode* TOUCH::assignObject(TreeEntry* obj)
+{
+    TreeNode* node = findAssignment(obj);
+    if (node == NULL)
+        filtered[1] ++;
+    else
+        node->attachedObjs[1].push_back(obj);
+    return node;
+}
 
-        nextNode = NULL;        
-        
-        if ( FLAT::Box::overlap(obj->mbr,root->mbrL[0]) && root->entries.size() == 0)
-        {
-            root->attachedObjs[1].push_back(obj);
-            continue;
-        }
 
-        while(true)
+void TOUCH::joinNodeToDesc(TreeNode* ancestorNode)
+{
+    TRACE_SCOPE_ARG("join node","level",ancestorNode->level);
+    NodeWork work(ancestorNode,this);
+    if (ancestorNode->chunks.empty() || localJoin == algo_SGrid)
+    {
+        // the grid filters by itself: one grid over all objects, probed by the leaves near a chunk
+        joinToLeaves(ancestorNode,ancestorNode->attachedObjs[1],ancestorNode->chunkMbrs);
+    }
+    else
+    {
+        for (unsigned int c = 0; c < ancestorNode->chunks.size(); c++)
         {
-            overlaps = false;
-            assigned = false;
-            for (NodeList::iterator it = ptr->entries.begin(); it != ptr->entries.end(); it++)
-            {    
-                if ( FLAT::Box::overlap(obj->mbr,(*it)->mbr) )
-                {
-                    if(!overlaps)
-                    {
-                        overlaps = true;
-                        nextNode = (*it);
-                    }
-                    else
-                    {
-                        // assignment to current level
-                        ptr->attachedObjs[1].push_back(obj);
-                        assigned = true;
-                        break;
-                    }
-                }
-            }
-            if(assigned)
-                    break;
-            if(!overlaps)
-            {
-                filtered[1] ++;
-                break;
-            }
-            ptr = nextNode;
-            if(ptr->leafnode)
-            {
-                ptr->attachedObjs[1].push_back(obj);
-                break;
-            }
+            thrust::host_vector<FLAT::Box> mbrs(1,ancestorNode->chunkMbrs[c]);
+            joinToLeaves(ancestorNode,ancestorNode->chunks[c],mbrs);
         }
     }
-
-    building.stop();
 }
 
-
-void TOUCH::joinNodeToDesc(TreeNode* ancestorNode)
+/*
+ * Join objs, B objects attached to ancestorNode, with the leaves below it.
+ * If mbrs is not empty only the subtrees overlapping one of them are visited.
+ */
+void TOUCH::joinToLeaves(TreeNode* ancestorNode, SpatialObjectList& objs, thrust::host_vector<FLAT::Box>& mbrs)
 {
     SpatialGridHash* spatialGridHash;
     queue<TreeNode*> leaves;
@@ -100,42 +88,52 @@ void TOUCH::joinNodeToDesc(TreeNode* ancestorNode)
         spatialGridHash = new SpatialGridHash();
         spatialGridHash->init(this->universeA,localPartitions);
         spatialGridHash->epsilon = this->epsilon;
+        spatialGridHash->resultPairs.useMode(resultPairs);
         gridCalculate.start();
-        spatialGridHash->build(ancestorNode->attachedObjs[1]);
+        spatialGridHash->build(objs);
         gridCalculate.stop();
+        ancestorNode->gridCells[1] = spatialGridHash->cells().size();
     }
 
     leaves.push(ancestorNode);
+    comparing.start();
     while(leaves.size()>0)
     {
         leaf = leaves.front();
         leaves.pop();
         if(leaf->leafnode)
         {
-            ItemsMaxCompared += ancestorNode->attachedObjs[1].size()*leaf->attachedObjs[0].size();
-            comparing.start();
+            ItemsMaxCompared += objs.size()*leaf->attachedObjs[0].size();
             if(localJoin == algo_SGrid)
             {
                 spatialGridHash->probe(leaf->attachedObjs[0]);
             }
             else
             {
-                NL(leaf->attachedObjs[0],ancestorNode->attachedObjs[1]);
+                NL(leaf->attachedObjs[0],objs);
             }
-            comparing.stop();
         }
         else
         {
             for (NodeList::iterator it = leaf->entries.begin(); it != leaf->entries.end(); it++)
             {
-                leaves.push((*it));
+                bool near = mbrs.empty();
+                for (unsigned int c = 0; c < mbrs.size() && !near; c++)
+                    near = FLAT::Box::overlap(mbrs[c],(*it)->mbr);
+                if (near)
+                    leaves.push((*it));
+                else
+                    addFilter += objs.size()*((*it)->objBelow[0] + (*it)->attachedObjs[0].size());
             }
         }
     }
+    comparing.stop();
 
     if(localJoin == algo_SGrid)
     {
         spatialGridHash->resultPairs.deDuplicate();
         SpatialGridHash::transferInfo(spatialGridHash,this);
+        memGrids = std::max(memGrids,spatialGridHash->gridBytes());
+        delete spatialGridHash;
     }
-}
\ No newline at end of file
+}
@@ -6,10 +6,19 @@ namespace FLAT
 	Timer::Timer()
         : _is_running(false),
           _at_zero(true),
+          _counters(NULL),
+          _memory(NULL),
 		  _elapsed_milliseconds(0)
     {
     }
 
+	Timer::Timer(const Timer &rhs)
+        : _counters(NULL),
+          _memory(NULL)
+    {
+        *this = rhs;
+    }
+
     void Timer::start(const std::string& label)
     {
         _label = label;
@@ -0,0 +1,111 @@
+#include "Tracer.hpp"
+#include <time.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace FLAT
+{
+	bool Tracer::enabled = false;
+	Nanosecond Tracer::origin = 0;
+	pthread_key_t Tracer::key;
+	pthread_once_t Tracer::once = PTHREAD_ONCE_INIT;
+	pthread_mutex_t Tracer::lock = PTHREAD_MUTEX_INITIALIZER;
+	std::vector<Tracer::Buffer*> Tracer::buffers;
+
+	void Tracer::createKey()
+	{
+		pthread_key_create(&key,NULL);
+	}
+
+	Tracer::Buffer* Tracer::buffer()
+	{
+		pthread_once(&once,createKey);
+		Buffer* buf = (Buffer*)pthread_getspecific(key);
+		if (buf == NULL)
+		{
+			buf = new Buffer();
+			pthread_setspecific(key,buf);
+			pthread_mutex_lock(&lock);
+			buf->thread = buffers.size();
+			buffers.push_back(buf);
+			pthread_mutex_unlock(&lock);
+		}
+		return buf;
+	}
+
+	Nanosecond Tracer::now()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC,&ts);
+		return (Nanosecond)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+	}
+
+	void Tracer::enable()
+	{
+		origin = now();
+		enabled = true;
+	}
+
+	void Tracer::disable()
+	{
+		enabled = false;
+	}
+
+	void Tracer::clear()
+	{
+		pthread_mutex_lock(&lock);
+		for (std::vector<Buffer*>::iterator it = buffers.begin(); it != buffers.end(); it++)
+			(*it)->events.clear();
+		pthread_mutex_unlock(&lock);
+	}
+
+	void Tracer::record(const char* name, Nanosecond begin, Nanosecond end, const char* argName, int64 arg)
+	{
+		Event event;
+		event.name = name;
+		event.argName = argName;
+		event.arg = arg;
+		event.begin = begin;
+		event.end = end;
+		buffer()->events.push_back(event);
+	}
+
+	/*
+	 * Complete events ("ph":"X") with microsecond timestamps relative to
+	 * enable(); nesting is derived by the viewer from the times per thread.
+	 */
+	bool Tracer::write(const std::string& fileName)
+	{
+		std::ofstream out(fileName.c_str());
+		if (!out.good())
+		{
+			std::cout << "Cannot create trace file " << fileName << std::endl;
+			return false;
+		}
+		out << std::fixed << std::setprecision(3);
+		out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+		bool first = true;
+		pthread_mutex_lock(&lock);
+		for (std::vector<Buffer*>::iterator it = buffers.begin(); it != buffers.end(); it++)
+		{
+			out << (first ? "" : ",\n")
+			    << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << (*it)->thread
+			    << ",\"args\":{\"name\":\"thread " << (*it)->thread << "\"}}";
+			first = false;
+			for (std::vector<Event>::iterator e = (*it)->events.begin(); e != (*it)->events.end(); e++)
+			{
+				if (e->begin < origin) continue;
+				out << ",\n{\"name\":\"" << e->name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (*it)->thread
+				    << ",\"ts\":" << (e->begin - origin)/1000.0
+				    << ",\"dur\":" << (e->end - e->begin)/1000.0;
+				if (e->argName != NULL)
+					out << ",\"args\":{\"" << e->argName << "\":" << e->arg << "}";
+				out << "}";
+			}
+		}
+		pthread_mutex_unlock(&lock);
+		out << "\n]}\n";
+		return true;
+	}
+}
@@ -308,7 +308,7 @@ namespace FLAT
 		}
 
 
-		return sqrDistance;
+		return sqrDistance>0 ? sqrt(sqrDistance) : 0;
 	}
 
 	// Mihas implementation converted
@@ -474,7 +474,7 @@ namespace FLAT
 	    	closest_point.Vector[i] = vertex1.Vector[i] + s *u.Vector[i] + t *v.Vector[i];
 
 	    sqrDistance = Vertex::squaredDistance(closest_point,P);
-	    return sqrDistance;
+	    return sqrDistance>0 ? sqrt(sqrDistance) : 0;
 
 	}
 
@@ -233,6 +233,6 @@ static boost::mt11213b generator (42u);
 
 	bigSpaceUnit Vertex::pointDistance(Vertex& p)
 	{
-		return squaredDistance(*this,p);
+		return sqrt(squaredDistance(*this,p));
 	}
 }
@@ -0,0 +1,147 @@
+/*
+ * File:   WorkStealingPool.cpp
+ *
+ */
+
+#include "WorkStealingPool.h"
+
+#include <sched.h>
+
+#define IDLE_ROUNDS 64      // failed takes of a worker before it sleeps
+
+WorkStealingPool::WorkStealingPool(int nthreads) {
+    threads = (nthreads < 1) ? 1 : nthreads;
+    steals = 0;
+    pending = 0;
+    queued = 0;
+    sleeping = 0;
+    pthread_mutex_init(&idleLock,NULL);
+    pthread_cond_init(&workAvailable,NULL);
+    for (int i = 0; i < threads; i++)
+    {
+        Worker* worker = new Worker();
+        worker->pool = this;
+        worker->id = i;
+        pthread_mutex_init(&worker->lock,NULL);
+        workers.push_back(worker);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    for (std::vector<Worker*>::iterator it = workers.begin(); it != workers.end(); it++)
+    {
+        pthread_mutex_destroy(&(*it)->lock);
+        delete (*it);
+    }
+    pthread_cond_destroy(&workAvailable);
+    pthread_mutex_destroy(&idleLock);
+}
+
+void WorkStealingPool::spawn(PoolTask* task, int worker)
+{
+    __sync_fetch_and_add(&pending,1);
+    pthread_mutex_lock(&workers[worker]->lock);
+    workers[worker]->tasks.push_back(task);
+    pthread_mutex_unlock(&workers[worker]->lock);
+
+    // the counters are full barriers: either the sleeper sees the task or the task sees the sleeper
+    __sync_fetch_and_add(&queued,1);
+    if (sleeping > 0)
+    {
+        pthread_mutex_lock(&idleLock);
+        pthread_cond_signal(&workAvailable);
+        pthread_mutex_unlock(&idleLock);
+    }
+}
+
+void WorkStealingPool::run(PoolTask* task)
+{
+    spawn(task,0);
+    for (int i = 0; i < threads; i++)
+        pthread_create(&workers[i]->thread,NULL,workerMain,workers[i]);
+    for (int i = 0; i < threads; i++)
+        pthread_join(workers[i]->thread,NULL);
+}
+
+/*
+ * Newest own task, otherwise the oldest task of another worker.
+ */
+PoolTask* WorkStealingPool::take(int worker)
+{
+    PoolTask* task = NULL;
+    Worker* own = workers[worker];
+    pthread_mutex_lock(&own->lock);
+    if (!own->tasks.empty())
+    {
+        task = own->tasks.back();
+        own->tasks.pop_back();
+        __sync_fetch_and_sub(&queued,1);
+    }
+    pthread_mutex_unlock(&own->lock);
+    if (task != NULL)
+        return task;
+
+    for (int i = 1; i < threads && task == NULL; i++)
+    {
+        Worker* victim = workers[(worker+i)%threads];
+        pthread_mutex_lock(&victim->lock);
+        if (!victim->tasks.empty())
+        {
+            task = victim->tasks.front();
+            victim->tasks.pop_front();
+            __sync_fetch_and_sub(&queued,1);
+            __sync_fetch_and_add(&steals,1);
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return task;
+}
+
+/*
+ * Sleep until a task is queued or all tasks are done.
+ */
+void WorkStealingPool::waitForWork()
+{
+    pthread_mutex_lock(&idleLock);
+    __sync_fetch_and_add(&sleeping,1);
+    while (queued == 0 && pending > 0)
+        pthread_cond_wait(&workAvailable,&idleLock);
+    __sync_fetch_and_sub(&sleeping,1);
+    pthread_mutex_unlock(&idleLock);
+}
+
+void WorkStealingPool::wakeAll()
+{
+    pthread_mutex_lock(&idleLock);
+    pthread_cond_broadcast(&workAvailable);
+    pthread_mutex_unlock(&idleLock);
+}
+
+void* WorkStealingPool::workerMain(void* arg)
+{
+    Worker* worker = (Worker*)arg;
+    WorkStealingPool* pool = worker->pool;
+    PoolTask* task;
+    int idle = 0;
+    while (pool->pending > 0)
+    {
+        task = pool->take(worker->id);
+        if (task == NULL)
+        {
+            if (++idle < IDLE_ROUNDS)
+                sched_yield();
+            else
+            {
+                pool->waitForWork();
+                idle = 0;
+            }
+            continue;
+        }
+        idle = 0;
+        task->run(*pool,worker->id);
+        delete task;
+        if (__sync_sub_and_fetch(&pool->pending,1) == 0)
+            pool->wakeAll();
+    }
+    return NULL;
+}